@@ -0,0 +1,408 @@
+// Accuracy vs throughput of the Space configurations that trade one for the
+// other (timestep, block timesteps, cutoff and particle-mesh gravity,
+// broadphases, reordering).
+//
+//   g++ -std=c++11 -O2 -pthread -I../src accuracy_suite.cpp -o accuracy_suite
+//   ./accuracy_suite [baseline file] [--record]
+//
+// Every scenario is first run as a reference with 16 substeps per step, then
+// once per configuration. For each configuration the suite reports the drift
+// of total (kinetic + potential) energy and of momentum over the run, how far
+// the bodies end up from the reference (RMS, relative to the world size), and
+// steps per second relative to plain direct summation at the same dt, so the
+// numbers carry over between machines. The two are timed in alternation, each
+// sample repeated until it covers a minimum time and the fastest of several
+// samples counting, so load on the machine slows both alike rather than
+// failing the speed check.
+//
+// The results are compared with the recorded baseline (accuracy_baseline.txt
+// by default) and the run fails if any configuration got less accurate or
+// slower than its recorded point by more than the tolerances below. Run with
+// --record after an intended change to accept the new points.
+
+#include "Space.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace flatics;
+
+typedef double Scalar;
+typedef Vector2<Scalar> Vec;
+typedef Circle<Scalar, Vec> Object;
+typedef Space<Scalar, Vec> World;
+typedef ParticleMesh<Scalar, Vec> Mesh;
+
+// an error may grow by this factor (plus a floor for values near zero) and
+// the relative throughput may shrink by this factor before the suite fails
+const double ERROR_TOLERANCE = 1.5;
+const double ERROR_FLOOR = 1e-9;
+const double SPEED_TOLERANCE = 0.75;
+
+const size_t REFERENCE_SUBSTEPS = 16;
+
+// each configuration and direct summation are timed this many times, in
+// turn, and the fastest of each counts; a time is of as many runs as it takes
+// to cover MIN_TIMING_SECONDS
+const size_t TIMING_RUNS = 5;
+const double MIN_TIMING_SECONDS = 0.05;
+
+struct Scenario {
+  std::string name;
+  size_t width, height;
+  World::BoundaryMode boundary;
+  Scalar dt;
+  size_t steps;
+  std::function<void(World&)> populate;
+  std::function<void(World&)> reference; // solver set up for the reference run
+};
+
+struct Configuration {
+  std::string name;
+  size_t dt_multiple; // steps of this many dt at a time
+  std::function<void(World&)> setup;
+};
+
+struct Point {
+  double energy_drift;
+  double momentum_drift;
+  double divergence;
+  double speedup;
+};
+
+/** Displacement from a to b, through the edges of a wrapped world */
+Vec separation(const Vec& a, const Vec& b, const Scenario& scenario) {
+  Vec d = b - a;
+
+  if (scenario.boundary == World::WRAP) {
+    if (d.x > scenario.width / 2.0) d.x -= scenario.width;
+    if (d.x < -(scenario.width / 2.0)) d.x += scenario.width;
+    if (d.y > scenario.height / 2.0) d.y -= scenario.height;
+    if (d.y < -(scenario.height / 2.0)) d.y += scenario.height;
+  }
+
+  return d;
+}
+
+/** Kinetic plus Newtonian potential energy, whatever gravity the world was simulated with */
+double totalEnergy(const World& world, const Scenario& scenario) {
+  const World::Objects& objects = world.objects();
+  double total = world.energy();
+
+  for (size_t i = 0; i < objects.size(); ++i)
+  for (size_t j = i + 1; j < objects.size(); ++j) {
+    double r = separation(objects[i].position(), objects[j].position(), scenario).length();
+
+    if (r > 0)
+      total -= G * objects[i].mass() * objects[j].mass() / r;
+  }
+
+  return total;
+}
+
+/** Sum of |p| over the bodies, the scale momentum drift is measured against */
+double momentumScale(const World& world) {
+  double total = 0;
+
+  for (const Object& obj : world.objects())
+    total += obj.momentum().length();
+
+  return total;
+}
+
+/** RMS distance of every body from where the reference put it, matched by id */
+double divergence(const World& world, const World& reference, const Scenario& scenario) {
+  double sum = 0;
+
+  for (size_t i = 0; i < reference.objects().size(); ++i) {
+    size_t id = reference.ids()[i];
+    const Vec& expected = reference.objects()[i].position();
+    const Vec& actual = world.objects()[world.indexOf(id)].position();
+    sum += separation(expected, actual, scenario).squared();
+  }
+
+  return std::sqrt(sum / reference.objects().size()) / std::sqrt(double(scenario.width) * scenario.height);
+}
+
+/** Run the scenario with a configuration, returning the seconds it took */
+double simulate(World& world, const Scenario& scenario, size_t dt_multiple) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t step = 0; step < scenario.steps; step += dt_multiple)
+    world.update(scenario.dt * dt_multiple);
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Seconds per run of the scenario with a configuration, over fresh runs until MIN_TIMING_SECONDS have passed */
+double timeRuns(const Scenario& scenario, const Configuration& config) {
+  double total = 0;
+  size_t runs = 0;
+
+  do {
+    World world(scenario.width, scenario.height, scenario.boundary);
+    scenario.populate(world);
+    config.setup(world);
+    total += simulate(world, scenario, config.dt_multiple);
+    ++runs;
+  } while (total < MIN_TIMING_SECONDS);
+
+  return total / runs;
+}
+
+std::vector<Scenario> scenarios() {
+  std::vector<Scenario> all;
+
+  // a light satellite around a heavy planet: one fast body among slow ones
+  Scenario orbit = { "orbit", 1600, 900, World::NONE, Scalar(1) / 256, 1024, nullptr, nullptr };
+  orbit.populate = [](World& world) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<Scalar> x(100, 1500), y(50, 850), v(-3, 3);
+
+    world.setRestitutionModel(World::ELASTIC);
+    world.addCircle(Scalar(50), Scalar(1e17), Vec(800, 500), Vec());
+    world.addCircle(Scalar(3), Scalar(100), Vec(800, 200), Vec(std::sqrt(G * 1e17 / 300), 0));
+
+    for (size_t i = 0; i < 60;) {
+      Vec position(x(rng), y(rng));
+      if ((position - Vec(800, 500)).length() < 400)
+        continue;
+
+      world.addCircle(Scalar(5), Scalar(1), position, Vec(v(rng), v(rng)));
+      ++i;
+    }
+  };
+  all.push_back(orbit);
+
+  // a self-gravitating cloud with elastic encounters
+  Scenario cloud = { "cloud", 2000, 2000, World::NONE, Scalar(1) / 64, 512, nullptr, nullptr };
+  cloud.populate = [](World& world) {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<Scalar> p(700, 1300), v(-2, 2);
+
+    world.setRestitutionModel(World::ELASTIC);
+
+    for (size_t i = 0; i < 150; ++i)
+      world.addCircle(Scalar(2), Scalar(1e14), Vec(p(rng), p(rng)), Vec(v(rng), v(rng)));
+  };
+  all.push_back(cloud);
+
+  // a uniform wrapped world, where direct summation misses the periodic
+  // images, so the reference is a fine P3M mesh instead
+  Scenario periodic = { "periodic", 512, 512, World::WRAP, Scalar(1) / 64, 256, nullptr, nullptr };
+  periodic.populate = [](World& world) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<Scalar> p(0, 512), v(-5, 5);
+
+    world.setRestitutionModel(World::ELASTIC);
+
+    for (size_t i = 0; i < 256; ++i)
+      world.addCircle(Scalar(1.5), Scalar(1e13), Vec(p(rng), p(rng)), Vec(v(rng), v(rng)));
+  };
+  periodic.reference = [](World& world) { world.setParticleMesh(256, 256, Mesh::TSC, 24); };
+  all.push_back(periodic);
+
+  return all;
+}
+
+std::map<std::string, std::vector<Configuration> > configurations() {
+  std::map<std::string, std::vector<Configuration> > all;
+
+  Configuration direct = { "direct", 1, [](World&) {} };
+  Configuration coarse = { "direct-dt*4", 4, [](World&) {} };
+  Configuration block = { "block-timesteps", 1, [](World& world) { world.setBlockTimesteps(6, Scalar(0.25)); } };
+  Configuration cutoff = { "cutoff-gravity", 1, [](World& world) { world.setCutoffGravity(200); } };
+  Configuration tree = { "aabb-tree", 1, [](World& world) { world.setBroadphase(World::AABB_TREE); } };
+  Configuration sap = { "sweep-and-prune", 1, [](World& world) { world.setBroadphase(World::SWEEP_AND_PRUNE); } };
+  Configuration morton = { "morton-reorder", 1, [](World& world) { world.setReorderPolicy(32); } };
+
+  all["orbit"] = { direct, coarse, block, tree };
+  all["cloud"] = { direct, coarse, block, cutoff, tree, sap, morton };
+
+  all["periodic"] = {
+    direct,
+    { "pm-64", 1, [](World& world) { world.setParticleMesh(64, 64); } },
+    { "pm-128-tsc", 1, [](World& world) { world.setParticleMesh(128, 128, Mesh::TSC); } },
+    { "p3m-64", 1, [](World& world) { world.setParticleMesh(64, 64, Mesh::CIC, 24); } },
+    { "cutoff-gravity", 1, [](World& world) { world.setCutoffGravity(64); } },
+  };
+
+  return all;
+}
+
+std::map<std::string, Point> readBaseline(const std::string& path) {
+  std::map<std::string, Point> baseline;
+  std::ifstream in(path.c_str());
+  std::string line;
+
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    std::string scenario, configuration;
+    Point point;
+
+    if (fields >> scenario >> configuration >> point.energy_drift >> point.momentum_drift >> point.divergence >> point.speedup)
+      baseline[scenario + " " + configuration] = point;
+  }
+
+  return baseline;
+}
+
+/** Whether some other point of the same scenario is at least as good on error and speed and better on one */
+bool dominated(const Point& point, const std::vector<Point>& others) {
+  for (const Point& other : others) {
+    bool no_worse = other.divergence <= point.divergence && other.speedup >= point.speedup;
+    bool better = other.divergence < point.divergence || other.speedup > point.speedup;
+
+    if (no_worse && better)
+      return true;
+  }
+
+  return false;
+}
+
+int main(int argc, char* argv[]) {
+  std::string path = "accuracy_baseline.txt";
+  bool record = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--record") == 0)
+      record = true;
+    else
+      path = argv[i];
+  }
+
+  const std::map<std::string, Point> baseline = readBaseline(path);
+  std::map<std::string, std::vector<Configuration> > all_configurations = configurations();
+
+  std::ostringstream recorded;
+  recorded << "# scenario configuration energy_drift momentum_drift divergence speedup\n";
+  recorded << std::setprecision(4);
+
+  size_t failures = 0;
+
+  std::cout << std::left << std::setw(10) << "scenario" << std::setw(18) << "configuration"
+            << std::right << std::setw(12) << "energy" << std::setw(12) << "momentum"
+            << std::setw(12) << "divergence" << std::setw(12) << "steps/s" << std::setw(9) << "speedup" << "  status" << std::endl;
+
+  for (const Scenario& scenario : scenarios()) {
+    World reference(scenario.width, scenario.height, scenario.boundary);
+    scenario.populate(reference);
+
+    if (scenario.reference)
+      scenario.reference(reference);
+
+    const double initial_energy = totalEnergy(reference, scenario);
+    const Vec initial_momentum = reference.momentum();
+    const double momentum_scale = std::max(momentumScale(reference), 1e-30);
+
+    for (size_t step = 0; step < scenario.steps * REFERENCE_SUBSTEPS; ++step)
+      reference.update(scenario.dt / REFERENCE_SUBSTEPS);
+
+    const std::vector<Configuration>& configs = all_configurations[scenario.name];
+    std::vector<Point> points;
+
+    for (const Configuration& config : configs) {
+      World world(scenario.width, scenario.height, scenario.boundary);
+      scenario.populate(world);
+      config.setup(world);
+      simulate(world, scenario, config.dt_multiple);
+
+      // direct summation is timed alongside, so both see the same load
+      const bool direct = config.name == configs.front().name;
+      double seconds = 1e300, direct_seconds = 1e300;
+
+      for (size_t run = 0; run < TIMING_RUNS; ++run) {
+        seconds = std::min(seconds, timeRuns(scenario, config));
+
+        if (!direct)
+          direct_seconds = std::min(direct_seconds, timeRuns(scenario, configs.front()));
+      }
+
+      // in steps of dt, so coarser steps count for the time they cover
+      double rate = scenario.steps / seconds;
+
+      Point point;
+      point.energy_drift = std::fabs(totalEnergy(world, scenario) - initial_energy) / std::fabs(initial_energy);
+      point.momentum_drift = (world.momentum() - initial_momentum).length() / momentum_scale;
+      point.divergence = divergence(world, reference, scenario);
+      point.speedup = direct ? 1 : direct_seconds / seconds;
+      points.push_back(point);
+
+      std::string key = scenario.name + " " + config.name;
+      std::string status = "new";
+      std::map<std::string, Point>::const_iterator recorded_point = baseline.find(key);
+
+      if (recorded_point != baseline.end()) {
+        const Point& old = recorded_point->second;
+        std::vector<std::string> worse;
+
+        if (point.energy_drift > old.energy_drift * ERROR_TOLERANCE + ERROR_FLOOR)
+          worse.push_back("energy");
+        if (point.momentum_drift > old.momentum_drift * ERROR_TOLERANCE + ERROR_FLOOR)
+          worse.push_back("momentum");
+        if (point.divergence > old.divergence * ERROR_TOLERANCE + ERROR_FLOOR)
+          worse.push_back("divergence");
+        if (point.speedup < old.speedup * SPEED_TOLERANCE)
+          worse.push_back("speed");
+
+        if (worse.empty()) {
+          status = "ok";
+        } else {
+          status = "FAIL:";
+          for (const std::string& what : worse)
+            status += " " + what;
+          ++failures;
+        }
+      }
+
+      std::cout << std::left << std::setw(10) << scenario.name << std::setw(18) << config.name
+                << std::right << std::scientific << std::setprecision(2)
+                << std::setw(12) << point.energy_drift << std::setw(12) << point.momentum_drift
+                << std::setw(12) << point.divergence << std::fixed << std::setprecision(0)
+                << std::setw(12) << rate << std::setprecision(2) << std::setw(9) << point.speedup
+                << "  " << status << std::endl;
+
+      recorded << scenario.name << ' ' << config.name << ' ' << point.energy_drift << ' '
+               << point.momentum_drift << ' ' << point.divergence << ' ' << point.speedup << '\n';
+    }
+
+    std::cout << "  off the divergence/speed front:";
+    bool any = false;
+    for (size_t c = 0; c < configs.size(); ++c) {
+      if (dominated(points[c], points)) {
+        std::cout << ' ' << configs[c].name;
+        any = true;
+      }
+    }
+    std::cout << (any ? "" : " none") << '\n' << std::endl;
+  }
+
+  if (record) {
+    std::ofstream out(path.c_str());
+    out << recorded.str();
+    std::cout << "recorded " << path << std::endl;
+    return 0;
+  }
+
+  if (failures != 0) {
+    std::cout << failures << " configuration(s) moved off their recorded point" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
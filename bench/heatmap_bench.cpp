@@ -0,0 +1,130 @@
+// Heatmap rasterization throughput, headless.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src heatmap_bench.cpp -o heatmap_bench
+//   ./heatmap_bench [bodies, default 1000000] [--write]
+//
+// Splats a clustered cloud of bodies into a 1600x900 field as counts, mass
+// and mean speed, with and without blur, serially and on a thread pool, and
+// compares against building the RenderList for the same frame. The serial
+// and pooled fields sum in a different order, so they are compared to within
+// float rounding. --write saves each image as heatmap-<quantity>.ppm.
+
+#include "Heatmap.h"
+#include "RenderList.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace flatics;
+
+/** Milliseconds per build, best of a few batches */
+template<class Builder>
+double buildTime(Builder& builder, const RenderSnapshot<double>& snapshot, const RenderCamera& camera, ThreadPool* pool) {
+  double best = 1e30;
+
+  for (int batch = 0; batch < 3; ++batch) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 5; ++i)
+      builder.build(snapshot, camera, pool);
+
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 5);
+  }
+
+  return best * 1e3;
+}
+
+/** Largest difference between two fields, relative to the larger maximum */
+double difference(const Heatmap& a, const Heatmap& b) {
+  double worst = 0;
+
+  for (size_t p = 0; p < a.field().size(); ++p)
+    worst = std::max(worst, double(std::abs(a.field()[p] - b.field()[p])));
+
+  return worst / std::max(1e-30, double(std::max(a.maximum(), b.maximum())));
+}
+
+int main(int argc, char** argv) {
+  size_t count = 1000000;
+  bool write = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--write") == 0)
+      write = true;
+    else
+      count = std::strtoul(argv[i], nullptr, 10);
+  }
+
+  // a few galaxies' worth of clusters in a 16000 x 9000 world
+  RenderSnapshot<double> snapshot;
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> normal(0, 1);
+
+  snapshot.count = count;
+  snapshot.x.resize(count);
+  snapshot.y.resize(count);
+  snapshot.vx.resize(count);
+  snapshot.vy.resize(count);
+  snapshot.mass.resize(count);
+  snapshot.radius.assign(count, 1.0);
+  snapshot.id.resize(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const double cx = 2000 + 12000 * std::floor(uniform(rng) * 4) / 3, cy = 1500 + 6000 * std::floor(uniform(rng) * 2);
+    const double r = 900 * std::abs(normal(rng)), angle = 6.283185307179586 * uniform(rng);
+
+    snapshot.x[i] = cx + r * std::cos(angle);
+    snapshot.y[i] = cy + r * std::sin(angle);
+    snapshot.vx[i] = -std::sin(angle) * std::sqrt(r);
+    snapshot.vy[i] = std::cos(angle) * std::sqrt(r);
+    snapshot.mass[i] = 1 + 9 * uniform(rng);
+    snapshot.id[i] = i;
+  }
+
+  const RenderCamera camera = { 0, 0, 0.1, 1600, 900 };
+  const char* NAMES[] = { "count", "mass", "speed" };
+
+  ThreadPool pool;
+  Heatmap serial, parallel;
+  RenderList<> list;
+
+  std::cout << count << " bodies into " << camera.width << "x" << camera.height << ", " << pool.size() << " workers" << std::endl
+            << std::setw(8) << std::left << "field" << std::right << std::setw(6) << "blur" << std::setw(11) << "serial ms"
+            << std::setw(11) << "pool ms" << std::setw(12) << "difference" << std::endl;
+
+  bool same = true;
+
+  for (int quantity = Heatmap::COUNT; quantity <= Heatmap::SPEED; ++quantity) {
+    for (double sigma : { 0.0, 2.0 }) {
+      serial.setQuantity(Heatmap::Quantity(quantity));
+      parallel.setQuantity(Heatmap::Quantity(quantity));
+      serial.setBlur(sigma);
+      parallel.setBlur(sigma);
+
+      const double serial_ms = buildTime(serial, snapshot, camera, nullptr);
+      const double pool_ms = buildTime(parallel, snapshot, camera, &pool);
+      const double diff = difference(serial, parallel);
+      same = same && diff < 1e-5;
+
+      std::cout << std::setw(8) << std::left << NAMES[quantity] << std::right << std::fixed << std::setprecision(1) << std::setw(6) << sigma
+                << std::setprecision(2) << std::setw(11) << serial_ms << std::setw(11) << pool_ms
+                << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::endl;
+
+      if (write && sigma > 0)
+        parallel.writePpm(std::string("heatmap-") + NAMES[quantity] + ".ppm");
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(2) << "render list of the same frame: " << buildTime(list, snapshot, camera, &pool) << " ms, "
+            << list.vertices().size() << " vertices" << std::endl;
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// Microbenchmarks of the Vector2 operations and the Circle/Space kernels.
+//
+//   g++ -std=c++11 -O2 -I../src kernel_bench.cpp -o kernel_bench
+//
+// Add -DFLATICS_SIMD_VECTOR2 to measure the SSE2 Vector2 specializations
+// instead of the scalar class.
+
+#include "Benchmark.h"
+#include "Circle.h"
+#include "Space.h"
+#include "StepPolicies.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace flatics;
+
+template<typename Scalar>
+class KernelBench {
+private:
+  typedef Vector2<Scalar> Vec;
+  typedef Circle<Scalar, Vec> Object;
+
+  // enough inputs to defeat constant folding, few enough to stay in L1
+  static const size_t COUNT = 256;
+  static const size_t MASK = COUNT - 1;
+
+  Benchmark& bench_;
+  std::string suffix_;
+
+  std::vector<Vec> a_, b_;
+  std::vector<Scalar> s_;
+  std::vector<Object> objects_;
+
+  std::string name(const char* kernel) const { return kernel + suffix_; }
+
+  /** Put two circles back into an overlapping configuration */
+  void overlap(Object& obj1, Object& obj2, size_t i) {
+    obj1.setPosition(a_[i]);
+    obj2.setPosition(a_[i] + Vec(3, 4));
+  }
+
+public:
+  KernelBench(Benchmark& bench, const char* suffix) : bench_(bench), suffix_(suffix) {
+    std::uniform_real_distribution<Scalar> value(-100, 100);
+    std::uniform_real_distribution<Scalar> radius(3, 15);
+
+    for (size_t i = 0; i < COUNT; ++i) {
+      a_.emplace_back(value(randGen), value(randGen));
+      b_.emplace_back(value(randGen), value(randGen));
+      s_.push_back(value(randGen));
+
+      Scalar rad = radius(randGen);
+      objects_.emplace_back(rad, rad * rad, a_[i], b_[i]);
+    }
+  }
+
+  void vectorOperations() {
+    bench_.run(name("a + b"), [this](size_t i) { doNotOptimize(a_[i & MASK] + b_[i & MASK]); });
+    bench_.run(name("a - b"), [this](size_t i) { doNotOptimize(a_[i & MASK] - b_[i & MASK]); });
+    bench_.run(name("-a"), [this](size_t i) { doNotOptimize(-a_[i & MASK]); });
+    bench_.run(name("a * s"), [this](size_t i) { doNotOptimize(a_[i & MASK] * s_[i & MASK]); });
+    bench_.run(name("s * a"), [this](size_t i) { doNotOptimize(s_[i & MASK] * a_[i & MASK]); });
+    bench_.run(name("a / s"), [this](size_t i) { doNotOptimize(a_[i & MASK] / s_[i & MASK]); });
+    bench_.run(name("a += b"), [this](size_t i) { a_[i & MASK] += b_[i & MASK]; doNotOptimize(a_[i & MASK]); });
+    bench_.run(name("a -= b"), [this](size_t i) { a_[i & MASK] -= b_[i & MASK]; doNotOptimize(a_[i & MASK]); });
+    bench_.run(name("a *= s"), [this](size_t i) { Vec v(a_[i & MASK]); v *= s_[i & MASK]; doNotOptimize(v); });
+    bench_.run(name("a /= s"), [this](size_t i) { Vec v(a_[i & MASK]); v /= s_[i & MASK]; doNotOptimize(v); });
+    bench_.run(name("dotProduct"), [this](size_t i) { doNotOptimize(Vec::dotProduct(a_[i & MASK], b_[i & MASK])); });
+    bench_.run(name("squared"), [this](size_t i) { doNotOptimize(a_[i & MASK].squared()); });
+    bench_.run(name("length"), [this](size_t i) { doNotOptimize(a_[i & MASK].length()); });
+    bench_.run(name("distance"), [this](size_t i) { doNotOptimize(Vec::distance(a_[i & MASK], b_[i & MASK])); });
+    bench_.run(name("normalized"), [this](size_t i) { doNotOptimize(a_[i & MASK].normalized()); });
+    bench_.run(name("normalized(length)"), [this](size_t i) { doNotOptimize(a_[i & MASK].normalized(s_[i & MASK])); });
+    bench_.run(name("normalizedFast"), [this](size_t i) { doNotOptimize(a_[i & MASK].normalizedFast()); });
+    bench_.run(name("Vec(length, direction)"), [this](size_t i) { doNotOptimize(Vec(s_[i & MASK], a_[i & MASK])); });
+    bench_.run(name("angle"), [this](size_t i) { doNotOptimize(a_[i & MASK].angle()); });
+    bench_.run(name("addLength"), [this](size_t i) { Vec v(a_[i & MASK]); v.addLength(1); doNotOptimize(v); });
+  }
+
+  void kernels() {
+    bench_.run(name("vectorCollision (x2)"), [this](size_t i) {
+      const Object& obj1 = objects_[i & MASK];
+      const Object& obj2 = objects_[(i + 1) & MASK];
+      doNotOptimize(Object::vectorCollision(0.6, obj1.mass(), obj1.position(), obj1.velocity(), obj2.mass(), obj2.position(), obj2.velocity()));
+      doNotOptimize(Object::vectorCollision(0.6, obj2.mass(), obj2.position(), obj2.velocity(), obj1.mass(), obj1.position(), obj1.velocity()));
+    });
+
+    bench_.run(name("collide"), [this](size_t i) {
+      Object::collide(objects_[i & MASK], objects_[(i + 1) & MASK]);
+    });
+
+    bench_.run(name("overlap reset"), [this](size_t i) {
+      overlap(objects_[i & MASK], objects_[(i + 1) & MASK], i & MASK);
+    });
+
+    bench_.run(name("unoverlap (+reset)"), [this](size_t i) {
+      Object& obj1 = objects_[i & MASK];
+      Object& obj2 = objects_[(i + 1) & MASK];
+      overlap(obj1, obj2, i & MASK);
+      Object::unoverlap(obj1, obj2);
+    });
+
+    bench_.run(name("applyGravity"), [this](size_t i) {
+      Space<Scalar, Vec>::applyGravity(objects_[i & MASK], objects_[(i + 1) & MASK]);
+    });
+
+    bench_.run(name("bounceBoundaries"), [this](size_t i) {
+      // a 200x200 world with the inputs spread over [-100, 100]^2, so most
+      // bodies end up against a wall
+      BounceBoundary::apply(objects_[i & MASK], Scalar(200), Scalar(200), Scalar(1));
+    });
+
+    bench_.run(name("wrapBoundaries"), [this](size_t i) {
+      WrapBoundary::apply(objects_[i & MASK], Scalar(200), Scalar(200), Scalar(1));
+    });
+  }
+};
+
+int main() {
+  if (!Benchmark::pin(0))
+    std::cerr << "warning: could not pin the benchmark thread" << std::endl;
+
+#ifdef FLATICS_SIMD
+  std::cout << "Vector2 with SSE2 specializations" << std::endl;
+#else
+  std::cout << "Vector2 scalar" << std::endl;
+#endif
+
+  Benchmark bench;
+
+  KernelBench<double> doubles(bench, " <double>");
+  KernelBench<float> floats(bench, " <float>");
+
+  Benchmark::reportHeader();
+  doubles.vectorOperations();
+  floats.vectorOperations();
+  doubles.kernels();
+  floats.kernels();
+
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Body storage on huge pages and first-touch placement, against the default allocator.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src memory_bench.cpp -o memory_bench
+//
+// Two measurements. The first walks four million bodies in a random order,
+// summing their kinetic energy, with the array in a std::vector with the
+// default allocator and in one from BodyAllocator with huge pages; visiting
+// bodies all over the array is what contact pairs and neighbour lists do, and
+// it is bound by TLB misses long before bandwidth. The second steps a Space
+// of 200000 colliding bodies on a thread pool with the memory policy off, with
+// huge pages, and with huge pages plus first-touch placement and a pinned pool.
+//
+// Reserved huge pages have to be set up beforehand (vm.nr_hugepages); without
+// them the allocator falls back to transparent huge pages, and the mappings
+// column shows which one it got. NUMA effects only show on a machine with more
+// than one node.
+
+#include "Allocator.h"
+#include "Circle.h"
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace flatics;
+
+typedef Circle<double, Vector2<double> > Body;
+typedef Space<double, Vector2<double> > World;
+
+/** Nanoseconds per body of a random-order pass over bodies, best of a few */
+template<class Bodies>
+double gatherTime(const Bodies& bodies, const std::vector<uint32_t>& order) {
+  double best = 1e30, energy = 0;
+
+  for (int pass = 0; pass < 5; ++pass) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i : order) {
+      const Body& body = bodies[i];
+      energy += 0.5 * body.mass() * body.velocity().squared();
+    }
+
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  // keep the sum alive
+  if (energy < 0)
+    std::cout << energy;
+
+  return best * 1e9 / order.size();
+}
+
+template<class Bodies>
+void fill(Bodies& bodies, size_t count) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> value(0, 1000);
+
+  bodies.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    bodies.emplace_back(1.0, value(rng), Vector2<double>(value(rng), value(rng)), Vector2<double>(value(rng), value(rng)));
+}
+
+std::string mappings(const MemoryPolicy& policy) {
+  return std::to_string(policy.huge_mappings.load()) + " huge, " + std::to_string(policy.transparent_mappings.load()) + " transparent, " +
+         std::to_string(policy.page_mappings.load()) + " plain";
+}
+
+/** Milliseconds per step of a collision-only Space, best of a few batches */
+double stepTime(bool hugePages, bool firstTouch, ThreadPool& pool, std::string& mapped) {
+  World world(10000, 10000);
+  world.setObjectGravity(false);
+  world.setBroadphase(World::AABB_TREE);
+  world.setThreadPool(&pool);
+  world.setMemoryPolicy(hugePages, firstTouch);
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<double> position(10, 9990), velocity(-20, 20);
+
+  for (size_t i = 0; i < 200000; ++i)
+    world.addCircle(2.0, 1.0, Vector2<double>(position(rng), position(rng)), Vector2<double>(velocity(rng), velocity(rng)));
+
+  world.update(0.01);
+
+  double best = 1e30;
+
+  for (int batch = 0; batch < 3; ++batch) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 3; ++i)
+      world.update(0.01);
+
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 3);
+  }
+
+  mapped = mappings(world.memoryPolicy());
+  return best * 1e3;
+}
+
+int main() {
+  const size_t COUNT = 4000000;
+
+  std::vector<uint32_t> order(COUNT);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(3));
+
+  std::cout << "random-order pass over " << COUNT << " bodies (" << COUNT * sizeof(Body) / (1 << 20) << " MB)" << std::endl;
+
+  double plain_ns;
+  {
+    std::vector<Body> bodies;
+    fill(bodies, COUNT);
+    plain_ns = gatherTime(bodies, order);
+  }
+
+  MemoryPolicy policy;
+  policy.huge_pages = true;
+  double huge_ns;
+  {
+    std::vector<Body, BodyAllocator<Body> > bodies((BodyAllocator<Body>(&policy)));
+    fill(bodies, COUNT);
+    huge_ns = gatherTime(bodies, order);
+  }
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "  std::allocator     " << std::setw(8) << plain_ns << " ns/body" << std::endl
+            << "  huge pages         " << std::setw(8) << huge_ns << " ns/body  " << plain_ns / huge_ns << "x  (" << mappings(policy) << ")" << std::endl;
+
+  ThreadPool pool;
+  const bool pinned = pool.pin();
+  std::string mapped;
+
+  std::cout << std::endl << "step of 200000 colliding bodies, " << pool.size() << " workers" << (pinned ? ", pinned" : "") << std::endl;
+
+  const double default_ms = stepTime(false, false, pool, mapped);
+  std::cout << "  policy off         " << std::setw(8) << default_ms << " ms" << std::endl;
+
+  const double huge_ms = stepTime(true, false, pool, mapped);
+  std::cout << "  huge pages         " << std::setw(8) << huge_ms << " ms     " << default_ms / huge_ms << "x  (" << mapped << ")" << std::endl;
+
+  const double touch_ms = stepTime(true, true, pool, mapped);
+  std::cout << "  + first touch      " << std::setw(8) << touch_ms << " ms     " << default_ms / touch_ms << "x  (" << mapped << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+// Whole-step throughput and memory of Space<float> against Space<double>.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src precision_bench.cpp -o precision_bench
+//
+// Runs the same scenes in both precisions: all-pairs gravity with collisions
+// (compute bound), AABB tree collisions only over many bodies (memory bound),
+// and the summed kinetic energy of a million bodies, where single precision
+// needs the pairwise reduction to stay accurate.
+
+#include "Space.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace flatics;
+
+struct Result {
+  double direct_rate;
+  double tree_rate;
+  size_t body_bytes;
+};
+
+template<typename Scalar>
+void populate(Space<Scalar, Vector2<Scalar> >& space, size_t count, Scalar size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<Scalar> position(Scalar(10), size - 10), velocity(-5, 5);
+
+  for (size_t i = 0; i < count; ++i)
+    space.addCircle(Scalar(2), Scalar(1e9), Vector2<Scalar>(position(rng), position(rng)), Vector2<Scalar>(velocity(rng), velocity(rng)));
+}
+
+/** Steps per second of space over steps updates */
+template<class World>
+double stepRate(World& space, size_t steps) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < steps; ++i)
+    space.update(0.01f);
+
+  return steps / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename Scalar>
+Result measure() {
+  typedef Space<Scalar, Vector2<Scalar> > World;
+  Result result;
+
+  World direct(2000, 2000);
+  populate(direct, 2000, Scalar(2000), 1);
+  stepRate(direct, 2);
+  result.direct_rate = stepRate(direct, 20);
+
+  World tree(20000, 20000);
+  tree.setObjectGravity(false);
+  tree.setBroadphase(World::AABB_TREE);
+  populate(tree, 200000, Scalar(20000), 2);
+  stepRate(tree, 2);
+  result.tree_rate = stepRate(tree, 20);
+
+  result.body_bytes = sizeof(Circle<Scalar, Vector2<Scalar> >);
+  return result;
+}
+
+/** Relative error of a million-body energy() in Scalar against the same bodies in double */
+template<typename Scalar>
+double energyError() {
+  Space<Scalar, Vector2<Scalar> > space(0, 0, Space<Scalar, Vector2<Scalar> >::NONE);
+  Space<double, Vector2<double> > reference(0, 0, Space<double, Vector2<double> >::NONE);
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> mass(1, 100), velocity(-10, 10);
+
+  for (size_t i = 0; i < 1000000; ++i) {
+    Scalar m = static_cast<Scalar>(mass(rng));
+    Scalar vx = static_cast<Scalar>(velocity(rng));
+    Scalar vy = static_cast<Scalar>(velocity(rng));
+    space.addCircle(Scalar(1), m, Vector2<Scalar>(), Vector2<Scalar>(vx, vy));
+    reference.addCircle(1.0, double(m), Vector2<double>(), Vector2<double>(vx, vy));
+  }
+
+  double expected = reference.energy();
+  return std::fabs(double(space.energy()) - expected) / expected;
+}
+
+int main() {
+  Result doubles = measure<double>();
+  Result floats = measure<float>();
+
+  std::cout << std::fixed << std::setprecision(1)
+            << std::setw(34) << "" << std::setw(10) << "double" << std::setw(10) << "float" << std::setw(8) << "ratio" << std::endl
+            << std::setw(34) << std::left << "bytes per body" << std::right
+            << std::setw(10) << double(doubles.body_bytes) << std::setw(10) << double(floats.body_bytes)
+            << std::setw(8) << std::setprecision(2) << double(doubles.body_bytes) / floats.body_bytes << std::endl
+            << std::setprecision(1)
+            << std::setw(34) << std::left << "all-pairs steps/s (2000 bodies)" << std::right
+            << std::setw(10) << doubles.direct_rate << std::setw(10) << floats.direct_rate
+            << std::setw(8) << std::setprecision(2) << floats.direct_rate / doubles.direct_rate << std::endl
+            << std::setprecision(1)
+            << std::setw(34) << std::left << "AABB tree steps/s (200000 bodies)" << std::right
+            << std::setw(10) << doubles.tree_rate << std::setw(10) << floats.tree_rate
+            << std::setw(8) << std::setprecision(2) << floats.tree_rate / doubles.tree_rate << std::endl;
+
+  std::cout << std::scientific << std::setprecision(2)
+            << "energy() of 1e6 bodies, relative error: float " << energyError<float>() << std::endl;
+
+  return 0;
+}
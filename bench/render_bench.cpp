@@ -0,0 +1,85 @@
+// Render-list build throughput, headless.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src render_bench.cpp -o render_bench
+//
+// Builds the vertex list for 200000 bodies through three cameras: the whole
+// world zoomed out so most bodies are under a pixel, a window at 1:1 that culls
+// most of them, and a close-up where the few bodies left are big fans. Each is
+// built serially and on a thread pool, and the two lists have to match.
+
+#include "RenderList.h"
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace flatics;
+
+/** Milliseconds per build, best of a few batches */
+template<class Snapshot>
+double buildTime(RenderList<>& list, const Snapshot& snapshot, const RenderCamera& camera, ThreadPool* pool) {
+  double best = 1e30;
+
+  for (int batch = 0; batch < 3; ++batch) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 10; ++i)
+      list.build(snapshot, camera, pool);
+
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 10);
+  }
+
+  return best * 1e3;
+}
+
+int main() {
+  typedef Space<double, Vector2<double> > World;
+
+  World world(4000, 4000);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> position(0, 4000), radius(0.1, 20);
+
+  for (size_t i = 0; i < 200000; ++i)
+    world.addCircle(radius(rng), 1.0, Vector2<double>(position(rng), position(rng)), Vector2<double>());
+
+  RenderSnapshot<double> snapshot;
+  snapshot.capture(world.objects(), world.ids());
+
+  const struct {
+    const char* name;
+    RenderCamera camera;
+  } VIEWS[] = {
+    { "whole world", { 0, 0, 0.225, 900, 900 } },
+    { "1:1 window", { 1000, 1000, 1, 1600, 900 } },
+    { "close-up", { 2000, 2000, 8, 1600, 900 } },
+  };
+
+  ThreadPool pool;
+  RenderList<> serial, parallel;
+
+  std::cout << std::setw(12) << std::left << "view" << std::right << std::setw(9) << "drawn" << std::setw(9) << "points"
+            << std::setw(11) << "vertices" << std::setw(11) << "serial ms" << std::setw(11) << "pool ms" << std::setw(8) << "same" << std::endl;
+
+  bool same = true;
+
+  for (const auto& view : VIEWS) {
+    double serial_ms = buildTime(serial, snapshot, view.camera, nullptr);
+    double pool_ms = buildTime(parallel, snapshot, view.camera, &pool);
+
+    bool match = serial.vertices().size() == parallel.vertices().size() &&
+                 std::memcmp(serial.vertices().data(), parallel.vertices().data(), serial.vertices().size() * sizeof(RenderVertex)) == 0;
+    same = same && match;
+
+    std::cout << std::setw(12) << std::left << view.name << std::right << std::setw(9) << serial.drawn() << std::setw(9) << serial.points()
+              << std::setw(11) << serial.vertices().size() << std::fixed << std::setprecision(2)
+              << std::setw(11) << serial_ms << std::setw(11) << pool_ms << std::setw(8) << (match ? "yes" : "NO") << std::endl;
+  }
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Scenario loading: time to populate a Space from a scene file, and whether it
+// makes the same bodies every time.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src scenario_bench.cpp -o scenario_bench
+//   ./scenario_bench [scene, default ../scenes/ten_million.scene]
+//
+// Parses the scene, then populates a fresh Space with it on a thread pool
+// twice and serially once, timing each and hashing every body's radius, mass,
+// position and velocity bit for bit. The hashes have to agree: the blocks are
+// seeded by number, not by thread. Also times adding the same number of
+// bodies one addCircle() at a time, the way scenes used to be built.
+
+#include "Circle.h"
+#include "Journal.h"
+#include "Scenario.h"
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace flatics;
+
+typedef Space<double, Vector2<double> > World;
+
+uint64_t hashOf(const World& world) {
+  StateHash hash;
+
+  for (const Circle<double, Vector2<double> >& obj : world.objects()) {
+    hash.add(obj.radius());
+    hash.add(obj.mass());
+    hash.add(obj.position().x);
+    hash.add(obj.position().y);
+    hash.add(obj.velocity().x);
+    hash.add(obj.velocity().y);
+  }
+
+  return hash.value();
+}
+
+/** Populate a new Space from scenario; returns seconds taken and the bodies' hash */
+double populate(const Scenario& scenario, ThreadPool* pool, uint64_t& hash) {
+  World world(static_cast<size_t>(scenario.width()), static_cast<size_t>(scenario.height()));
+  world.setThreadPool(pool);
+
+  const auto start = std::chrono::steady_clock::now();
+  scenario.populate(world);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  hash = hashOf(world);
+  return seconds;
+}
+
+int main(int argc, char** argv) {
+  const std::string path = argc > 1 ? argv[1] : "../scenes/ten_million.scene";
+  Scenario scenario;
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (!scenario.load(path)) {
+    std::cerr << path << ": " << scenario.error() << std::endl;
+    return 1;
+  }
+
+  const double parse = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  ThreadPool pool;
+  std::cout << path << ": " << scenario.bodies() << " bodies in " << scenario.regions().size() << " regions, parsed in "
+            << std::fixed << std::setprecision(3) << parse * 1e3 << " ms" << std::endl
+            << "  populate                 s      hash" << std::endl;
+
+  uint64_t first, second, serial;
+  double seconds = populate(scenario, &pool, first);
+  std::cout << "  " << pool.size() << " workers     " << std::setw(10) << seconds << "  " << std::hex << first << std::dec << std::endl;
+
+  seconds = populate(scenario, &pool, second);
+  std::cout << "  " << pool.size() << " workers     " << std::setw(10) << seconds << "  " << std::hex << second << std::dec << std::endl;
+
+  seconds = populate(scenario, nullptr, serial);
+  std::cout << "  serial        " << std::setw(10) << seconds << "  " << std::hex << serial << std::dec << std::endl;
+
+  // the old way, one locked emplace at a time
+  {
+    World world(static_cast<size_t>(scenario.width()), static_cast<size_t>(scenario.height()));
+    const size_t count = scenario.bodies();
+
+    start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; ++i)
+      world.addCircle(1.0, 1.0, Vector2<double>(double(i % 1000), double(i / 1000)), Vector2<double>());
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  addCircle()   " << std::setw(10) << seconds << std::endl;
+  }
+
+  const bool same = first == second && first == serial;
+  std::cout << (same ? "reproducible" : "NOT REPRODUCIBLE") << std::endl;
+  return same ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+// Broadphases on an unbounded world with escaping debris, and far-field parking.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src unbounded_bench.cpp -o unbounded_bench
+//
+// A cluster of colliding bodies with no boundary, plus a few percent of debris
+// flung outwards fast enough that after a while it is spread over millions of
+// units. First every broadphase finds the pairs of one such scene, with some
+// debris a billion units out, and the pairs are checked against brute force.
+// Then a Space is stepped with each broadphase keeping the debris, and with
+// the debris parked, timing the steps once the debris is far out. Last, the
+// broadphases run on a thread pool over a world that shrinks from 100 bodies
+// to 2, which must not bring back pairs of the bigger world. It exits nonzero
+// if any broadphase disagrees with brute force.
+
+#include "AabbTree.h"
+#include "Broadphase.h"
+#include "Circle.h"
+#include "Space.h"
+#include "SpatialHash.h"
+#include "SweepAndPrune.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace flatics;
+
+typedef Circle<double, Vector2<double> > Body;
+typedef Space<double, Vector2<double> > World;
+typedef Broadphase<double, Vector2<double> >::Pair Pair;
+
+const size_t CLUSTER = 20000;
+const size_t DEBRIS = 500;
+
+/** The cluster and its debris; debris starts on the edge of the cluster, heading out at speed */
+std::vector<Body> scene(double debrisDistance) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> position(-1000, 1000), velocity(-20, 20), angle(0, 6.283185307179586);
+  std::vector<Body> bodies;
+
+  for (size_t i = 0; i < CLUSTER; ++i)
+    bodies.emplace_back(3.0, 1.0, Vector2<double>(position(rng), position(rng)), Vector2<double>(velocity(rng), velocity(rng)));
+
+  for (size_t i = 0; i < DEBRIS; ++i) {
+    const double a = angle(rng);
+    const Vector2<double> direction(std::cos(a), std::sin(a));
+    bodies.emplace_back(3.0, 1.0, (1500 + debrisDistance) * direction, 20000.0 * direction);
+  }
+
+  return bodies;
+}
+
+std::vector<Pair> pairsOf(Broadphase<double, Vector2<double> >& broadphase, const std::vector<Body>& bodies, double& ms) {
+  std::vector<size_t> ids(bodies.size());
+  for (size_t i = 0; i < ids.size(); ++i)
+    ids[i] = i;
+
+  std::vector<Pair> pairs;
+  broadphase.findPairs(bodies.data(), ids.data(), bodies.size(), pairs);
+
+  auto start = std::chrono::steady_clock::now();
+  pairs.clear();
+  broadphase.findPairs(bodies.data(), ids.data(), bodies.size(), pairs);
+  ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::sort(pairs.begin(), pairs.end());
+  return pairs;
+}
+
+std::vector<Pair> bruteForcePairs(const std::vector<Body>& bodies) {
+  std::vector<Pair> pairs;
+
+  for (size_t i = 0; i < bodies.size(); ++i)
+  for (size_t j = i + 1; j < bodies.size(); ++j) {
+    if (Broadphase<double, Vector2<double> >::overlaps(bodies[i], bodies[j]))
+      pairs.push_back(Pair(i, j));
+  }
+
+  return pairs;
+}
+
+/** Pairs of a packed world of 100 bodies, then of the first 2 of them alone, on pool; whether both match brute force */
+bool shrinks(Broadphase<double, Vector2<double> >& broadphase, ThreadPool& pool) {
+  broadphase.setThreadPool(&pool);
+
+  std::vector<Body> bodies;
+  for (size_t i = 0; i < 100; ++i)
+    bodies.emplace_back(3.0, 1.0, Vector2<double>(double(i % 10) * 5, double(i / 10) * 5), Vector2<double>());
+
+  std::vector<size_t> ids(bodies.size());
+  for (size_t i = 0; i < ids.size(); ++i)
+    ids[i] = i;
+
+  bool same = true;
+
+  for (size_t count : { size_t(100), size_t(2) }) {
+    for (size_t id = count; id < bodies.size(); ++id)
+      broadphase.remove(id);
+
+    bodies.erase(bodies.begin() + count, bodies.end());
+
+    std::vector<Pair> pairs;
+    broadphase.findPairs(bodies.data(), ids.data(), bodies.size(), pairs);
+    std::sort(pairs.begin(), pairs.end());
+    same = same && pairs == bruteForcePairs(bodies);
+  }
+
+  broadphase.setThreadPool(nullptr);
+  return same;
+}
+
+/** Milliseconds per step once the debris has flown out, and how many bodies are still stepped */
+double stepTime(World::BroadphaseMode broadphase, World::FarFieldPolicy policy, size_t& active) {
+  World world(2000, 2000, World::NONE);
+  world.setObjectGravity(false);
+  world.setBroadphase(broadphase);
+  world.setFarField(policy, 5000);
+
+  for (const Body& body : scene(0))
+    world.addCircle(body);
+
+  // 100 s of flight puts the debris about two million units out
+  for (int i = 0; i < 10; ++i)
+    world.update(10);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < 20; ++i)
+    world.update(0.01);
+
+  active = world.objects().size();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 20;
+}
+
+int main() {
+  std::vector<Body> bodies = scene(1e9);
+
+  const std::vector<Pair> expected = bruteForcePairs(bodies);
+  bool all_same = true;
+
+  std::cout << CLUSTER << " bodies in a cluster, " << DEBRIS << " a billion units out; " << expected.size() << " overlapping pairs" << std::endl
+            << "  broadphase        ms     same" << std::endl << std::fixed << std::setprecision(2);
+
+  double ms;
+  AabbTree<double, Vector2<double> > tree;
+  SweepAndPrune<double, Vector2<double> > sweep;
+  SpatialHash<double, Vector2<double> > hash;
+
+  bool same = pairsOf(tree, bodies, ms) == expected;
+  all_same = all_same && same;
+  std::cout << "  aabb tree    " << std::setw(8) << ms << "     " << (same ? "yes" : "NO") << std::endl;
+
+  same = pairsOf(sweep, bodies, ms) == expected;
+  all_same = all_same && same;
+  std::cout << "  sweep/prune  " << std::setw(8) << ms << "     " << (same ? "yes" : "NO") << std::endl;
+
+  same = pairsOf(hash, bodies, ms) == expected;
+  all_same = all_same && same;
+  std::cout << "  spatial hash " << std::setw(8) << ms << "     " << (same ? "yes" : "NO")
+            << "   (" << hash.cells() << " cells, " << hash.memoryBytes() / 1024 << " KB)" << std::endl;
+
+  std::cout << std::endl << "step after the debris has flown ~2e6 units out" << std::endl
+            << "  configuration                 ms/step   stepped" << std::endl;
+
+  size_t active;
+  ms = stepTime(World::AABB_TREE, World::KEEP, active);
+  std::cout << "  aabb tree, keep           " << std::setw(10) << ms << "   " << active << std::endl;
+
+  ms = stepTime(World::AABB_TREE, World::PARK, active);
+  std::cout << "  aabb tree, park           " << std::setw(10) << ms << "   " << active << std::endl;
+
+  ms = stepTime(World::SWEEP_AND_PRUNE, World::KEEP, active);
+  std::cout << "  sweep/prune, keep         " << std::setw(10) << ms << "   " << active << std::endl;
+
+  ms = stepTime(World::SPATIAL_HASH, World::KEEP, active);
+  std::cout << "  spatial hash, keep        " << std::setw(10) << ms << "   " << active << std::endl;
+
+  ms = stepTime(World::SPATIAL_HASH, World::PARK, active);
+  std::cout << "  spatial hash, park        " << std::setw(10) << ms << "   " << active << std::endl;
+
+  ThreadPool pool(4);
+  AabbTree<double, Vector2<double> > shrinking_tree;
+  SpatialHash<double, Vector2<double> > shrinking_hash;
+
+  std::cout << std::endl << "100 bodies, then 2, on " << pool.size() << " workers" << std::endl;
+
+  same = shrinks(shrinking_tree, pool);
+  all_same = all_same && same;
+  std::cout << "  aabb tree                     " << (same ? "yes" : "NO") << std::endl;
+
+  same = shrinks(shrinking_hash, pool);
+  all_same = all_same && same;
+  std::cout << "  spatial hash                  " << (same ? "yes" : "NO") << std::endl;
+
+  return all_same ? 0 : 1;
+}
@@ -0,0 +1,454 @@
+#ifndef FLATICS_AABBTREE_H
+#define FLATICS_AABBTREE_H
+
+#include "Broadphase.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Dynamic bounding volume tree broadphase.
+ *
+ *  Every body owns a leaf holding its bounding box grown by a margin, so small
+ *  movements don't touch the tree at all; a body is only reinserted once its
+ *  exact box leaves the fattened one. Insertion picks the sibling by the
+ *  perimeter heuristic and rebalances the ancestors with AVL-style rotations on
+ *  the way back up (incremental refit); every rebuild interval the whole tree
+ *  is rebuilt top-down from the current leaves.
+ *
+ *  Because the leaves adapt to each body's own size, huge and tiny bodies mix
+ *  without any cell size to tune.
+ */
+template<typename Scalar, class Vec>
+class AabbTree : public Broadphase<Scalar, Vec> {
+public:
+  typedef typename Broadphase<Scalar, Vec>::Object Object;
+  typedef typename Broadphase<Scalar, Vec>::Pair Pair;
+
+private:
+  static const int NONE = -1;
+
+  struct Box {
+    Scalar min_x, min_y, max_x, max_y;
+
+    Scalar perimeter() const { return 2 * ((max_x - min_x) + (max_y - min_y)); }
+
+    bool contains(const Box& other) const {
+      return min_x <= other.min_x && min_y <= other.min_y && other.max_x <= max_x && other.max_y <= max_y;
+    }
+
+    bool overlaps(const Box& other) const {
+      return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+    }
+
+    static Box merge(const Box& a, const Box& b) {
+      Box box = { std::min(a.min_x, b.min_x), std::min(a.min_y, b.min_y), std::max(a.max_x, b.max_x), std::max(a.max_y, b.max_y) };
+      return box;
+    }
+  };
+
+  struct Node {
+    Box box;
+    int parent; // doubles as the free list link for unused nodes
+    int child1;
+    int child2;
+    int height; // 0 for leaves, -1 for unused nodes
+    size_t id;
+
+    bool isLeaf() const { return child1 == NONE; }
+  };
+
+  std::vector<Node> nodes_;
+  int root_;
+  int free_list_;
+
+  // leaf node of every body id, NONE if it has none
+  std::vector<int> leaf_of_;
+
+  // index into the current object array of every body id, refreshed each call
+  std::vector<size_t> index_of_;
+
+  Scalar margin_;
+  size_t rebuild_interval_;
+  size_t updates_since_rebuild_;
+  size_t reinsertions_;
+
+  ThreadPool* pool_;
+  StepArena* arena_;
+  std::vector<std::vector<Pair> > chunk_pairs_;
+  std::vector<int> stack_;
+
+  static Box tightBox(const Object& obj) {
+    Box box = { obj.minX(), obj.minY(), obj.maxX(), obj.maxY() };
+    return box;
+  }
+
+  Box fatBox(const Object& obj) const {
+    Box box = { obj.minX() - margin_, obj.minY() - margin_, obj.maxX() + margin_, obj.maxY() + margin_ };
+    return box;
+  }
+
+  int allocateNode() {
+    int node;
+
+    if (free_list_ != NONE) {
+      node = free_list_;
+      free_list_ = nodes_[node].parent;
+    } else {
+      node = static_cast<int>(nodes_.size());
+      nodes_.push_back(Node());
+    }
+
+    nodes_[node].parent = NONE;
+    nodes_[node].child1 = NONE;
+    nodes_[node].child2 = NONE;
+    nodes_[node].height = 0;
+    return node;
+  }
+
+  void freeNode(int node) {
+    nodes_[node].parent = free_list_;
+    nodes_[node].height = -1;
+    free_list_ = node;
+  }
+
+  /** Recompute a node's box and height from its children */
+  void refit(int node) {
+    Node& n = nodes_[node];
+    n.box = Box::merge(nodes_[n.child1].box, nodes_[n.child2].box);
+    n.height = 1 + std::max(nodes_[n.child1].height, nodes_[n.child2].height);
+  }
+
+  void replaceChild(int parent, int old_child, int new_child) {
+    if (parent == NONE) {
+      root_ = new_child;
+    } else if (nodes_[parent].child1 == old_child) {
+      nodes_[parent].child1 = new_child;
+    } else {
+      nodes_[parent].child2 = new_child;
+    }
+  }
+
+  /** Rotate the taller grandchild up if a's subtrees differ in height by more than one; returns the new subtree root */
+  int balance(int a) {
+    Node& node_a = nodes_[a];
+
+    if (node_a.isLeaf() || node_a.height < 2)
+      return a;
+
+    int b = node_a.child1;
+    int c = node_a.child2;
+    int difference = nodes_[c].height - nodes_[b].height;
+
+    if (difference > 1)
+      return rotate(a, c, b);
+
+    if (difference < -1)
+      return rotate(a, b, c);
+
+    return a;
+  }
+
+  /** Promote up (a child of a) over a, handing its shorter grandchild to a in place of up */
+  int rotate(int a, int up, int other) {
+    int f = nodes_[up].child1;
+    int g = nodes_[up].child2;
+
+    // up takes a's place
+    nodes_[up].child1 = a;
+    nodes_[up].parent = nodes_[a].parent;
+    nodes_[a].parent = up;
+    replaceChild(nodes_[up].parent, a, up);
+
+    // the taller grandchild stays under up, the shorter one moves to a
+    int taller = nodes_[f].height > nodes_[g].height ? f : g;
+    int shorter = taller == f ? g : f;
+
+    nodes_[up].child2 = taller;
+    nodes_[a].child1 = other;
+    nodes_[a].child2 = shorter;
+    nodes_[shorter].parent = a;
+
+    refit(a);
+    refit(up);
+    return up;
+  }
+
+  void insertLeaf(int leaf) {
+    if (root_ == NONE) {
+      root_ = leaf;
+      nodes_[leaf].parent = NONE;
+      return;
+    }
+
+    // descend towards the sibling that grows the total perimeter the least
+    const Box leaf_box = nodes_[leaf].box;
+    int index = root_;
+
+    while (!nodes_[index].isLeaf()) {
+      const Node& node = nodes_[index];
+      Scalar perimeter = node.box.perimeter();
+      Scalar combined = Box::merge(node.box, leaf_box).perimeter();
+
+      // cost of making a new parent for this node and the leaf, and the cost
+      // pushed down onto the children if we descend instead
+      Scalar cost = 2 * combined;
+      Scalar inheritance = 2 * (combined - perimeter);
+
+      Scalar cost1 = descentCost(node.child1, leaf_box) + inheritance;
+      Scalar cost2 = descentCost(node.child2, leaf_box) + inheritance;
+
+      if (cost < cost1 && cost < cost2)
+        break;
+
+      index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    int sibling = index;
+    int old_parent = nodes_[sibling].parent;
+    int new_parent = allocateNode();
+
+    nodes_[new_parent].parent = old_parent;
+    nodes_[new_parent].child1 = sibling;
+    nodes_[new_parent].child2 = leaf;
+    nodes_[sibling].parent = new_parent;
+    nodes_[leaf].parent = new_parent;
+    replaceChild(old_parent, sibling, new_parent);
+
+    refitAncestors(new_parent);
+  }
+
+  Scalar descentCost(int child, const Box& leaf_box) const {
+    Scalar merged = Box::merge(nodes_[child].box, leaf_box).perimeter();
+    return nodes_[child].isLeaf() ? merged : merged - nodes_[child].box.perimeter();
+  }
+
+  void refitAncestors(int index) {
+    while (index != NONE) {
+      index = balance(index);
+      refit(index);
+      index = nodes_[index].parent;
+    }
+  }
+
+  void removeLeaf(int leaf) {
+    if (leaf == root_) {
+      root_ = NONE;
+      return;
+    }
+
+    int parent = nodes_[leaf].parent;
+    int grand_parent = nodes_[parent].parent;
+    int sibling = nodes_[parent].child1 == leaf ? nodes_[parent].child2 : nodes_[parent].child1;
+
+    replaceChild(grand_parent, parent, sibling);
+    nodes_[sibling].parent = grand_parent;
+    freeNode(parent);
+
+    refitAncestors(grand_parent);
+  }
+
+  /** Build a balanced subtree over leaves[begin, end) by median splits; returns its root */
+  int build(int* leaves, size_t begin, size_t end) {
+    if (end - begin == 1)
+      return leaves[begin];
+
+    // bounds of the leaves' centres, kept doubled like the sort keys below
+    Box centers;
+
+    for (size_t i = begin; i < end; ++i) {
+      const Box& box = nodes_[leaves[i]].box;
+      Box center = { box.min_x + box.max_x, box.min_y + box.max_y, box.min_x + box.max_x, box.min_y + box.max_y };
+      centers = i == begin ? center : Box::merge(centers, center);
+    }
+
+    bool split_x = centers.max_x - centers.min_x >= centers.max_y - centers.min_y;
+    size_t middle = begin + (end - begin) / 2;
+
+    std::nth_element(leaves + begin, leaves + middle, leaves + end, [this, split_x](int a, int b) {
+      const Box& box_a = nodes_[a].box;
+      const Box& box_b = nodes_[b].box;
+      return split_x ? box_a.min_x + box_a.max_x < box_b.min_x + box_b.max_x
+                     : box_a.min_y + box_a.max_y < box_b.min_y + box_b.max_y;
+    });
+
+    int node = allocateNode();
+    int child1 = build(leaves, begin, middle);
+    int child2 = build(leaves, middle, end);
+
+    nodes_[node].child1 = child1;
+    nodes_[node].child2 = child2;
+    nodes_[child1].parent = node;
+    nodes_[child2].parent = node;
+    refit(node);
+    return node;
+  }
+
+  /** Throw away the internal nodes and rebuild them top-down */
+  void rebuild() {
+    ArenaVector<int> leaves(ArenaAllocator<int>(arena_ ? &arena_->main() : nullptr));
+    leaves.reserve(nodes_.size() / 2 + 1);
+
+    for (size_t node = 0; node < nodes_.size(); ++node) {
+      if (nodes_[node].height < 0)
+        continue;
+
+      if (nodes_[node].isLeaf())
+        leaves.push_back(static_cast<int>(node));
+      else
+        freeNode(static_cast<int>(node));
+    }
+
+    root_ = leaves.empty() ? NONE : build(leaves.data(), 0, leaves.size());
+
+    if (root_ != NONE)
+      nodes_[root_].parent = NONE;
+
+    updates_since_rebuild_ = 0;
+  }
+
+  /** Append every body after index i whose box overlaps body i's */
+  template<class Stack>
+  void query(const Object* objects, size_t i, std::vector<Pair>& pairs, Stack& stack) const {
+    const Box box = tightBox(objects[i]);
+
+    stack.clear();
+    stack.push_back(root_);
+
+    while (!stack.empty()) {
+      const Node& node = nodes_[stack.back()];
+      stack.pop_back();
+
+      if (!node.box.overlaps(box))
+        continue;
+
+      if (node.isLeaf()) {
+        size_t j = index_of_[node.id];
+
+        // the fat box overlapped; only report exact overlaps, once per pair
+        if (j > i && box.overlaps(tightBox(objects[j])))
+          pairs.push_back(Pair(i, j));
+      } else {
+        stack.push_back(node.child1);
+        stack.push_back(node.child2);
+      }
+    }
+  }
+
+public:
+  /**
+   *  @param margin how far a body may move before it needs reinserting
+   *  @param rebuildInterval rebuild the tree from scratch every this many updates (0 never)
+   */
+  explicit AabbTree(Scalar margin = 2, size_t rebuildInterval = 256)
+      : root_(NONE), free_list_(NONE), margin_(margin), rebuild_interval_(rebuildInterval),
+        updates_since_rebuild_(0), reinsertions_(0), pool_(nullptr), arena_(nullptr) {}
+
+  void setMargin(Scalar margin) { margin_ = margin; }
+
+  void setRebuildInterval(size_t interval) { rebuild_interval_ = interval; }
+
+  /** Workers for the pair queries; nullptr queries serially */
+  void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+
+  /** Scratch for rebuilds and the parallel queries' stacks */
+  void setArena(StepArena* arena) { arena_ = arena; }
+
+  /** Leaves reinserted during the last update */
+  size_t reinsertions() const { return reinsertions_; }
+
+  /** Height of the tree (0 for a single leaf, -1 when empty) */
+  int height() const { return root_ == NONE ? -1 : nodes_[root_].height; }
+
+  void findPairs(const Object* objects, const size_t* ids, size_t count, std::vector<Pair>& pairs) {
+    reinsertions_ = 0;
+    size_t added = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      size_t id = ids[i];
+
+      if (id >= leaf_of_.size()) {
+        leaf_of_.resize(id + 1, NONE);
+        index_of_.resize(id + 1);
+      }
+
+      index_of_[id] = i;
+      int leaf = leaf_of_[id];
+
+      if (leaf == NONE) {
+        leaf = allocateNode();
+        nodes_[leaf].box = fatBox(objects[i]);
+        nodes_[leaf].id = id;
+        leaf_of_[id] = leaf;
+        insertLeaf(leaf);
+        ++added;
+      } else if (!nodes_[leaf].box.contains(tightBox(objects[i]))) {
+        removeLeaf(leaf);
+        nodes_[leaf].box = fatBox(objects[i]);
+        insertLeaf(leaf);
+        ++reinsertions_;
+      }
+    }
+
+    // greedy insertion makes a poor tree out of a large batch in arbitrary
+    // order, so build that top-down instead
+    if (added * 8 > count || (rebuild_interval_ != 0 && ++updates_since_rebuild_ >= rebuild_interval_))
+      rebuild();
+
+    if (root_ == NONE)
+      return;
+
+    if (!pool_ || pool_->size() < 2) {
+      for (size_t i = 0; i < count; ++i)
+        query(objects, i, pairs, stack_);
+      return;
+    }
+
+    // query in parallel, then concatenate in chunk order so the pair order
+    // doesn't depend on scheduling. With fewer bodies than workers some
+    // chunks don't run, so every list is emptied first.
+    chunk_pairs_.resize(pool_->size());
+
+    for (std::vector<Pair>& chunk : chunk_pairs_)
+      chunk.clear();
+
+    pool_->parallelFor(count, [this, objects](size_t begin, size_t end, size_t chunk) {
+      ArenaVector<int> stack(ArenaAllocator<int>(arena_ ? &arena_->worker(chunk) : nullptr));
+      stack.reserve(64);
+
+      for (size_t i = begin; i < end; ++i)
+        query(objects, i, chunk_pairs_[chunk], stack);
+    }, chunk_pairs_.size());
+
+    for (const std::vector<Pair>& chunk : chunk_pairs_)
+      pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+  }
+
+  void remove(size_t id) {
+    if (id >= leaf_of_.size() || leaf_of_[id] == NONE)
+      return;
+
+    removeLeaf(leaf_of_[id]);
+    freeNode(leaf_of_[id]);
+    leaf_of_[id] = NONE;
+  }
+
+  void clear() {
+    nodes_.clear();
+    leaf_of_.clear();
+    index_of_.clear();
+    root_ = NONE;
+    free_list_ = NONE;
+    updates_since_rebuild_ = 0;
+  }
+};
+
+template<typename Scalar, class Vec>
+const int AabbTree<Scalar, Vec>::NONE;
+
+}
+
+#endif // FLATICS_AABBTREE_H
@@ -0,0 +1,212 @@
+#ifndef FLATICS_ALLOCATOR_H
+#define FLATICS_ALLOCATOR_H
+
+#include "ThreadPool.h"
+#include "Utility.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#ifndef FLATICS_WINDOWS
+#include <sys/mman.h>
+#endif
+
+namespace flatics {
+
+/**
+ *  Where a Space's body arrays go. Shared by every BodyAllocator made from it,
+ *  so changing it affects the arrays allocated from then on.
+ */
+struct MemoryPolicy {
+  // back big arrays with 2MB pages: reserved huge pages if the system has any,
+  // otherwise transparent huge pages, otherwise ordinary ones
+  bool huge_pages;
+
+  // if set, a new array's pages are first touched by the workers of this pool,
+  // chunk by chunk as parallelFor() splits it, so the kernel places each part
+  // on the NUMA node of the thread that will work on it
+  ThreadPool* first_touch;
+
+  // big arrays mapped so far by what backs them
+  std::atomic<size_t> huge_mappings;        // reserved (hugetlbfs / large page) pages
+  std::atomic<size_t> transparent_mappings; // transparent huge pages
+  std::atomic<size_t> page_mappings;        // ordinary pages
+
+  MemoryPolicy() : huge_pages(false), first_touch(nullptr), huge_mappings(0), transparent_mappings(0), page_mappings(0) {}
+
+  MemoryPolicy(const MemoryPolicy&) = delete;
+  MemoryPolicy& operator=(const MemoryPolicy&) = delete;
+};
+
+namespace detail {
+
+const size_t HUGE_PAGE = size_t(2) << 20;
+const size_t TOUCH_PAGE = 4096;
+
+inline size_t roundToHugePage(size_t bytes) { return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE; }
+
+/** Map bytes rounded up to whole huge pages, starting on a huge page boundary; nullptr if out of memory */
+inline void* mapPages(size_t bytes, MemoryPolicy& policy) {
+  const size_t length = roundToHugePage(bytes);
+
+#ifdef FLATICS_WINDOWS
+  if (policy.huge_pages && GetLargePageMinimum() != 0 && length % GetLargePageMinimum() == 0) {
+    // only works for accounts holding the lock pages in memory privilege
+    void* pages = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+    if (pages) {
+      policy.huge_mappings.fetch_add(1, std::memory_order_relaxed);
+      return pages;
+    }
+  }
+
+  void* pages = VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+  if (pages)
+    policy.page_mappings.fetch_add(1, std::memory_order_relaxed);
+
+  return pages;
+#else
+#ifdef MAP_HUGETLB
+  if (policy.huge_pages) {
+    void* pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (pages != MAP_FAILED) {
+      policy.huge_mappings.fetch_add(1, std::memory_order_relaxed);
+      return pages;
+    }
+  }
+#endif
+
+  // map a huge page more than needed and trim it, so the block is aligned the
+  // way transparent huge pages need
+  void* raw = mmap(nullptr, length + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (raw == MAP_FAILED)
+    return nullptr;
+
+  char* begin = static_cast<char*>(raw);
+  char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE);
+
+  if (aligned != begin)
+    munmap(begin, aligned - begin);
+  munmap(aligned + length, begin + HUGE_PAGE - aligned);
+
+#ifdef MADV_HUGEPAGE
+  if (policy.huge_pages && madvise(aligned, length, MADV_HUGEPAGE) == 0) {
+    policy.transparent_mappings.fetch_add(1, std::memory_order_relaxed);
+    return aligned;
+  }
+#endif
+
+  policy.page_mappings.fetch_add(1, std::memory_order_relaxed);
+  return aligned;
+#endif
+}
+
+inline void unmapPages(void* pages, size_t bytes) {
+#ifdef FLATICS_WINDOWS
+  (void)bytes;
+  VirtualFree(pages, 0, MEM_RELEASE);
+#else
+  munmap(pages, roundToHugePage(bytes));
+#endif
+}
+
+}
+
+/**
+ *  A std allocator for the big arrays of a Space, following a MemoryPolicy.
+ *
+ *  Arrays of at least a huge page are mapped straight from the system, huge
+ *  page aligned, instead of coming from the heap; smaller ones, and every
+ *  array of an allocator without a policy, use operator new like
+ *  std::allocator. The choice depends only on the size, so memory can be
+ *  freed whatever the policy says by then.
+ *
+ *  With first_touch set, allocate() has the pool's workers write one byte to
+ *  every page of the new array before anything else does, each the part that
+ *  parallelFor() would give it for an array this long. Linux puts a page on
+ *  the node of the thread that first touches it, so once the array is filled
+ *  and worked on in parallel, each worker mostly reads local memory. Arrays
+ *  that are later grown in place (capacity beyond their length) lose some of
+ *  that; Space lays its arrays out again when that happens.
+ *
+ *  The allocator is carried along by copies, moves and swaps of the
+ *  container, so memory always goes back the way it came.
+ */
+template<class T>
+class BodyAllocator {
+private:
+  MemoryPolicy* policy_;
+
+  void firstTouch(T* array, size_t n) const {
+    char* bytes = reinterpret_cast<char*>(array);
+
+    policy_->first_touch->parallelFor(n, [bytes](size_t begin, size_t end, size_t) {
+      const size_t first = (begin * sizeof(T) + detail::TOUCH_PAGE - 1) / detail::TOUCH_PAGE * detail::TOUCH_PAGE;
+
+      for (size_t offset = first; offset < end * sizeof(T); offset += detail::TOUCH_PAGE)
+        static_cast<volatile char*>(bytes)[offset] = 0;
+    });
+  }
+
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template<class U>
+  struct rebind {
+    typedef BodyAllocator<U> other;
+  };
+
+  BodyAllocator() : policy_(nullptr) {}
+
+  explicit BodyAllocator(MemoryPolicy* policy) : policy_(policy) {}
+
+  template<class U>
+  BodyAllocator(const BodyAllocator<U>& other) : policy_(other.policy()) {}
+
+  MemoryPolicy* policy() const { return policy_; }
+
+  T* allocate(size_t n) {
+    const size_t bytes = n * sizeof(T);
+
+    if (!policy_ || bytes < detail::HUGE_PAGE)
+      return static_cast<T*>(::operator new(bytes));
+
+    T* array = static_cast<T*>(detail::mapPages(bytes, *policy_));
+
+    if (!array)
+      throw std::bad_alloc();
+
+    if (policy_->first_touch)
+      firstTouch(array, n);
+
+    return array;
+  }
+
+  void deallocate(T* array, size_t n) {
+    const size_t bytes = n * sizeof(T);
+
+    if (!policy_ || bytes < detail::HUGE_PAGE)
+      ::operator delete(array);
+    else
+      detail::unmapPages(array, bytes);
+  }
+};
+
+template<class T, class U>
+bool operator==(const BodyAllocator<T>& a, const BodyAllocator<U>& b) { return a.policy() == b.policy(); }
+
+template<class T, class U>
+bool operator!=(const BodyAllocator<T>& a, const BodyAllocator<U>& b) { return a.policy() != b.policy(); }
+
+}
+
+#endif // FLATICS_ALLOCATOR_H
@@ -0,0 +1,342 @@
+#ifndef FLATICS_ARENA_H
+#define FLATICS_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  A linear allocator for scratch memory that lives no longer than one step.
+ *
+ *  allocate() hands out the next bytes of the current block and reset() takes
+ *  them all back at once; nothing is freed individually. When a block runs
+ *  out, another one as big as everything so far is chained on, and the next
+ *  reset() folds the chain into a single block of their total size, which
+ *  fits everything that step asked for again. So after the first few steps of
+ *  a workload it stops touching the heap altogether, which heapAllocations()
+ *  shows. Not thread safe: give each thread its own (see StepArena).
+ */
+class Arena {
+private:
+  static const size_t ALIGNMENT = 64; // of the blocks, a cache line
+  static const size_t MIN_BLOCK = 64 << 10;
+
+  struct Block {
+    char* memory; // as allocated
+    char* data;   // aligned start
+    size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  size_t current_; // block allocated from
+  size_t offset_;  // into it
+  size_t used_;    // bytes handed out since reset(), alignment padding included
+  size_t high_water_;
+  uint64_t heap_allocations_;
+
+  void addBlock(size_t size) {
+    Block block;
+    block.memory = static_cast<char*>(::operator new(size + ALIGNMENT));
+    block.data = block.memory + (ALIGNMENT - reinterpret_cast<uintptr_t>(block.memory) % ALIGNMENT) % ALIGNMENT;
+    block.size = size;
+    blocks_.push_back(block);
+    ++heap_allocations_;
+  }
+
+  void release() {
+    for (const Block& block : blocks_)
+      ::operator delete(block.memory);
+
+    blocks_.clear();
+  }
+
+public:
+  Arena() : current_(0), offset_(0), used_(0), high_water_(0), heap_allocations_(0) {
+    blocks_.reserve(8);
+  }
+
+  ~Arena() { release(); }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /** Bytes of scratch aligned to alignment (a power of two, at most 64), valid until reset() */
+  void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    size_t start = (offset_ + alignment - 1) & ~(alignment - 1);
+
+    if (blocks_.empty() || start + bytes > blocks_[current_].size) {
+      // the rest of this block is wasted; the next one is big enough for
+      // everything so far, so chains stay short
+      if (current_ + 1 < blocks_.size() && blocks_[current_ + 1].size >= bytes) {
+        ++current_;
+      } else {
+        const size_t size = std::max(bytes, capacity());
+        addBlock(size < MIN_BLOCK ? size_t(MIN_BLOCK) : size);
+        current_ = blocks_.size() - 1;
+      }
+
+      offset_ = 0;
+      start = 0;
+    }
+
+    used_ += start - offset_ + bytes;
+    offset_ = start + bytes;
+    high_water_ = std::max(high_water_, used_);
+
+    return blocks_[current_].data + start;
+  }
+
+  /** Uninitialized room for count Ts */
+  template<typename T>
+  T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+  /** Take back everything handed out; a chain of blocks becomes one block of their total size */
+  void reset() {
+    if (blocks_.size() > 1) {
+      const size_t total = capacity();
+      release();
+      addBlock(total);
+    }
+
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+  }
+
+  /** Bytes handed out since the last reset() */
+  size_t used() const { return used_; }
+
+  /** Most bytes ever handed out between two resets */
+  size_t highWater() const { return high_water_; }
+
+  /** Bytes of all blocks */
+  size_t capacity() const {
+    size_t total = 0;
+
+    for (const Block& block : blocks_)
+      total += block.size;
+
+    return total;
+  }
+
+  /** Blocks allocated from the heap so far */
+  uint64_t heapAllocations() const { return heap_allocations_; }
+};
+
+/**
+ *  A std allocator drawing from an Arena, for containers that only live
+ *  within a step: deallocate() does nothing, the memory comes back with the
+ *  arena's reset(). Made from nullptr it is just operator new and delete, so
+ *  code can take an optional arena and use the same container either way.
+ */
+template<class T>
+class ArenaAllocator {
+private:
+  Arena* arena_;
+
+public:
+  typedef T value_type;
+
+  template<class U>
+  struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+  explicit ArenaAllocator(Arena* arena = nullptr) : arena_(arena) {}
+
+  template<class U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  Arena* arena() const { return arena_; }
+
+  T* allocate(size_t n) {
+    return arena_ ? arena_->allocate<T>(n) : static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* array, size_t) {
+    if (!arena_)
+      ::operator delete(array);
+  }
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
+
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+/**
+ *  The scratch memory of a Space's steps: one Arena for the stepping thread
+ *  and one per chunk of a parallel loop, so workers never share one (or a
+ *  cache line of its bookkeeping). Everything is reset at the start of a step.
+ */
+class StepArena {
+private:
+  Arena main_;
+  std::vector<std::unique_ptr<Arena> > workers_;
+
+public:
+  explicit StepArena(size_t workers = 1) { setWorkers(workers); }
+
+  /** Make room for parallel loops of up to count chunks; only between steps */
+  void setWorkers(size_t count) {
+    count = std::max<size_t>(1, count);
+
+    while (workers_.size() < count)
+      workers_.emplace_back(new Arena());
+  }
+
+  size_t workers() const { return workers_.size(); }
+
+  /** For the stepping thread, outside parallel loops */
+  Arena& main() { return main_; }
+
+  /** For chunk of a parallel loop (chunk < workers()), whichever thread runs it */
+  Arena& worker(size_t chunk) { return *workers_[chunk]; }
+
+  void reset() {
+    main_.reset();
+
+    for (const std::unique_ptr<Arena>& worker : workers_)
+      worker->reset();
+  }
+
+  /** Bytes handed out since the last reset(), over all the arenas */
+  size_t used() const {
+    size_t total = main_.used();
+
+    for (const std::unique_ptr<Arena>& worker : workers_)
+      total += worker->used();
+
+    return total;
+  }
+
+  /** Sum of the arenas' high-water marks */
+  size_t highWater() const {
+    size_t total = main_.highWater();
+
+    for (const std::unique_ptr<Arena>& worker : workers_)
+      total += worker->highWater();
+
+    return total;
+  }
+
+  size_t capacity() const {
+    size_t total = main_.capacity();
+
+    for (const std::unique_ptr<Arena>& worker : workers_)
+      total += worker->capacity();
+
+    return total;
+  }
+
+  /** Blocks the arenas have taken from the heap; flat once the workload has settled */
+  uint64_t heapAllocations() const {
+    uint64_t total = main_.heapAllocations();
+
+    for (const std::unique_ptr<Arena>& worker : workers_)
+      total += worker->heapAllocations();
+
+    return total;
+  }
+};
+
+/**
+ *  Keeps freed single-object allocations (the nodes of node based containers)
+ *  on free lists by size and hands them out again, so a set whose contents
+ *  churn without growing stops allocating. Everything goes back to the heap
+ *  when the recycler is destroyed, so it has to outlive the containers using
+ *  it (declare it first).
+ */
+class NodeRecycler {
+private:
+  std::vector<std::pair<size_t, std::vector<void*> > > free_; // by node size
+
+  std::vector<void*>& listFor(size_t size) {
+    for (std::pair<size_t, std::vector<void*> >& list : free_) {
+      if (list.first == size)
+        return list.second;
+    }
+
+    free_.push_back(std::make_pair(size, std::vector<void*>()));
+    return free_.back().second;
+  }
+
+public:
+  NodeRecycler() {}
+
+  ~NodeRecycler() {
+    for (const std::pair<size_t, std::vector<void*> >& list : free_) {
+      for (void* node : list.second)
+        ::operator delete(node);
+    }
+  }
+
+  NodeRecycler(const NodeRecycler&) = delete;
+  NodeRecycler& operator=(const NodeRecycler&) = delete;
+
+  void* allocate(size_t size) {
+    std::vector<void*>& list = listFor(size);
+
+    if (list.empty())
+      return ::operator new(size);
+
+    void* node = list.back();
+    list.pop_back();
+    return node;
+  }
+
+  void deallocate(void* node, size_t size) { listFor(size).push_back(node); }
+};
+
+/** A std allocator recycling single objects through a NodeRecycler; arrays use the heap */
+template<class T>
+class RecyclingAllocator {
+private:
+  NodeRecycler* recycler_;
+
+public:
+  typedef T value_type;
+
+  template<class U>
+  struct rebind {
+    typedef RecyclingAllocator<U> other;
+  };
+
+  explicit RecyclingAllocator(NodeRecycler* recycler) : recycler_(recycler) {}
+
+  template<class U>
+  RecyclingAllocator(const RecyclingAllocator<U>& other) : recycler_(other.recycler()) {}
+
+  NodeRecycler* recycler() const { return recycler_; }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(n == 1 ? recycler_->allocate(sizeof(T)) : ::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n == 1)
+      recycler_->deallocate(p, sizeof(T));
+    else
+      ::operator delete(p);
+  }
+};
+
+template<class T, class U>
+bool operator==(const RecyclingAllocator<T>& a, const RecyclingAllocator<U>& b) { return a.recycler() == b.recycler(); }
+
+template<class T, class U>
+bool operator!=(const RecyclingAllocator<T>& a, const RecyclingAllocator<U>& b) { return a.recycler() != b.recycler(); }
+
+}
+
+#endif // FLATICS_ARENA_H
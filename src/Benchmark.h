@@ -0,0 +1,133 @@
+#ifndef FLATICS_BENCHMARK_H
+#define FLATICS_BENCHMARK_H
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/** Keep the compiler from optimizing away a value the benchmark computed */
+template<typename Type>
+inline void doNotOptimize(const Type& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+/** Cycle statistics of one benchmarked kernel, per call */
+struct BenchmarkResult {
+  double median;
+  double mad;     // median absolute deviation from the median
+  double min;
+  size_t samples;
+};
+
+/**
+ *  Microbenchmark harness on top of startTiming()/stopTiming().
+ *
+ *  A kernel is any callable taking the iteration index. Each sample times a
+ *  batch of calls between the serializing cpuid/rdtsc(p) pairs, the cost of an
+ *  empty batch is subtracted, and the per-call cycle counts of all samples are
+ *  summarized by median and MAD, which shrug off the odd interrupt far better
+ *  than mean and standard deviation.
+ */
+class Benchmark {
+private:
+  size_t samples_;
+  size_t batch_;
+  size_t warmup_;
+  double overhead_;
+
+  template<class Kernel>
+  uint64_t timeBatch(Kernel& kernel) {
+    uint32_t start_high, start_low, end_high, end_low;
+
+    startTiming(start_high, start_low);
+    for (size_t i = 0; i < batch_; ++i)
+      kernel(i);
+    stopTiming(end_high, end_low);
+
+    return cycleDifference(start_high, start_low, end_high, end_low);
+  }
+
+  static double median(std::vector<double>& values) {
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    return values[middle];
+  }
+
+  template<class Kernel>
+  std::vector<double> sample(Kernel kernel) {
+    for (size_t i = 0; i < warmup_; ++i)
+      timeBatch(kernel);
+
+    std::vector<double> cycles(samples_);
+    for (size_t i = 0; i < samples_; ++i)
+      cycles[i] = static_cast<double>(timeBatch(kernel));
+
+    return cycles;
+  }
+
+public:
+  /**
+   *  @param samples timed samples per kernel
+   *  @param batch calls per sample
+   *  @param warmup untimed samples run first to settle caches, predictors and clocks
+   */
+  Benchmark(size_t samples = 101, size_t batch = 1000, size_t warmup = 20)
+      : samples_(samples), batch_(batch), warmup_(warmup), overhead_(0) {
+    // measure the harness itself so it can be taken out of every result
+    std::vector<double> empty = sample([](size_t i) { doNotOptimize(i); });
+    overhead_ = median(empty);
+  }
+
+  /** Pin the benchmarking thread so samples don't migrate between cores */
+  static bool pin(unsigned cpu = 0) { return pinThread(cpu); }
+
+  template<class Kernel>
+  BenchmarkResult run(Kernel kernel) {
+    std::vector<double> cycles = sample(kernel);
+
+    for (double& c : cycles)
+      c = std::max(0.0, c - overhead_) / batch_;
+
+    BenchmarkResult result;
+    result.samples = cycles.size();
+    result.min = *std::min_element(cycles.begin(), cycles.end());
+    result.median = median(cycles);
+
+    for (double& c : cycles)
+      c = std::fabs(c - result.median);
+    result.mad = median(cycles);
+
+    return result;
+  }
+
+  /** Run a kernel and print one line of results */
+  template<class Kernel>
+  BenchmarkResult run(const std::string& name, Kernel kernel, std::ostream& os = std::cout) {
+    BenchmarkResult result = run(kernel);
+    report(name, result, os);
+    return result;
+  }
+
+  static void reportHeader(std::ostream& os = std::cout) {
+    os << std::left << std::setw(32) << "kernel" << std::right
+       << std::setw(12) << "median" << std::setw(10) << "mad" << std::setw(10) << "min" << "  (cycles/call)" << std::endl;
+  }
+
+  static void report(const std::string& name, const BenchmarkResult& result, std::ostream& os = std::cout) {
+    os << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+       << std::setw(12) << result.median << std::setw(10) << result.mad << std::setw(10) << result.min << std::endl;
+    os.unsetf(std::ios_base::floatfield);
+  }
+};
+
+}
+
+#endif // FLATICS_BENCHMARK_H
@@ -0,0 +1,212 @@
+#ifndef FLATICS_BLOCKTIMESTEPS_H
+#define FLATICS_BLOCKTIMESTEPS_H
+
+#include "Circle.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Hierarchical (power-of-two block) individual timesteps.
+ *
+ *  A body on level k steps by dt / 2^k, where dt is the step passed to
+ *  advance(). Levels come from two criteria on the body's own scale: it
+ *  shouldn't move more than a fraction of its radius in one step, and its
+ *  acceleration shouldn't change its velocity by more than that either.
+ *
+ *  Within advance() every body is integrated with kick-drift-kick leapfrog on
+ *  its own level. All bodies drift together, but a body's acceleration is
+ *  only evaluated at the end of its own step, so a few fast bodies deep in the
+ *  hierarchy cost force evaluations for themselves alone. Contacts are handed
+ *  back to the caller on the same schedule, so a fast body can't pass through
+ *  another between its steps. A body may move to a finer level after any of
+ *  its steps, and to a coarser one only where that level's steps line up.
+ */
+template<typename Scalar, class Vec>
+class BlockTimesteps {
+public:
+  typedef Circle<Scalar, Vec> Object;
+
+private:
+  unsigned max_level_;
+  Scalar eta_;
+
+  std::vector<unsigned> level_;
+  std::vector<Vec> acceleration_;
+  std::vector<size_t> active_;
+  unsigned deepest_;
+  bool valid_;
+
+  size_t substeps_;
+  size_t evaluations_;
+
+  /** Ticks of the finest level in one step on level */
+  size_t span(unsigned level) const { return size_t(1) << (max_level_ - level); }
+
+  /** The coarsest level whose step is no longer than the body's criteria allow */
+  unsigned desiredLevel(const Object& obj, const Vec& acceleration, Scalar dt) const {
+    Scalar limit = dt;
+    Scalar speed = obj.speed();
+    Scalar magnitude = acceleration.length();
+
+    if (speed > 0)
+      limit = std::min(limit, eta_ * obj.radius() / speed);
+
+    if (magnitude > 0)
+      limit = std::min(limit, eta_ * std::sqrt(obj.radius() / magnitude));
+
+    unsigned level = 0;
+    while (level < max_level_ && dt / (size_t(1) << level) > limit)
+      ++level;
+
+    return level;
+  }
+
+  template<class Acceleration>
+  void evaluate(const Object* objects, const std::vector<size_t>& which, Acceleration& acceleration, ThreadPool* pool) {
+    auto range = [&](size_t begin, size_t end, size_t) {
+      for (size_t k = begin; k < end; ++k)
+        acceleration_[which[k]] = acceleration(objects, which[k]);
+    };
+
+    if (pool && which.size() > 64)
+      pool->parallelFor(which.size(), range);
+    else
+      range(0, which.size(), 0);
+
+    evaluations_ += which.size();
+  }
+
+  void updateDeepest() {
+    deepest_ = 0;
+    for (unsigned level : level_)
+      deepest_ = std::max(deepest_, level);
+  }
+
+public:
+  /**
+   *  @param maxLevel finest level, whose step is dt / 2^maxLevel
+   *  @param eta fraction of its radius a body may move in one step, and the matching acceleration criterion
+   */
+  explicit BlockTimesteps(unsigned maxLevel = 8, Scalar eta = 0.25)
+      : max_level_(maxLevel), eta_(eta), deepest_(0), valid_(false), substeps_(0), evaluations_(0) {}
+
+  unsigned maxLevel() const { return max_level_; }
+
+  Scalar eta() const { return eta_; }
+
+  /** Level of the body at index i, as of the last advance() */
+  unsigned level(size_t i) const { return i < level_.size() ? level_[i] : 0; }
+
+  /** Finest level any body is on */
+  unsigned deepest() const { return deepest_; }
+
+  /** Substeps and per-body acceleration evaluations the last advance() took */
+  size_t substeps() const { return substeps_; }
+
+  size_t evaluations() const { return evaluations_; }
+
+  /** Forget levels and accelerations, e.g. when the bodies have been reordered */
+  void invalidate() { valid_ = false; }
+
+  /**
+   *  Advance every body by dt.
+   *
+   *  @param acceleration acceleration(objects, i) is body i's acceleration at the current positions; called concurrently
+   *  @param drifted drifted(obj) runs on every body after it moves, e.g. to apply the world boundary
+   *  @param contacts contacts(active) resolves the contacts of the bodies whose steps end now, before their forces;
+   *         at the end of advance() every body is active
+   */
+  template<class Acceleration, class Drifted, class Contacts>
+  void advance(Object* objects, size_t count, Scalar dt, Acceleration acceleration, Drifted drifted, Contacts contacts,
+               ThreadPool* pool = nullptr) {
+    substeps_ = 0;
+    evaluations_ = 0;
+
+    if (count == 0)
+      return;
+
+    const size_t ticks = span(0);
+    const Scalar tick_dt = dt / ticks;
+
+    if (!valid_ || level_.size() != count) {
+      level_.resize(count);
+      acceleration_.resize(count);
+      active_.resize(count);
+
+      for (size_t i = 0; i < count; ++i)
+        active_[i] = i;
+
+      evaluate(objects, active_, acceleration, pool);
+
+      for (size_t i = 0; i < count; ++i)
+        level_[i] = desiredLevel(objects[i], acceleration_[i], dt);
+
+      valid_ = true;
+    }
+
+    updateDeepest();
+
+    for (size_t tick = 0; tick < ticks;) {
+      // opening half kick for everyone starting a step now, and everyone drifts
+      // to the next time some step ends
+      size_t stride = ticks - tick;
+
+      for (size_t i = 0; i < count; ++i) {
+        const size_t length = span(level_[i]);
+        const size_t into = tick % length;
+
+        if (into == 0)
+          objects[i].setVelocity(objects[i].velocity() + acceleration_[i] * (length * tick_dt / 2));
+
+        stride = std::min(stride, length - into);
+      }
+
+      const Scalar drift_dt = stride * tick_dt;
+
+      for (size_t i = 0; i < count; ++i) {
+        objects[i].translate(objects[i].velocity() * drift_dt);
+        drifted(objects[i]);
+      }
+
+      tick += stride;
+      ++substeps_;
+
+      active_.clear();
+      for (size_t i = 0; i < count; ++i) {
+        if (tick % span(level_[i]) == 0)
+          active_.push_back(i);
+      }
+
+      contacts(active_);
+      evaluate(objects, active_, acceleration, pool);
+
+      // closing half kick, then a level for the next step
+      for (size_t i : active_) {
+        unsigned level = level_[i];
+        objects[i].setVelocity(objects[i].velocity() + acceleration_[i] * (span(level) * tick_dt / 2));
+
+        unsigned desired = desiredLevel(objects[i], acceleration_[i], dt);
+
+        if (desired > level) {
+          level = desired;
+        } else {
+          while (level > desired && tick % span(level - 1) == 0)
+            --level;
+        }
+
+        level_[i] = level;
+      }
+
+      updateDeepest();
+    }
+  }
+};
+
+}
+
+#endif // FLATICS_BLOCKTIMESTEPS_H
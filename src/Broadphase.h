@@ -0,0 +1,57 @@
+#ifndef FLATICS_BROADPHASE_H
+#define FLATICS_BROADPHASE_H
+
+#include "Arena.h"
+#include "Circle.h"
+#include "ThreadPool.h"
+
+#include <utility>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Finds the pairs of bodies whose bounding boxes overlap, so the exact
+ *  collision test only runs on those.
+ *
+ *  Implementations may keep state between steps keyed by body id; indices into
+ *  the object array may change from one call to the next (e.g. after Morton
+ *  reordering), ids do not.
+ */
+template<typename Scalar, class Vec>
+class Broadphase {
+public:
+  typedef Circle<Scalar, Vec> Object;
+
+  /** Indices into the object array, first < second */
+  typedef std::pair<size_t, size_t> Pair;
+
+  virtual ~Broadphase() {}
+
+  /**
+   *  Bring the structure up to date with the bodies (ids[i] is the id of
+   *  objects[i]) and append every pair whose bounding boxes overlap, once.
+   */
+  virtual void findPairs(const Object* objects, const size_t* ids, size_t count, std::vector<Pair>& pairs) = 0;
+
+  /** A body has left the simulation */
+  virtual void remove(size_t id) = 0;
+
+  /** Forget every body */
+  virtual void clear() = 0;
+
+  /** Workers the implementation may use; nullptr means serial */
+  virtual void setThreadPool(ThreadPool*) {}
+
+  /** Scratch memory for what only lives within a findPairs() call; nullptr means the heap */
+  virtual void setArena(StepArena*) {}
+
+  static bool overlaps(const Object& obj1, const Object& obj2) {
+    return obj1.minX() <= obj2.maxX() && obj2.minX() <= obj1.maxX()
+        && obj1.minY() <= obj2.maxY() && obj2.minY() <= obj1.maxY();
+  }
+};
+
+}
+
+#endif // FLATICS_BROADPHASE_H
@@ -23,7 +23,7 @@ public:
   Scalar minY() const { return this->position_.y - radius_; };
   Scalar maxY() const { return this->position_.y + radius_; };
 
-  Scalar radius() const { return radius_; }
+  const Scalar& radius() const { return radius_; }
 
   // "bounce" off something with infinite mass
   // TODO: make sure this works...
@@ -55,7 +55,7 @@ public:
     this->velocity_.x = -this->velocity_.x * restituton_factor;
   }
 
-  // TODO: vector form is less efficient when compiled with -O2
+  // Alternative to collide(); bench/kernel_bench.cpp measures the two against each other
   inline static Vec vectorCollision(Scalar cr, Scalar m1, const Vec& x1, const Vec& v1, Scalar m2, const Vec& x2, const Vec& v2) {
     Vec difference(x1 - x2);
 
@@ -70,7 +70,8 @@ public:
   }
 
   // TODO: this is not the right way to do this
-  inline static void collide(Circle& obj1, Circle& obj2) {
+  /** Resolve a collision between two touching circles with coefficient of restitution cr */
+  inline static void collide(Circle& obj1, Circle& obj2, Scalar cr = 0.6) {
     const Scalar& m1(obj1.mass());
     const Vec& x1(obj1.position());
     const Vec& v1(obj1.velocity());
@@ -78,47 +79,21 @@ public:
     const Vec& x2(obj2.position());
     const Vec& v2(obj2.velocity());
 
-    const double cr = 0.6;
-
     Vec difference(x1 - x2);
 
     if (difference) {
-      // COMPARE METHODS
-      // TODO: COMPARE EFFICIENCY OF METHODS
-
-      /* TODO: remove this comparison code
-      uint64_t vector_1 = cycleCount();
-
-      Vec new_obj1_vel(vectorCollision(cr, obj1.mass_, obj1.position_, obj1.velocity_, obj2.mass_, obj2.position_, obj2.velocity_));
-      Vec new_obj2_vel(vectorCollision(cr, obj2.mass_, obj2.position_, obj2.velocity_, obj1.mass_, obj1.position_, obj1.velocity_));
-      Vec test(new_obj1_vel);
-
-      uint64_t vector_2 = cycleCount();
-
-//      std::cout << "COLLISION!" << std::endl;
-
-      uint64_t linear_1 = cycleCount();
-*/
       Vec unit_normal(difference.normalized());
-      Vec unit_tangent(-unit_normal.y, unit_normal.x);
 
       Scalar v1_normal = unit_normal.dotProduct(v1);
       Scalar v2_normal = unit_normal.dotProduct(v2);
 
-      Scalar v1_tangent = unit_tangent.dotProduct(v1);
-      Scalar v2_tangent = unit_tangent.dotProduct(v2);
-
       Scalar v1_normal_f = PointMass<Scalar, Vec>::inelasticCollision(cr, m1, v1_normal, m2, v2_normal);
       Scalar v2_normal_f = PointMass<Scalar, Vec>::inelasticCollision(cr, m2, v2_normal, m1, v1_normal);
 
-      obj1.velocity_ = v1_normal_f * unit_normal + v1_tangent * unit_tangent;
-      obj2.velocity_ = v2_normal_f * unit_normal + v2_tangent * unit_tangent;
-
-/*  // TODO: cleanup
-      uint64_t linear_2 = cycleCount();
-      std::cout << "METHOD 1 TOOK: " << vector_2 - vector_1 << " and GIVES: " << new_obj1_vel << " " << new_obj2_vel << std::endl;
-      std::cout << "METHOD 2 TOOK: " << linear_2 - linear_1 << " and GIVES: " << obj1.velocity_ << " " << obj2.velocity_ << std::endl;
-*/
+      // only the normal components change, so adjust them in place rather than
+      // rebuilding both velocities from normal and tangent projections
+      obj1.velocity_ += (v1_normal_f - v1_normal) * unit_normal;
+      obj2.velocity_ += (v2_normal_f - v2_normal) * unit_normal;
     }
   }
 
@@ -134,10 +109,15 @@ public:
   // TODO: This is not good... find a better way to avoid overlapping
   static void unoverlap(Circle& obj1, Circle& obj2) {
     Vec difference(obj1.position() - obj2.position());
-    Scalar translateDistance = obj1.radius() + obj2.radius() - difference.length();
+    Scalar distance = difference.length();
+    Scalar translateDistance = obj1.radius() + obj2.radius() - distance;
 
     if (translateDistance > 0) {
-      difference.addLength(translateDistance); // TODO: should I add just a bit to the translate distance?
+      // TODO: should I add just a bit to the translate distance?
+      if (distance != 0)
+        difference *= (distance + translateDistance) / distance;
+      else
+        difference.x = translateDistance;
 
       // move the lass massive of the two objects
       if (obj1.mass() < obj2.mass()) {
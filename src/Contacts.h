@@ -0,0 +1,147 @@
+#ifndef FLATICS_CONTACTS_H
+#define FLATICS_CONTACTS_H
+
+#include <algorithm>
+#include <vector>
+
+namespace flatics {
+
+/** A change in the contact state of a pair of bodies during one step */
+template<typename Scalar, class Vec>
+struct ContactEvent {
+  enum Type {
+    BEGIN,   // the bodies touched this step but not the one before
+    PERSIST, // the bodies touched this step and the one before
+    END,     // the bodies touched the step before but not this one
+  };
+
+  Type type;
+
+  // body ids, body1 < body2
+  size_t body1;
+  size_t body2;
+
+  /** Magnitude of the impulse exchanged this step (0 for END) */
+  Scalar impulse;
+
+  /** Point of contact on the line between the centers (last known point for END) */
+  Vec point;
+};
+
+/**
+ *  Collects the contacts of one step and turns them into begin/persist/end
+ *  events by diffing against the contacts of the previous step.
+ *
+ *  Both steps' contacts are kept sorted by pair of ids, so the diff is a
+ *  single linear merge. A pair may be recorded several times in a step
+ *  (block timesteps resolve contacts at every substep); those records become
+ *  one, with the impulses summed and the point of the strongest.
+ */
+template<typename Scalar, class Vec>
+class ContactTracker {
+public:
+  typedef ContactEvent<Scalar, Vec> Event;
+
+private:
+  struct Contact {
+    size_t body1, body2; // smallest id first
+    Scalar impulse;
+    Vec point;
+
+    bool operator<(const Contact& other) const {
+      return body1 < other.body1 || (body1 == other.body1 && body2 < other.body2);
+    }
+
+    bool samePair(const Contact& other) const { return body1 == other.body1 && body2 == other.body2; }
+  };
+
+  std::vector<Contact> current_;
+  std::vector<Contact> previous_;
+  std::vector<Event> events_;
+
+  void emit(typename Event::Type type, const Contact& contact) {
+    Event event;
+    event.type = type;
+    event.body1 = contact.body1;
+    event.body2 = contact.body2;
+    event.impulse = type == Event::END ? Scalar(0) : contact.impulse;
+    event.point = contact.point;
+    events_.push_back(event);
+  }
+
+public:
+  /** Start collecting the contacts of a new step */
+  void begin() {
+    current_.clear();
+  }
+
+  /** Record that two bodies touched during the current step */
+  void record(size_t id1, size_t id2, Scalar impulse, const Vec& point) {
+    Contact contact;
+    contact.body1 = std::min(id1, id2);
+    contact.body2 = std::max(id1, id2);
+    contact.impulse = impulse;
+    contact.point = point;
+    current_.push_back(contact);
+  }
+
+  /** Diff the current step against the previous one and publish the events */
+  void finish() {
+    std::sort(current_.begin(), current_.end());
+
+    if (!current_.empty()) {
+      size_t merged = 0;
+      Scalar strongest = current_[0].impulse;
+
+      for (size_t i = 1; i < current_.size(); ++i) {
+        Contact& last = current_[merged];
+
+        if (!current_[i].samePair(last)) {
+          current_[++merged] = current_[i];
+          strongest = current_[i].impulse;
+          continue;
+        }
+
+        if (current_[i].impulse > strongest) {
+          strongest = current_[i].impulse;
+          last.point = current_[i].point;
+        }
+
+        last.impulse += current_[i].impulse;
+      }
+
+      current_.resize(merged + 1);
+    }
+
+    events_.clear();
+
+    typename std::vector<Contact>::const_iterator now = current_.begin(), before = previous_.begin();
+
+    while (now != current_.end() || before != previous_.end()) {
+      if (before == previous_.end() || (now != current_.end() && *now < *before)) {
+        emit(Event::BEGIN, *now++);
+      } else if (now == current_.end() || *before < *now) {
+        emit(Event::END, *before++);
+      } else {
+        emit(Event::PERSIST, *now++);
+        ++before;
+      }
+    }
+
+    previous_.swap(current_);
+  }
+
+  /** The events of the last finished step, valid until the next finish() */
+  const std::vector<Event>& events() const { return events_; }
+
+  /** Forget every contact, e.g. when the bodies are cleared */
+  void clear() {
+    current_.clear();
+    previous_.clear();
+    events_.clear();
+  }
+};
+
+}
+
+#endif // FLATICS_CONTACTS_H
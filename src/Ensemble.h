@@ -0,0 +1,172 @@
+#ifndef FLATICS_ENSEMBLE_H
+#define FLATICS_ENSEMBLE_H
+
+#include "Space.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/** Named columns of doubles, one row per simulation */
+class ResultTable {
+private:
+  std::vector<std::string> names_;
+  std::vector<std::vector<double> > columns_;
+  size_t rows_;
+
+public:
+  ResultTable() : rows_(0) {}
+
+  /** Add a column (or find the existing one) and return its index */
+  size_t addColumn(const std::string& name) {
+    for (size_t c = 0; c < names_.size(); ++c) {
+      if (names_[c] == name)
+        return c;
+    }
+
+    names_.push_back(name);
+    columns_.emplace_back(rows_);
+    return names_.size() - 1;
+  }
+
+  void resize(size_t rows) {
+    rows_ = rows;
+    for (std::vector<double>& column : columns_)
+      column.resize(rows);
+  }
+
+  size_t rows() const { return rows_; }
+
+  size_t columns() const { return columns_.size(); }
+
+  const std::vector<std::string>& names() const { return names_; }
+
+  /** Column index by name, or columns() if there is none */
+  size_t find(const std::string& name) const {
+    return std::find(names_.begin(), names_.end(), name) - names_.begin();
+  }
+
+  double& at(size_t column, size_t row) { return columns_[column][row]; }
+
+  double at(size_t column, size_t row) const { return columns_[column][row]; }
+
+  const std::vector<double>& column(size_t column) const { return columns_[column]; }
+
+  const std::vector<double>& column(const std::string& name) const { return columns_[find(name)]; }
+
+  /** Comma separated, a header line then one line per row */
+  void write(std::ostream& os) const {
+    for (size_t c = 0; c < names_.size(); ++c)
+      os << (c ? "," : "") << names_[c];
+    os << '\n';
+
+    for (size_t r = 0; r < rows_; ++r) {
+      for (size_t c = 0; c < columns_.size(); ++c)
+        os << (c ? "," : "") << columns_[c][r];
+      os << '\n';
+    }
+  }
+};
+
+/**
+ *  A batch of independent simulations stepped together on one pool.
+ *
+ *  Each run() puts the simulations in one queue, biggest first, and the
+ *  calling thread and every worker keep taking the next one until none are
+ *  left, so a sweep of thousands of small scenes keeps every core busy without one
+ *  process per scene. Once a simulation has finished its steps the reducers
+ *  summarize it into its row of the result table, still on the same worker.
+ *
+ *  The simulations should not be given the pool themselves: the ensemble is
+ *  already the parallel loop.
+ */
+template<typename Scalar, class Vec>
+class Ensemble {
+public:
+  typedef Space<Scalar, Vec> Simulation;
+  typedef std::function<double(const Simulation&)> Reducer;
+
+private:
+  ThreadPool& pool_;
+  std::vector<std::unique_ptr<Simulation> > simulations_;
+  std::vector<std::string> reducer_names_;
+  std::vector<Reducer> reducers_;
+  ResultTable results_;
+
+public:
+  /** Starts with the energy and momentum reducers */
+  explicit Ensemble(ThreadPool& pool) : pool_(pool) {
+    addReducer("energy", [](const Simulation& simulation) { return double(simulation.energy()); });
+    addReducer("momentum_x", [](const Simulation& simulation) { return double(simulation.momentum().x); });
+    addReducer("momentum_y", [](const Simulation& simulation) { return double(simulation.momentum().y); });
+  }
+
+  /** Construct a simulation in place with Space's constructor arguments and return it for setup */
+  template<typename... Args>
+  Simulation& add(Args&&... args) {
+    simulations_.emplace_back(new Simulation(std::forward<Args>(args)...));
+    return *simulations_.back();
+  }
+
+  size_t size() const { return simulations_.size(); }
+
+  Simulation& operator[](size_t i) { return *simulations_[i]; }
+
+  const Simulation& operator[](size_t i) const { return *simulations_[i]; }
+
+  /** Summarize every simulation into a column called name after each run(); called concurrently */
+  void addReducer(const std::string& name, Reducer reducer) {
+    reducer_names_.push_back(name);
+    reducers_.push_back(std::move(reducer));
+  }
+
+  /** Step every simulation steps times by dt and fill the result table */
+  void run(size_t steps, Scalar dt) {
+    results_.resize(simulations_.size());
+
+    std::vector<size_t> columns;
+    for (const std::string& name : reducer_names_)
+      columns.push_back(results_.addColumn(name));
+
+    // longest first, so no big scene is left to run alone at the end; pair
+    // tests grow with the square of the body count
+    std::vector<size_t> order(simulations_.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return simulations_[a]->objects().size() > simulations_[b]->objects().size();
+    });
+
+    // one loop per thread, each taking the next simulation in that order as
+    // it finishes one; handing them out as tasks would let every worker pop
+    // its own most recently queued, i.e. smallest, first
+    std::atomic<size_t> next(0);
+
+    pool_.parallelFor(order.size(), [&](size_t, size_t, size_t) {
+      for (size_t k = next++; k < order.size(); k = next++) {
+        Simulation& simulation = *simulations_[order[k]];
+
+        for (size_t step = 0; step < steps; ++step)
+          simulation.update(dt);
+
+        for (size_t r = 0; r < reducers_.size(); ++r)
+          results_.at(columns[r], order[k]) = reducers_[r](simulation);
+      }
+    }, pool_.size() + 1);
+  }
+
+  /** One row per simulation, in the order they were added */
+  const ResultTable& results() const { return results_; }
+};
+
+}
+
+#endif // FLATICS_ENSEMBLE_H
@@ -0,0 +1,547 @@
+#ifndef FLATICS_HEATMAP_H
+#define FLATICS_HEATMAP_H
+
+#include "RenderList.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Rasterizes a state snapshot into a density or velocity field image, for
+ *  scenes with far too many bodies to draw one by one.
+ *
+ *  Every body is splatted into a fixed-resolution accumulation buffer (the
+ *  camera's width x height) with bilinear weights, so the field stays smooth
+ *  as bodies move between pixels. What accumulates is a quantity: how many
+ *  bodies, how much mass, or their mean speed. The field can be blurred with
+ *  a (near) Gaussian and mapped through a linear or logarithmic scale onto
+ *  a color gradient, giving an RGBA image that goes up as one texture.
+ *
+ *  Splatting bodies straight into a frame-sized buffer in whatever order they
+ *  come is a cache miss per body, so the screen is cut into 64 pixel square
+ *  tiles instead. One parallel pass over the bodies bins them by tile (a
+ *  counting sort, like radixSort()), then each worker accumulates whole tiles
+ *  in a small buffer of its own that stays in cache, writes the tile's pixels
+ *  out and leaves what spilled over its right and bottom edges to be merged
+ *  at the end. No two threads ever write the same memory, and the splatted
+ *  field is the same with or without a pool. The blur and the coloring run
+ *  over bands of rows in parallel too.
+ *
+ *  The snapshot is anything with x, y, vx, vy and mass arrays, a count and
+ *  origin_x/origin_y, like for RenderList. Nothing here needs a window.
+ */
+class Heatmap {
+public:
+  enum Quantity {
+    COUNT, // bodies per pixel
+    MASS,  // mass per pixel
+    SPEED, // mean speed of the bodies in the pixel
+  };
+
+private:
+  static const size_t TILE = 64;
+
+  /** A body binned into a tile: its position in pixels relative to the tile, and what it adds */
+  struct Splat {
+    float x, y;
+    float weight;
+  };
+
+  Quantity quantity_;
+  double blur_;          // Gaussian sigma in pixels, 0 for none
+  bool log_scale_;
+  double dynamic_range_; // with log_scale_, the ratio between the brightest value and the dimmest one still visible
+
+  std::vector<RenderColor> lut_; // 256 colors from the gradient
+
+  size_t width_, height_;
+  size_t tiles_x_, tiles_y_;
+  std::vector<uint32_t> tile_of_;     // per body, tiles_x_ * tiles_y_ when off screen
+  std::vector<size_t> tile_offset_;   // per chunk and tile, then per tile once summed
+  std::vector<Splat> splats_;         // bodies in tile order
+  std::vector<float> weight_, hits_;  // per pixel
+  std::vector<float> spill_weight_, spill_hits_; // per tile, its right column, bottom row and corner beyond the edge
+  std::vector<float> field_, scratch_;
+  std::vector<long> box_radii_; // three box blurs that add up to the Gaussian
+  std::vector<float> chunk_max_;
+  std::vector<uint8_t> pixels_;
+  float maximum_;
+
+  std::vector<uint8_t> color_index_; // by colorKey() of the scaled value
+  bool color_log_;
+  double color_range_;
+
+  size_t spillSize() const { return 2 * TILE + 1; }
+
+  /**
+   *  The top 16 bits of a non-negative float (exponent and 8 bits of mantissa),
+   *  which order the same way as the values; fine enough to pick one of 256
+   *  colors, and coarse enough that the whole range is one small table.
+   */
+  static uint16_t colorKey(float value) {
+    uint32_t bits;
+    value = std::max(value, 0.0f);
+    std::memcpy(&bits, &value, sizeof(bits));
+    return static_cast<uint16_t>(bits >> 15);
+  }
+
+  /** The gradient entry for every colorKey() of a scaled value, through the log or linear scale */
+  void buildColorIndex() {
+    if (color_index_.size() == 65536 && color_log_ == log_scale_ && color_range_ == dynamic_range_)
+      return;
+
+    color_index_.resize(65536);
+    color_log_ = log_scale_;
+    color_range_ = dynamic_range_;
+
+    const double norm = 255 / (log_scale_ ? std::log1p(dynamic_range_) : 1.0);
+
+    for (uint32_t key = 0; key < color_index_.size(); ++key) {
+      // the middle of the values sharing this key
+      const uint32_t bits = (key << 15) | (1u << 14);
+      float value;
+      std::memcpy(&value, &bits, sizeof(value));
+
+      const double t = std::isfinite(value) ? (log_scale_ ? std::log1p(double(value)) : double(value)) * norm : 255;
+      color_index_[key] = static_cast<uint8_t>(std::min(std::max(t, 0.0), 255.0) + 0.5);
+    }
+
+    color_index_[0] = 0;
+  }
+
+  template<class Function>
+  static void forRows(size_t rows, ThreadPool* pool, Function fn) {
+    if (pool && pool->size() > 1 && rows > 1)
+      pool->parallelFor(rows, fn);
+    else
+      fn(0, rows, 0);
+  }
+
+  /**
+   *  Accumulate the splats of tile in a local buffer, then write its pixels and
+   *  spill. The buffer has a border of one pixel all round: the top and left
+   *  ones are only ever reached from off screen, the bottom and right ones are
+   *  the spill.
+   */
+  void rasterizeTile(size_t tile, std::vector<float>& local) {
+    const size_t side = TILE + 2;
+    local.assign(2 * side * side, 0.0f);
+
+    for (size_t k = tile_offset_[tile]; k < tile_offset_[tile + 1]; ++k) {
+      const Splat& splat = splats_[k];
+      const size_t x0 = std::min(static_cast<size_t>(splat.x), TILE), y0 = std::min(static_cast<size_t>(splat.y), TILE);
+      const float fx = splat.x - x0, fy = splat.y - y0;
+      float* row0 = &local[2 * (y0 * side + x0)];
+      float* row1 = row0 + 2 * side;
+
+      row0[0] += (1 - fx) * (1 - fy) * splat.weight;
+      row0[1] += (1 - fx) * (1 - fy);
+      row0[2] += fx * (1 - fy) * splat.weight;
+      row0[3] += fx * (1 - fy);
+      row1[0] += (1 - fx) * fy * splat.weight;
+      row1[1] += (1 - fx) * fy;
+      row1[2] += fx * fy * splat.weight;
+      row1[3] += fx * fy;
+    }
+
+    const size_t left = (tile % tiles_x_) * TILE, top = (tile / tiles_x_) * TILE;
+    const size_t columns = std::min(TILE, width_ - left), rows = std::min(TILE, height_ - top);
+
+    for (size_t y = 0; y < rows; ++y) {
+      const float* source = &local[2 * ((y + 1) * side + 1)];
+
+      for (size_t x = 0; x < columns; ++x) {
+        weight_[(top + y) * width_ + left + x] = source[2 * x];
+        hits_[(top + y) * width_ + left + x] = source[2 * x + 1];
+      }
+    }
+
+    // right column, bottom row, corner: merged into the neighbours after every tile is done
+    float* spill_weight = &spill_weight_[tile * spillSize()];
+    float* spill_hits = &spill_hits_[tile * spillSize()];
+
+    for (size_t k = 0; k < TILE; ++k) {
+      spill_weight[k] = local[2 * ((k + 1) * side + TILE + 1)];
+      spill_hits[k] = local[2 * ((k + 1) * side + TILE + 1) + 1];
+      spill_weight[TILE + k] = local[2 * ((TILE + 1) * side + k + 1)];
+      spill_hits[TILE + k] = local[2 * ((TILE + 1) * side + k + 1) + 1];
+    }
+
+    spill_weight[2 * TILE] = local[2 * ((TILE + 1) * side + TILE + 1)];
+    spill_hits[2 * TILE] = local[2 * ((TILE + 1) * side + TILE + 1) + 1];
+  }
+
+  /** Add what tile spilled over its edges to the pixels beyond them */
+  void mergeSpill(size_t tile) {
+    const size_t left = (tile % tiles_x_) * TILE, top = (tile / tiles_x_) * TILE;
+    const float* spill_weight = &spill_weight_[tile * spillSize()];
+    const float* spill_hits = &spill_hits_[tile * spillSize()];
+
+    for (size_t k = 0; k <= 2 * TILE; ++k) {
+      const size_t x = k < TILE ? left + TILE : k < 2 * TILE ? left + k - TILE : left + TILE;
+      const size_t y = k < TILE ? top + k : top + TILE;
+
+      if (x < width_ && y < height_) {
+        weight_[y * width_ + x] += spill_weight[k];
+        hits_[y * width_ + x] += spill_hits[k];
+      }
+    }
+  }
+
+  /**
+   *  A box blur of the given radius along rows or down columns, from in to
+   *  out, as running sums so the cost doesn't depend on the radius. Near the
+   *  edges the box is cut short and the sum divided by what is left of it.
+   */
+  void boxPass(const std::vector<float>& in, std::vector<float>& out, long radius, bool columns, ThreadPool* pool) const {
+    forRows(height_, pool, [&](size_t begin, size_t end, size_t) {
+      if (!columns) {
+        const long length = static_cast<long>(width_);
+
+        for (size_t y = begin; y < end; ++y) {
+          const float* source = &in[y * width_];
+          float* row = &out[y * width_];
+          double sum = 0;
+
+          for (long x = 0; x < std::min(radius, length); ++x)
+            sum += source[x];
+
+          for (long x = 0; x < length; ++x) {
+            if (x + radius < length)
+              sum += source[x + radius];
+            if (x - radius - 1 >= 0)
+              sum -= source[x - radius - 1];
+
+            row[x] = static_cast<float>(sum / (std::min(x + radius, length - 1) - std::max(x - radius, 0L) + 1));
+          }
+        }
+        return;
+      }
+
+      // a running sum per column, a whole row at a time, so the loops run along memory
+      const long length = static_cast<long>(height_);
+      std::vector<float> sum(width_, 0.0f);
+
+      // primed with the rows the first one adds to and then drops
+      for (long y = std::max(long(begin) - radius - 1, 0L); y < std::min(long(begin) + radius, length); ++y) {
+        for (size_t x = 0; x < width_; ++x)
+          sum[x] += in[size_t(y) * width_ + x];
+      }
+
+      for (long y = long(begin); y < long(end); ++y) {
+        if (y + radius < length) {
+          const float* add = &in[size_t(y + radius) * width_];
+          for (size_t x = 0; x < width_; ++x)
+            sum[x] += add[x];
+        }
+
+        if (y - radius - 1 >= 0) {
+          const float* drop = &in[size_t(y - radius - 1) * width_];
+          for (size_t x = 0; x < width_; ++x)
+            sum[x] -= drop[x];
+        }
+
+        const float scale = 1.0f / (std::min(y + radius, length - 1) - std::max(y - radius, 0L) + 1);
+        float* row = &out[size_t(y) * width_];
+
+        for (size_t x = 0; x < width_; ++x)
+          row[x] = sum[x] * scale;
+      }
+    });
+  }
+
+  /** Blur field_ in place with the boxes of setBlur(), rows then columns for each */
+  void blur(ThreadPool* pool) {
+    scratch_.resize(field_.size());
+
+    for (long radius : box_radii_) {
+      boxPass(field_, scratch_, radius, false, pool);
+      boxPass(scratch_, field_, radius, true, pool);
+    }
+  }
+
+public:
+  Heatmap() : quantity_(COUNT), blur_(0), log_scale_(true), dynamic_range_(1000), width_(0), height_(0), tiles_x_(0), tiles_y_(0), maximum_(0),
+              color_log_(false), color_range_(0) {
+    // black through purple and orange to pale yellow
+    static const RenderColor GRADIENT[] = {
+      { 0, 0, 0, 255 },
+      { 60, 10, 100, 255 },
+      { 190, 50, 80, 255 },
+      { 250, 140, 20, 255 },
+      { 252, 255, 160, 255 },
+    };
+
+    setGradient(std::vector<RenderColor>(GRADIENT, GRADIENT + sizeof(GRADIENT) / sizeof(GRADIENT[0])));
+  }
+
+  Quantity quantity() const { return quantity_; }
+
+  void setQuantity(Quantity quantity) { quantity_ = quantity; }
+
+  /**
+   *  Blur the field with a Gaussian of sigma pixels, 0 for none. It is done as
+   *  three box blurs whose variances add up to sigma squared, which is close
+   *  to a true Gaussian and costs the same however wide it is.
+   */
+  void setBlur(double sigma) {
+    blur_ = std::max(0.0, sigma);
+    box_radii_.clear();
+
+    if (blur_ <= 0)
+      return;
+
+    // box widths: the odd widths either side of the ideal one, m of the narrower
+    const int BOXES = 3;
+    const double ideal = std::sqrt(12 * blur_ * blur_ / BOXES + 1);
+    long narrow = static_cast<long>(std::floor(ideal));
+
+    if (narrow % 2 == 0)
+      --narrow;
+
+    const long wide = narrow + 2;
+    const long m = std::lround((12 * blur_ * blur_ - BOXES * narrow * narrow - 4 * BOXES * narrow - 3 * BOXES) / (-4.0 * narrow - 4));
+
+    for (int box = 0; box < BOXES; ++box)
+      box_radii_.push_back(((box < m ? narrow : wide) - 1) / 2);
+  }
+
+  /** Logarithmic scale showing values down to 1/dynamicRange of the brightest, or a linear one */
+  void setLogScale(bool enabled, double dynamicRange = 1000) {
+    log_scale_ = enabled;
+    dynamic_range_ = std::max(1.0, dynamicRange);
+  }
+
+  /** Colors from zero to the brightest value, evenly spaced; needs at least two */
+  void setGradient(const std::vector<RenderColor>& stops) {
+    if (stops.size() < 2)
+      return;
+
+    lut_.resize(256);
+
+    for (size_t k = 0; k < lut_.size(); ++k) {
+      const double at = k / 255.0 * (stops.size() - 1);
+      const size_t low = std::min(static_cast<size_t>(at), stops.size() - 2);
+      const double t = at - low;
+      const RenderColor& a = stops[low];
+      const RenderColor& b = stops[low + 1];
+
+      RenderColor color = {
+        static_cast<uint8_t>(a.r + (b.r - a.r) * t + 0.5), static_cast<uint8_t>(a.g + (b.g - a.g) * t + 0.5),
+        static_cast<uint8_t>(a.b + (b.b - a.b) * t + 0.5), static_cast<uint8_t>(a.a + (b.a - a.a) * t + 0.5),
+      };
+      lut_[k] = color;
+    }
+  }
+
+  /** Rasterize snapshot as seen through camera, at camera.width x camera.height */
+  template<class Snapshot>
+  void build(const Snapshot& snapshot, const RenderCamera& camera, ThreadPool* pool = nullptr) {
+    const size_t count = snapshot.count;
+    const size_t chunks = pool && pool->size() > 1 && count > 4096 ? pool->size() : 1;
+
+    width_ = camera.width;
+    height_ = camera.height;
+    tiles_x_ = (width_ + TILE - 1) / TILE;
+    tiles_y_ = (height_ + TILE - 1) / TILE;
+
+    const size_t pixels = width_ * height_;
+    const size_t tiles = tiles_x_ * tiles_y_;
+    const uint32_t OFF = static_cast<uint32_t>(tiles);
+
+    const double shift_x = snapshot.origin_x - camera.left;
+    const double shift_y = snapshot.origin_y - camera.top;
+    const double scale = camera.scale;
+
+    tile_of_.resize(count);
+    tile_offset_.assign(chunks * tiles + 1, 0);
+
+    // pixel centres are at half-integers, so a body covers the four around it,
+    // the top left of which decides its tile
+    auto pixelOf = [&](size_t i, double& px, double& py) {
+      px = (snapshot.x[i] + shift_x) * scale - 0.5;
+      py = (snapshot.y[i] + shift_y) * scale - 0.5;
+    };
+
+    auto classify = [&](size_t begin, size_t end, size_t chunk) {
+      size_t* counts = &tile_offset_[chunk * tiles];
+      const double width = static_cast<double>(width_), height = static_cast<double>(height_);
+
+      for (size_t i = begin; i < end; ++i) {
+        double px, py;
+        pixelOf(i, px, py);
+
+        // off to the left or top still spills into the first column or row
+        if (!(px >= -1 && py >= -1 && px < width && py < height)) {
+          tile_of_[i] = OFF;
+          continue;
+        }
+
+        const size_t tx = px < 0 ? 0 : static_cast<size_t>(px) / TILE, ty = py < 0 ? 0 : static_cast<size_t>(py) / TILE;
+        tile_of_[i] = static_cast<uint32_t>(ty * tiles_x_ + tx);
+        ++counts[tile_of_[i]];
+      }
+    };
+
+    if (chunks > 1)
+      pool->parallelFor(count, classify, chunks);
+    else
+      classify(0, count, 0);
+
+    // exclusive prefix sum, tile-major and chunk-minor, so bodies keep their order within a tile
+    size_t total = 0;
+    std::vector<size_t> tile_begin(tiles + 1);
+
+    for (size_t tile = 0; tile < tiles; ++tile) {
+      tile_begin[tile] = total;
+
+      for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const size_t n = tile_offset_[chunk * tiles + tile];
+        tile_offset_[chunk * tiles + tile] = total;
+        total += n;
+      }
+    }
+
+    tile_begin[tiles] = total;
+    splats_.resize(total);
+
+    auto scatter = [&](size_t begin, size_t end, size_t chunk) {
+      size_t* next = &tile_offset_[chunk * tiles];
+
+      for (size_t i = begin; i < end; ++i) {
+        const uint32_t tile = tile_of_[i];
+
+        if (tile == OFF)
+          continue;
+
+        double px, py;
+        pixelOf(i, px, py);
+
+        // relative to the tile's local buffer, which starts a pixel up and left of it
+        const double left = double((tile % tiles_x_) * TILE) - 1, top = double((tile / tiles_x_) * TILE) - 1;
+        Splat& splat = splats_[next[tile]++];
+        splat.x = static_cast<float>(px - left);
+        splat.y = static_cast<float>(py - top);
+
+        switch (quantity_) {
+        case COUNT:
+          splat.weight = 1;
+          break;
+        case MASS:
+          splat.weight = static_cast<float>(snapshot.mass[i]);
+          break;
+        case SPEED:
+          splat.weight = static_cast<float>(std::sqrt(double(snapshot.vx[i]) * snapshot.vx[i] + double(snapshot.vy[i]) * snapshot.vy[i]));
+          break;
+        }
+      }
+    };
+
+    if (chunks > 1)
+      pool->parallelFor(count, scatter, chunks);
+    else
+      scatter(0, count, 0);
+
+    tile_offset_.swap(tile_begin);
+
+    // each tile on its own; a tile's local buffer starts one pixel up and left of it
+    weight_.resize(pixels);
+    hits_.resize(pixels);
+    spill_weight_.assign(tiles * spillSize(), 0.0f);
+    spill_hits_.assign(tiles * spillSize(), 0.0f);
+
+    auto rasterize = [&](size_t begin, size_t end, size_t) {
+      std::vector<float> local;
+      for (size_t tile = begin; tile < end; ++tile)
+        rasterizeTile(tile, local);
+    };
+
+    if (pool && pool->size() > 1)
+      pool->parallelFor(tiles, rasterize);
+    else
+      rasterize(0, tiles, 0);
+
+    for (size_t tile = 0; tile < tiles; ++tile)
+      mergeSpill(tile);
+
+    // resolve the quantity
+    field_.resize(pixels);
+
+    forRows(height_, pool, [&](size_t begin, size_t end, size_t) {
+      for (size_t p = begin * width_; p < end * width_; ++p)
+        field_[p] = quantity_ == SPEED ? (hits_[p] > 0 ? weight_[p] / hits_[p] : 0) : weight_[p];
+    });
+
+    if (!box_radii_.empty())
+      blur(pool);
+
+    // brightest value, then colors
+    const size_t bands = pool && pool->size() > 1 ? pool->size() : 1;
+    chunk_max_.assign(bands, 0.0f);
+
+    forRows(height_, pool, [&](size_t begin, size_t end, size_t chunk) {
+      float top = 0;
+      for (size_t p = begin * width_; p < end * width_; ++p)
+        top = std::max(top, field_[p]);
+      chunk_max_[chunk] = top;
+    });
+
+    maximum_ = *std::max_element(chunk_max_.begin(), chunk_max_.end());
+    pixels_.resize(4 * pixels);
+
+    const float gain = maximum_ > 0 ? static_cast<float>((log_scale_ ? dynamic_range_ : 1.0) / maximum_) : 0;
+    buildColorIndex();
+
+    forRows(height_, pool, [&](size_t begin, size_t end, size_t) {
+      for (size_t p = begin * width_; p < end * width_; ++p) {
+        const RenderColor& color = lut_[color_index_[colorKey(field_[p] * gain)]];
+
+        pixels_[4 * p] = color.r;
+        pixels_[4 * p + 1] = color.g;
+        pixels_[4 * p + 2] = color.b;
+        pixels_[4 * p + 3] = color.a;
+      }
+    });
+  }
+
+  size_t width() const { return width_; }
+
+  size_t height() const { return height_; }
+
+  /** The quantity per pixel after blurring, row by row from the top */
+  const std::vector<float>& field() const { return field_; }
+
+  /** Largest value in field() */
+  float maximum() const { return maximum_; }
+
+  /** The image, RGBA 8 bits each, row by row from the top: what a texture upload takes */
+  const std::vector<uint8_t>& pixels() const { return pixels_; }
+
+  /** Write the image as a binary PPM (alpha dropped); false if the file couldn't be written */
+  bool writePpm(const std::string& path) const {
+    std::ofstream file(path.c_str(), std::ios::binary);
+
+    if (!file)
+      return false;
+
+    file << "P6\n" << width_ << ' ' << height_ << "\n255\n";
+
+    for (size_t p = 0; p < width_ * height_; ++p)
+      file.write(reinterpret_cast<const char*>(&pixels_[4 * p]), 3);
+
+    return static_cast<bool>(file);
+  }
+};
+
+}
+
+#endif // FLATICS_HEATMAP_H
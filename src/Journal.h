@@ -0,0 +1,267 @@
+#ifndef FLATICS_JOURNAL_H
+#define FLATICS_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/*
+ *  A compact binary log of a deterministic session: everything that changed
+ *  a Space from outside, stamped with the step it happened before, plus a
+ *  hash of the state every so often. Replaying it into a Space configured
+ *  the same way re-executes the session step for step, and the hashes show
+ *  exactly where (if anywhere) the replay stopped matching.
+ *
+ *  The file is a JournalHeader followed by records. A record is a varint of
+ *  the steps since the previous record, a type byte and a payload; counts and
+ *  ids are varints, simulation values the raw bytes of the Scalar the session
+ *  ran in (header.scalar_size), host byte order. The first record is always a
+ *  JOURNAL_STATE with every body, and a cleanly closed journal ends with a
+ *  JOURNAL_END.
+ */
+
+enum JournalRecordType {
+  JOURNAL_STATE,    // settings, gravity, origin, next id, then every body with its id
+  JOURNAL_ADD,      // id, then radius, mass, x, y, vx, vy
+  JOURNAL_REMOVE,   // count, then that many ids
+  JOURNAL_CLEAR,
+  JOURNAL_ENERGIZE, // ratio
+  JOURNAL_HALT,
+  JOURNAL_GRAVITY,  // x, y
+  JOURNAL_SETTING,  // JournalSetting, then its value as a varint
+  JOURNAL_HASH,     // 64 bit hash of the bodies after the record's step
+  JOURNAL_END,      // 64 bit hash after the last step
+};
+
+enum JournalSetting {
+  SETTING_BOUNDARY,
+  SETTING_OBJECT_GRAVITY,
+  SETTING_RESTITUTION,
+  SETTING_BROADPHASE,
+};
+
+struct JournalHeader {
+  static const uint32_t MAGIC = 0x524a4c46; // "FLJR"
+  static const uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t scalar_size;
+  uint32_t threads;      // workers of the recording Space's pool (0 without one)
+  uint64_t seed;         // of the Space's random numbers
+  double step;           // the fixed step
+  double width, height;
+  uint64_t hash_interval;
+};
+
+/** FNV-1a over raw bytes, for state hashes */
+class StateHash {
+private:
+  uint64_t hash_;
+
+public:
+  StateHash() : hash_(0xcbf29ce484222325ull) {}
+
+  void add(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; ++i) {
+      hash_ ^= bytes[i];
+      hash_ *= 0x100000001b3ull;
+    }
+  }
+
+  template<typename Type>
+  void add(const Type& value) { add(&value, sizeof(value)); }
+
+  uint64_t value() const { return hash_; }
+};
+
+/** Appends records to a journal file, buffered */
+class JournalWriter {
+private:
+  std::FILE* file_;
+  std::vector<unsigned char> buffer_;
+  uint64_t last_step_;
+  uint64_t bytes_;
+
+public:
+  JournalWriter() : file_(nullptr), last_step_(0), bytes_(0) {}
+
+  ~JournalWriter() { close(); }
+
+  JournalWriter(const JournalWriter&) = delete;
+  JournalWriter& operator=(const JournalWriter&) = delete;
+
+  /** Start a new journal at path; false if it can't be created */
+  bool open(const std::string& path, const JournalHeader& header) {
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+
+    if (!file_)
+      return false;
+
+    last_step_ = 0;
+    bytes_ = 0;
+    buffer_.clear();
+    putRaw(&header, sizeof(header));
+    return true;
+  }
+
+  bool isOpen() const { return file_ != nullptr; }
+
+  /** Start a record of the given type before step */
+  void begin(JournalRecordType type, uint64_t step) {
+    putVarint(step - last_step_);
+    last_step_ = step;
+    buffer_.push_back(static_cast<unsigned char>(type));
+  }
+
+  void putRaw(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+
+    if (buffer_.size() >= (64 << 10))
+      flush();
+  }
+
+  template<typename Type>
+  void put(const Type& value) { putRaw(&value, sizeof(value)); }
+
+  void putVarint(uint64_t value) {
+    while (value >= 0x80) {
+      buffer_.push_back(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+
+    buffer_.push_back(static_cast<unsigned char>(value));
+  }
+
+  void flush() {
+    if (file_ && !buffer_.empty()) {
+      bytes_ += std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+      std::fflush(file_);
+    }
+
+    buffer_.clear();
+  }
+
+  /** Bytes written so far, including the buffered ones */
+  uint64_t bytes() const { return bytes_ + buffer_.size(); }
+
+  void close() {
+    if (!file_)
+      return;
+
+    flush();
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+};
+
+/** Reads a journal back record by record */
+class JournalReader {
+private:
+  std::vector<unsigned char> data_;
+  size_t offset_;
+  uint64_t step_;
+  JournalHeader header_;
+
+public:
+  JournalReader() : offset_(0), step_(0) { std::memset(&header_, 0, sizeof(header_)); }
+
+  /** Load the journal at path; false if it is missing or not a journal of this version */
+  bool open(const std::string& path) {
+    data_.clear();
+    offset_ = 0;
+    step_ = 0;
+
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+
+    if (!file)
+      return false;
+
+    unsigned char chunk[1 << 16];
+    size_t read;
+
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+      data_.insert(data_.end(), chunk, chunk + read);
+
+    std::fclose(file);
+
+    if (data_.size() < sizeof(header_))
+      return false;
+
+    std::memcpy(&header_, data_.data(), sizeof(header_));
+    offset_ = sizeof(header_);
+
+    return header_.magic == JournalHeader::MAGIC && header_.version == JournalHeader::VERSION;
+  }
+
+  const JournalHeader& header() const { return header_; }
+
+  /**
+   *  Move to the next record, giving its type and the step it comes before;
+   *  false at the end of the file (or of what was written of it).
+   */
+  bool next(JournalRecordType& type, uint64_t& step) {
+    uint64_t delta;
+
+    if (!getVarint(delta) || offset_ >= data_.size())
+      return false;
+
+    step_ += delta;
+    step = step_;
+    type = static_cast<JournalRecordType>(data_[offset_++]);
+    return true;
+  }
+
+  /** Read a payload value; false if the file ends first */
+  bool getRaw(void* data, size_t size) {
+    if (data_.size() - offset_ < size)
+      return false;
+
+    std::memcpy(data, &data_[offset_], size);
+    offset_ += size;
+    return true;
+  }
+
+  template<typename Type>
+  bool get(Type& value) { return getRaw(&value, sizeof(value)); }
+
+  bool getVarint(uint64_t& value) {
+    value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (offset_ >= data_.size())
+        return false;
+
+      const unsigned char byte = data_[offset_++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+      if (!(byte & 0x80))
+        return true;
+    }
+
+    return false;
+  }
+};
+
+/** What replaying a journal found */
+struct JournalReplay {
+  uint64_t steps;           // steps re-executed
+  uint64_t records;         // records applied, hashes included
+  uint64_t hashes;          // state hashes compared
+  uint64_t diverged_step;   // first step whose hash didn't match, 0 if none did
+  bool complete;            // the journal ended with JOURNAL_END (it wasn't cut off)
+  double simulated_seconds;
+};
+
+}
+
+#endif // FLATICS_JOURNAL_H
@@ -0,0 +1,376 @@
+#ifndef FLATICS_METRICS_H
+#define FLATICS_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace flatics {
+
+/**
+ *  What a Space measured about its last step, plus running totals.
+ *
+ *  The conserved quantities come out of the integration pass itself (see
+ *  Space::setMetrics()), so they describe the bodies as the step left them
+ *  and cost a few flops per body rather than another pass over the array.
+ *  They are summed in double whatever the simulation's precision.
+ */
+struct StepMetrics {
+  // upper bounds of the step duration histogram, in seconds
+  static const size_t BUCKETS = 10;
+
+  static double bucketBound(size_t bucket) {
+    static const double bounds[BUCKETS] = { 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5 };
+    return bounds[bucket];
+  }
+
+  // the last step
+  uint64_t step;          // steps taken so far, this one included
+  uint64_t bodies;        // stepped bodies
+  uint64_t parked;        // bodies parked out of the step
+  double kinetic_energy;
+  double momentum_x, momentum_y;
+  double max_speed;
+  uint64_t contacts;      // contacts resolved
+  uint64_t pairs;         // candidate pairs tested
+  double step_seconds;    // wall time of update()
+  uint64_t arena_bytes;   // scratch drawn from the Space's StepArena
+  uint64_t arena_high_water;       // most scratch any step has drawn
+  uint64_t arena_heap_allocations; // blocks the arena has taken from the heap; flat once steps settle
+
+  // since metrics were enabled
+  uint64_t contacts_total;
+  double step_seconds_total;
+  double simulated_seconds_total;
+  uint64_t step_buckets[BUCKETS]; // steps no longer than each bound, not cumulative
+
+  StepMetrics() { reset(); }
+
+  void reset() {
+    std::memset(this, 0, sizeof(*this));
+  }
+
+  /** Add the last step's duration and contacts to the totals */
+  void accumulate(double dt) {
+    contacts_total += contacts;
+    step_seconds_total += step_seconds;
+    simulated_seconds_total += dt;
+
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+      if (step_seconds <= bucketBound(bucket)) {
+        ++step_buckets[bucket];
+        break;
+      }
+    }
+  }
+};
+
+/** The metrics in the Prometheus text exposition format, names prefixed flatics_ */
+inline std::string prometheusText(const StepMetrics& metrics) {
+  std::ostringstream out;
+  out.precision(17);
+
+  auto metric = [&out](const char* name, const char* type, const char* help) {
+    out << "# HELP flatics_" << name << ' ' << help << "\n# TYPE flatics_" << name << ' ' << type << '\n';
+  };
+
+  metric("steps_total", "counter", "Steps taken.");
+  out << "flatics_steps_total " << metrics.step << '\n';
+  metric("bodies", "gauge", "Bodies stepped in the last step.");
+  out << "flatics_bodies " << metrics.bodies << '\n';
+  metric("parked_bodies", "gauge", "Bodies parked out of the step.");
+  out << "flatics_parked_bodies " << metrics.parked << '\n';
+  metric("kinetic_energy", "gauge", "Total kinetic energy after the last step.");
+  out << "flatics_kinetic_energy " << metrics.kinetic_energy << '\n';
+  metric("momentum", "gauge", "Total momentum after the last step, by axis.");
+  out << "flatics_momentum{axis=\"x\"} " << metrics.momentum_x << '\n'
+      << "flatics_momentum{axis=\"y\"} " << metrics.momentum_y << '\n';
+  metric("max_speed", "gauge", "Fastest body after the last step.");
+  out << "flatics_max_speed " << metrics.max_speed << '\n';
+  metric("contacts", "gauge", "Contacts resolved in the last step.");
+  out << "flatics_contacts " << metrics.contacts << '\n';
+  metric("contacts_total", "counter", "Contacts resolved.");
+  out << "flatics_contacts_total " << metrics.contacts_total << '\n';
+  metric("pairs", "gauge", "Candidate pairs tested in the last step.");
+  out << "flatics_pairs " << metrics.pairs << '\n';
+  metric("arena_bytes", "gauge", "Scratch memory used by the last step.");
+  out << "flatics_arena_bytes " << metrics.arena_bytes << '\n';
+  metric("arena_high_water_bytes", "gauge", "Most scratch memory used by any step.");
+  out << "flatics_arena_high_water_bytes " << metrics.arena_high_water << '\n';
+  metric("arena_heap_allocations_total", "counter", "Heap allocations made by the scratch arena.");
+  out << "flatics_arena_heap_allocations_total " << metrics.arena_heap_allocations << '\n';
+  metric("simulated_seconds_total", "counter", "Simulated time.");
+  out << "flatics_simulated_seconds_total " << metrics.simulated_seconds_total << '\n';
+  metric("step_seconds", "histogram", "Wall time of a step.");
+
+  uint64_t cumulative = 0;
+  for (size_t bucket = 0; bucket < StepMetrics::BUCKETS; ++bucket) {
+    cumulative += metrics.step_buckets[bucket];
+    out << "flatics_step_seconds_bucket{le=\"" << StepMetrics::bucketBound(bucket) << "\"} " << cumulative << '\n';
+  }
+
+  out << "flatics_step_seconds_bucket{le=\"+Inf\"} " << metrics.step << '\n'
+      << "flatics_step_seconds_sum " << metrics.step_seconds_total << '\n'
+      << "flatics_step_seconds_count " << metrics.step << '\n';
+
+  return out.str();
+}
+
+/**
+ *  Where a Space sends its metrics after every step. publish() runs on the
+ *  thread calling update(), inside it, so it has to be quick; the exporters
+ *  here only format text every so often and never wait on anyone.
+ */
+class MetricsExporter {
+public:
+  virtual ~MetricsExporter() {}
+
+  virtual void publish(const StepMetrics& metrics) = 0;
+};
+
+/**
+ *  Writes the metrics as a Prometheus text file, e.g. into node_exporter's
+ *  textfile collector directory, every interval steps. Each write goes to a
+ *  temporary file that is renamed over the old one, so a collector never
+ *  reads half a file.
+ */
+class PrometheusFileExporter : public MetricsExporter {
+private:
+  std::string path_;
+  uint64_t interval_;
+  uint64_t writes_;
+  bool failed_;
+
+public:
+  explicit PrometheusFileExporter(const std::string& path, uint64_t interval = 100)
+      : path_(path), interval_(interval > 0 ? interval : 1), writes_(0), failed_(false) {}
+
+  void publish(const StepMetrics& metrics) {
+    if (metrics.step % interval_ != 0)
+      return;
+
+    const std::string temporary = path_ + ".tmp";
+    {
+      std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+      file << prometheusText(metrics);
+
+      if (!file) {
+        failed_ = true;
+        return;
+      }
+    }
+
+    failed_ = std::rename(temporary.c_str(), path_.c_str()) != 0;
+    writes_ += !failed_;
+  }
+
+  /** Files written */
+  uint64_t writes() const { return writes_; }
+
+  /** Whether the last write failed */
+  bool failed() const { return failed_; }
+};
+
+/**
+ *  Serves the metrics over HTTP on a loopback TCP port, so a Prometheus on
+ *  the same machine (or tools/metrics_scraper) can scrape it directly.
+ *
+ *  There is no server thread: publish() accepts waiting connections and
+ *  answers those whose request has arrived, all without blocking, so a scrape
+ *  is served within a step or two. The text is only formatted when there is a
+ *  scrape to answer, so steps without one don't allocate. Every request gets
+ *  the metrics, whatever its path. Not available on Windows: open() fails
+ *  there.
+ */
+class SocketExporter : public MetricsExporter {
+private:
+  int listener_;
+  uint16_t port_;
+  uint64_t interval_;
+  uint64_t scrapes_;
+  std::string text_;
+  uint64_t text_step_; // step text_ was formatted at
+  // accepted connections whose request hasn't fully arrived yet
+  struct Pending {
+    int socket;
+    std::string request;
+    uint64_t since;
+  };
+
+  std::vector<Pending> pending_;
+
+  void closeListener() {
+#ifndef _WIN32
+    if (listener_ >= 0)
+      ::close(listener_);
+#endif
+    listener_ = -1;
+  }
+
+  /** Read what has arrived of a request; true once it is complete (or the client stopped sending) */
+  static bool readRequest(Pending& pending) {
+#ifndef _WIN32
+    char buffer[1024];
+
+    for (;;) {
+      ssize_t received = ::recv(pending.socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+      if (received == 0)
+        return true;
+
+      if (received < 0)
+        return false;
+
+      pending.request.append(buffer, static_cast<size_t>(received));
+
+      // only the end of the headers matters; a body, if any, is ignored
+      if (pending.request.find("\r\n\r\n") != std::string::npos || pending.request.size() > 8192)
+        return true;
+    }
+#else
+    (void)pending;
+    return true;
+#endif
+  }
+
+  /** Answer a connection with the current text and close it */
+  void answer(int connection) {
+#ifndef _WIN32
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << text_.size()
+             << "\r\nConnection: close\r\n\r\n" << text_;
+
+    const std::string bytes = response.str();
+    size_t sent = 0;
+
+    // the client is local and the response small, so it all fits in the
+    // socket buffer; give up rather than wait if it doesn't
+    while (sent < bytes.size()) {
+      ssize_t written = ::send(connection, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+
+      if (written <= 0)
+        break;
+
+      sent += static_cast<size_t>(written);
+    }
+
+    ::shutdown(connection, SHUT_WR);
+    ::close(connection);
+    ++scrapes_;
+#else
+    (void)connection;
+#endif
+  }
+
+public:
+  /** @param interval serve text up to this many steps old rather than format it again */
+  explicit SocketExporter(uint64_t interval = 1)
+      : listener_(-1), port_(0), interval_(interval > 0 ? interval : 1), scrapes_(0), text_step_(0) {}
+
+  ~SocketExporter() {
+    closeListener();
+
+#ifndef _WIN32
+    for (const Pending& pending : pending_)
+      ::close(pending.socket);
+#endif
+  }
+
+  SocketExporter(const SocketExporter&) = delete;
+  SocketExporter& operator=(const SocketExporter&) = delete;
+
+  /** Listen on 127.0.0.1:port (0 picks a free one, see port()); false if that fails */
+  bool open(uint16_t port) {
+    closeListener();
+#ifndef _WIN32
+    listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    if (listener_ < 0)
+      return false;
+
+    int reuse = 1;
+    ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+
+    if (::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener_, 16) != 0 ||
+        ::getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0 ||
+        ::fcntl(listener_, F_SETFL, ::fcntl(listener_, F_GETFL) | O_NONBLOCK) != 0) {
+      closeListener();
+      return false;
+    }
+
+    port_ = ntohs(address.sin_port);
+    return true;
+#else
+    (void)port;
+    return false;
+#endif
+  }
+
+  bool isOpen() const { return listener_ >= 0; }
+
+  /** The port listened on */
+  uint16_t port() const { return port_; }
+
+  /** Scrapes answered */
+  uint64_t scrapes() const { return scrapes_; }
+
+  void publish(const StepMetrics& metrics) {
+    if (listener_ < 0)
+      return;
+
+#ifndef _WIN32
+    for (;;) {
+      int connection = ::accept(listener_, nullptr, nullptr);
+
+      if (connection < 0)
+        break;
+
+      Pending pending = { connection, std::string(), metrics.step };
+      pending_.push_back(pending);
+    }
+
+    // answering before the request is read would make closing reset the
+    // connection, and the client could lose the response; clients that
+    // haven't sent a request within 100 steps get it anyway
+    size_t kept = 0;
+
+    for (size_t k = 0; k < pending_.size(); ++k) {
+      if (readRequest(pending_[k]) || metrics.step - pending_[k].since > 100) {
+        if (text_.empty() || metrics.step - text_step_ >= interval_) {
+          text_ = prometheusText(metrics);
+          text_step_ = metrics.step;
+        }
+
+        answer(pending_[k].socket);
+      } else
+        pending_[kept++] = pending_[k];
+    }
+
+    pending_.resize(kept);
+#endif
+  }
+};
+
+}
+
+#endif // FLATICS_METRICS_H
@@ -0,0 +1,101 @@
+#ifndef FLATICS_MORTONORDER_H
+#define FLATICS_MORTONORDER_H
+
+#include "Arena.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace flatics {
+
+/** A sort key and the index of the body it belongs to */
+struct MortonEntry {
+  uint32_t key;
+  uint32_t index;
+};
+
+/** Spread the low 16 bits of value out to the even bits */
+inline uint32_t spreadBits(uint32_t value) {
+  value &= 0x0000ffff;
+  value = (value | (value << 8)) & 0x00ff00ff;
+  value = (value | (value << 4)) & 0x0f0f0f0f;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+/** Z-order key of a cell on a 65536 x 65536 grid */
+inline uint32_t mortonKey(uint32_t cell_x, uint32_t cell_y) {
+  return spreadBits(cell_x) | (spreadBits(cell_y) << 1);
+}
+
+/** Z-order key of a point within [min_x, min_x + 1/scale_x] x [min_y, min_y + 1/scale_y], scaled to the 16 bit grid */
+template<typename Scalar>
+inline uint32_t mortonKey(Scalar x, Scalar y, Scalar min_x, Scalar min_y, Scalar scale_x, Scalar scale_y) {
+  Scalar cell_x = std::min(std::max((x - min_x) * scale_x, Scalar(0)), Scalar(65535));
+  Scalar cell_y = std::min(std::max((y - min_y) * scale_y, Scalar(0)), Scalar(65535));
+  return mortonKey(static_cast<uint32_t>(cell_x), static_cast<uint32_t>(cell_y));
+}
+
+/**
+ *  Stable LSD radix sort of entries by key, 8 bits per pass.
+ *
+ *  Each pass histograms and scatters contiguous chunks in parallel; a chunk's
+ *  output offsets come from the prefix sum over all chunks' histograms, so the
+ *  result is identical to the serial sort. Without a pool it runs serially.
+ *  The histograms come from arena, if given.
+ */
+template<class Allocator>
+void radixSort(std::vector<MortonEntry, Allocator>& entries, std::vector<MortonEntry, Allocator>& scratch, ThreadPool* pool = nullptr,
+               Arena* arena = nullptr) {
+  const size_t RADIX = 256;
+  const size_t count = entries.size();
+  const size_t chunks = pool && pool->size() > 1 && count >= 4096 ? pool->size() : 1;
+
+  scratch.resize(count);
+  ArenaVector<size_t> offsets(chunks * RADIX, 0, ArenaAllocator<size_t>(arena));
+
+  for (unsigned shift = 0; shift < 32; shift += 8) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+
+    auto histogram = [&](size_t begin, size_t end, size_t chunk) {
+      size_t* counts = &offsets[chunk * RADIX];
+      for (size_t i = begin; i < end; ++i)
+        ++counts[(entries[i].key >> shift) & (RADIX - 1)];
+    };
+
+    if (chunks > 1)
+      pool->parallelFor(count, histogram, chunks);
+    else
+      histogram(0, count, 0);
+
+    // exclusive prefix sum in digit-major, chunk-minor order keeps the sort stable
+    size_t total = 0;
+    for (size_t digit = 0; digit < RADIX; ++digit) {
+      for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        size_t n = offsets[chunk * RADIX + digit];
+        offsets[chunk * RADIX + digit] = total;
+        total += n;
+      }
+    }
+
+    auto scatter = [&](size_t begin, size_t end, size_t chunk) {
+      size_t* next = &offsets[chunk * RADIX];
+      for (size_t i = begin; i < end; ++i)
+        scratch[next[(entries[i].key >> shift) & (RADIX - 1)]++] = entries[i];
+    };
+
+    if (chunks > 1)
+      pool->parallelFor(count, scatter, chunks);
+    else
+      scatter(0, count, 0);
+
+    entries.swap(scratch);
+  }
+}
+
+}
+
+#endif // FLATICS_MORTONORDER_H
@@ -0,0 +1,219 @@
+#ifndef FLATICS_NEIGHBOURLIST_H
+#define FLATICS_NEIGHBOURLIST_H
+
+#include "Arena.h"
+#include "Circle.h"
+#include "SparseGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Verlet neighbour lists for short-range interactions.
+ *
+ *  Every body i lists the bodies j > i within max(cutoff, r_i + r_j) + skin of
+ *  it when the lists were built, so each pair appears once and both the
+ *  cutoff interaction and contacts are covered. As long as no body has moved
+ *  more than skin/2 since then, no pair can have come within range without
+ *  being listed, and the lists are reused as they are.
+ *
+ *  The lists are stored back to back (CSR): the neighbours of body i are
+ *  neighbours()[offsets()[i]] up to neighbours()[offsets()[i+1]].
+ *
+ *  Entries are indices into the object array, so the owner has to
+ *  invalidate() whenever those change meaning (reordering, clearing).
+ */
+template<typename Scalar, class Vec>
+class NeighbourList {
+public:
+  typedef Circle<Scalar, Vec> Object;
+
+private:
+  Scalar cutoff_;
+  Scalar skin_;
+
+  std::vector<size_t> offsets_;
+  std::vector<uint32_t> neighbours_;
+
+  // positions at the last build
+  std::vector<Vec> reference_;
+  bool valid_;
+  size_t builds_;
+
+  // cells of the bodies while building, hashed so far apart bodies don't
+  // blow up the grid
+  SparseGrid grid_;
+  std::vector<uint64_t> keys_;
+
+  // the 3x3 block of cells around every occupied cell, as cell numbers
+  // (grid_.cells() where empty), so lookups are per cell rather than per body
+  std::vector<uint32_t> around_;
+
+  bool needsRebuild(const Object* objects, size_t count) const {
+    if (!valid_ || count != reference_.size())
+      return true;
+
+    const Scalar limit = skin_ * skin_ / 4;
+
+    for (size_t i = 0; i < count; ++i) {
+      if ((objects[i].position() - reference_[i]).squared() > limit)
+        return true;
+    }
+
+    return false;
+  }
+
+  void build(const Object* objects, size_t count, ThreadPool* pool, StepArena* arena) {
+    ++builds_;
+    valid_ = true;
+    reference_.resize(count);
+    offsets_.assign(count + 1, 0);
+    neighbours_.clear();
+
+    if (count == 0)
+      return;
+
+    Scalar max_radius = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      reference_[i] = objects[i].position();
+      max_radius = std::max(max_radius, objects[i].radius());
+    }
+
+    // no pair further apart than one cell can be in range
+    const Scalar cell_size = std::max(cutoff_, 2 * max_radius) + skin_;
+    keys_.resize(count);
+
+    for (size_t i = 0; i < count; ++i)
+      keys_[i] = SparseGrid::key(SparseGrid::cellOf(reference_[i].x, cell_size), SparseGrid::cellOf(reference_[i].y, cell_size));
+
+    grid_.build(keys_.data(), count, arena ? &arena->main() : nullptr);
+
+    const size_t cells = grid_.cells();
+    around_.resize(9 * cells);
+
+    for (size_t cell = 0; cell < cells; ++cell) {
+      const uint64_t key = grid_.cellKey(cell);
+      uint32_t* around = &around_[9 * cell];
+
+      for (int64_t y = int64_t(SparseGrid::y(key)) - 1; y <= int64_t(SparseGrid::y(key)) + 1; ++y)
+      for (int64_t x = int64_t(SparseGrid::x(key)) - 1; x <= int64_t(SparseGrid::x(key)) + 1; ++x) {
+        const bool inside = x >= INT32_MIN && x <= INT32_MAX && y >= INT32_MIN && y <= INT32_MAX;
+        *around++ = static_cast<uint32_t>(inside ? grid_.find(SparseGrid::key(int32_t(x), int32_t(y))) : cells);
+      }
+    }
+
+    // two passes over the same neighbourhood, the first only counting, so
+    // every body's list can be written in place and in parallel
+    auto visit = [&](size_t i, bool fill) {
+      const Object& obj = objects[i];
+      const uint32_t* around = &around_[9 * grid_.cellOfItem(i)];
+      size_t found = 0;
+      uint32_t* out = fill ? neighbours_.data() + offsets_[i] : nullptr;
+
+      for (int n = 0; n < 9; ++n) {
+        const size_t cell = around[n];
+
+        if (cell == cells)
+          continue;
+
+        for (size_t k = grid_.begin(cell); k < grid_.end(cell); ++k) {
+          const uint32_t j = grid_.items()[k];
+
+          if (j <= i)
+            continue;
+
+          Scalar range = std::max(cutoff_, obj.radius() + objects[j].radius()) + skin_;
+
+          if ((objects[j].position() - obj.position()).squared() <= range * range) {
+            if (fill)
+              out[found] = j;
+            ++found;
+          }
+        }
+      }
+
+      return found;
+    };
+
+    auto count_range = [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i)
+        offsets_[i + 1] = visit(i, false);
+    };
+
+    auto fill_range = [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        visit(i, true);
+
+        // ascending neighbours stream through memory in order
+        std::sort(neighbours_.data() + offsets_[i], neighbours_.data() + offsets_[i + 1]);
+      }
+    };
+
+    if (pool)
+      pool->parallelFor(count, count_range);
+    else
+      count_range(0, count, 0);
+
+    for (size_t i = 0; i < count; ++i)
+      offsets_[i + 1] += offsets_[i];
+
+    // resizing up from empty would allocate exactly, and again on every
+    // build with a few more pairs; leave room for the lists to grow into
+    if (offsets_[count] > neighbours_.capacity())
+      neighbours_.reserve(offsets_[count] + offsets_[count] / 4);
+
+    neighbours_.resize(offsets_[count]);
+
+    if (pool)
+      pool->parallelFor(count, fill_range);
+    else
+      fill_range(0, count, 0);
+  }
+
+public:
+  /**
+   *  @param cutoff range of the short-range interaction
+   *  @param skin extra margin listed beyond it; larger means fewer rebuilds but longer lists
+   */
+  explicit NeighbourList(Scalar cutoff, Scalar skin = 0)
+      : cutoff_(cutoff), skin_(skin > 0 ? skin : cutoff / 5), valid_(false), builds_(0) {}
+
+  Scalar cutoff() const { return cutoff_; }
+
+  Scalar skin() const { return skin_; }
+
+  /**
+   *  Rebuild the lists if any body has moved more than skin/2 since the last
+   *  build; returns whether it did. Temporaries come from arena, if given.
+   */
+  bool update(const Object* objects, size_t count, ThreadPool* pool = nullptr, StepArena* arena = nullptr) {
+    if (!needsRebuild(objects, count))
+      return false;
+
+    build(objects, count, pool, arena);
+    return true;
+  }
+
+  /** Force a rebuild on the next update() */
+  void invalidate() { valid_ = false; }
+
+  /** Number of times the lists have been built */
+  size_t builds() const { return builds_; }
+
+  /** Listed pairs */
+  size_t size() const { return neighbours_.size(); }
+
+  const std::vector<size_t>& offsets() const { return offsets_; }
+
+  const std::vector<uint32_t>& neighbours() const { return neighbours_; }
+};
+
+}
+
+#endif // FLATICS_NEIGHBOURLIST_H
@@ -0,0 +1,434 @@
+#ifndef FLATICS_PARTICLEMESH_H
+#define FLATICS_PARTICLEMESH_H
+
+#include "Arena.h"
+#include "Circle.h"
+#include "ThreadPool.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace flatics {
+
+/** In-place radix-2 complex FFT of one fixed power-of-two length */
+template<typename Scalar>
+class Fft {
+private:
+  typedef std::complex<Scalar> Complex;
+
+  size_t n_;
+  std::vector<size_t> reversed_;
+  std::vector<Complex> twiddles_;
+
+public:
+  explicit Fft(size_t n = 1) { resize(n); }
+
+  void resize(size_t n) {
+    n_ = n;
+    reversed_.resize(n);
+    twiddles_.resize(n / 2);
+
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n)
+      ++bits;
+
+    for (size_t i = 0; i < n; ++i) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; ++b)
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      reversed_[i] = r;
+    }
+
+    const double two_pi = 6.283185307179586476925286766559;
+    for (size_t k = 0; k < n / 2; ++k)
+      twiddles_[k] = Complex(static_cast<Scalar>(std::cos(two_pi * k / n)), static_cast<Scalar>(-std::sin(two_pi * k / n)));
+  }
+
+  size_t size() const { return n_; }
+
+  /** Forward transform, or the unscaled inverse */
+  void transform(Complex* data, bool inverse) const {
+    for (size_t i = 0; i < n_; ++i) {
+      if (i < reversed_[i])
+        std::swap(data[i], data[reversed_[i]]);
+    }
+
+    for (size_t length = 2; length <= n_; length <<= 1) {
+      size_t half = length / 2;
+      size_t step = n_ / length;
+
+      for (size_t start = 0; start < n_; start += length) {
+        for (size_t k = 0; k < half; ++k) {
+          Complex w = inverse ? std::conj(twiddles_[k * step]) : twiddles_[k * step];
+          Complex u = data[start + k];
+          Complex v = data[start + k + half] * w;
+          data[start + k] = u + v;
+          data[start + k + half] = u - v;
+        }
+      }
+    }
+  }
+};
+
+/**
+ *  Particle-mesh gravity for periodic (WRAP) worlds.
+ *
+ *  Masses are deposited onto a grid covering the width x height torus with
+ *  cloud-in-cell or triangular-shaped-cloud weights, convolved by FFT with the
+ *  same G*m/r^2 law Space::applyGravity() uses (taken over the minimum image
+ *  displacement), and the resulting accelerations are interpolated back onto
+ *  the bodies with the same weights, which also cancels every body's pull on
+ *  itself. Cost is O(n + G log G) for a grid of G cells.
+ *
+ *  With a split radius the mesh only carries the part of the force beyond it,
+ *  and pairs closer than the split radius get the rest directly (P3M), which
+ *  restores the short-range accuracy the grid smooths away.
+ */
+template<typename Scalar, class Vec>
+class ParticleMesh {
+public:
+  typedef Circle<Scalar, Vec> Object;
+
+  enum Assignment {
+    CIC, // cloud in cell: 2x2 nodes, linear weights
+    TSC, // triangular shaped cloud: 3x3 nodes, quadratic weights
+  };
+
+private:
+  typedef std::complex<Scalar> Complex;
+
+  size_t grid_x_, grid_y_;
+  Assignment assignment_;
+  Scalar split_radius_;
+
+  // the world size the kernel was computed for
+  Scalar width_, height_;
+
+  Fft<Scalar> fft_x_, fft_y_;
+  std::vector<Complex> kernel_;  // see computeKernel()
+  std::vector<Complex> grid_;
+  std::vector<std::vector<Scalar> > partial_mass_;
+
+  // short-range cell list
+  std::vector<size_t> cell_start_;
+  std::vector<size_t> cell_items_;
+  std::vector<size_t> cell_of_;
+
+  /** Fraction of the force handled by the direct short-range sum at distance r */
+  Scalar shortRangeWeight(Scalar r) const {
+    if (split_radius_ <= 0 || r >= split_radius_)
+      return 0;
+
+    Scalar q = r / split_radius_;
+    return (1 - q*q) * (1 - q*q);
+  }
+
+  static Scalar minimumImage(Scalar d, Scalar period) {
+    if (d > period / 2)
+      return d - period;
+    if (d < -period / 2)
+      return d + period;
+    return d;
+  }
+
+  /** Row-wise then column-wise 2D transform of data */
+  void transform2d(std::vector<Complex>& data, bool inverse, ThreadPool* pool, StepArena* arena = nullptr) {
+    auto rows = [&](size_t begin, size_t end, size_t) {
+      for (size_t row = begin; row < end; ++row)
+        fft_x_.transform(&data[row * grid_x_], inverse);
+    };
+
+    auto columns = [&](size_t begin, size_t end, size_t chunk) {
+      ArenaVector<Complex> column(grid_y_, Complex(), ArenaAllocator<Complex>(arena ? &arena->worker(chunk) : nullptr));
+
+      for (size_t x = begin; x < end; ++x) {
+        for (size_t y = 0; y < grid_y_; ++y)
+          column[y] = data[y * grid_x_ + x];
+
+        fft_y_.transform(&column[0], inverse);
+
+        for (size_t y = 0; y < grid_y_; ++y)
+          data[y * grid_x_ + x] = column[y];
+      }
+    };
+
+    if (pool) {
+      pool->parallelFor(grid_y_, rows);
+      pool->parallelFor(grid_x_, columns);
+    } else {
+      rows(0, grid_y_, 0);
+      columns(0, grid_x_, 0);
+    }
+  }
+
+  /** Transform the long-range acceleration kernel for the current world size */
+  void computeKernel(Scalar width, Scalar height, ThreadPool* pool) {
+    width_ = width;
+    height_ = height;
+
+    const Scalar hx = width / grid_x_;
+    const Scalar hy = height / grid_y_;
+
+    std::vector<Complex> kernel_x(grid_x_ * grid_y_), kernel_y(grid_x_ * grid_y_);
+
+    // acceleration at offset d from a unit mass: -G d/|d|^3, minus the part
+    // the short-range sum takes care of
+    for (size_t j = 0; j < grid_y_; ++j)
+    for (size_t i = 0; i < grid_x_; ++i) {
+      Scalar dx = minimumImage(i * hx, width);
+      Scalar dy = minimumImage(j * hy, height);
+      Scalar r2 = dx*dx + dy*dy;
+
+      if (r2 == 0)
+        continue;
+
+      Scalar r = std::sqrt(r2);
+      Scalar magnitude = -gravitationalConstant<Scalar>() / (r2 * r) * (1 - shortRangeWeight(r));
+
+      // half a period away the pull is equal both ways; leaving it out keeps
+      // the kernel odd, so the mesh forces sum to zero and momentum is kept
+      kernel_x[j * grid_x_ + i] = Complex(2*i == grid_x_ ? 0 : magnitude * dx, 0);
+      kernel_y[j * grid_x_ + i] = Complex(2*j == grid_y_ ? 0 : magnitude * dy, 0);
+    }
+
+    transform2d(kernel_x, false, pool);
+    transform2d(kernel_y, false, pool);
+
+    // both accelerations are real, so they come back together from a single
+    // inverse transform of X + iY
+    kernel_.resize(kernel_x.size());
+    const Complex i(0, 1);
+    for (size_t k = 0; k < kernel_.size(); ++k)
+      kernel_[k] = kernel_x[k] + i * kernel_y[k];
+  }
+
+  /** Grid nodes and weights of one body's cloud along one axis */
+  int weights(Scalar u, size_t grid, size_t nodes[3], Scalar w[3]) const {
+    if (assignment_ == CIC) {
+      Scalar base = std::floor(u);
+      Scalar f = u - base;
+      long i = static_cast<long>(base);
+      nodes[0] = wrap(i, grid);
+      nodes[1] = wrap(i + 1, grid);
+      w[0] = 1 - f;
+      w[1] = f;
+      return 2;
+    }
+
+    Scalar nearest = std::floor(u + Scalar(0.5));
+    Scalar d = u - nearest;
+    long i = static_cast<long>(nearest);
+    nodes[0] = wrap(i - 1, grid);
+    nodes[1] = wrap(i, grid);
+    nodes[2] = wrap(i + 1, grid);
+    w[0] = Scalar(0.5) * (Scalar(0.5) - d) * (Scalar(0.5) - d);
+    w[1] = Scalar(0.75) - d*d;
+    w[2] = Scalar(0.5) * (Scalar(0.5) + d) * (Scalar(0.5) + d);
+    return 3;
+  }
+
+  static size_t wrap(long i, size_t grid) {
+    long n = static_cast<long>(grid);
+    return static_cast<size_t>(((i % n) + n) % n);
+  }
+
+  void deposit(const Object* objects, size_t count, ThreadPool* pool) {
+    const size_t cells = grid_x_ * grid_y_;
+    const Scalar to_x = grid_x_ / width_;
+    const Scalar to_y = grid_y_ / height_;
+    const size_t chunks = pool ? std::max<size_t>(1, pool->size()) : 1;
+
+    partial_mass_.resize(chunks);
+
+    auto spread = [&](size_t begin, size_t end, size_t chunk) {
+      std::vector<Scalar>& mass = partial_mass_[chunk];
+      mass.assign(cells, 0);
+
+      size_t nx[3], ny[3];
+      Scalar wx[3], wy[3];
+
+      for (size_t b = begin; b < end; ++b) {
+        int kx = weights(objects[b].position().x * to_x, grid_x_, nx, wx);
+        int ky = weights(objects[b].position().y * to_y, grid_y_, ny, wy);
+
+        for (int j = 0; j < ky; ++j)
+        for (int i = 0; i < kx; ++i)
+          mass[ny[j] * grid_x_ + nx[i]] += objects[b].mass() * wx[i] * wy[j];
+      }
+    };
+
+    if (pool)
+      pool->parallelFor(count, spread, chunks);
+    else
+      spread(0, count, 0);
+
+    grid_.resize(cells);
+
+    auto reduce = [&](size_t begin, size_t end, size_t) {
+      for (size_t c = begin; c < end; ++c) {
+        Scalar total = 0;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+          total += partial_mass_[chunk].empty() ? 0 : partial_mass_[chunk][c];
+        grid_[c] = Complex(total, 0);
+      }
+    };
+
+    if (pool)
+      pool->parallelFor(cells, reduce);
+    else
+      reduce(0, cells, 0);
+
+    // chunks that got no bodies must not leak into the next step
+    for (std::vector<Scalar>& mass : partial_mass_)
+      mass.clear();
+  }
+
+  void interpolate(Object* objects, size_t count, ThreadPool* pool) {
+    const Scalar to_x = grid_x_ / width_;
+    const Scalar to_y = grid_y_ / height_;
+    const Scalar scale = Scalar(1) / (grid_x_ * grid_y_);
+
+    auto gather = [&](size_t begin, size_t end, size_t) {
+      size_t nx[3], ny[3];
+      Scalar wx[3], wy[3];
+
+      for (size_t b = begin; b < end; ++b) {
+        int kx = weights(objects[b].position().x * to_x, grid_x_, nx, wx);
+        int ky = weights(objects[b].position().y * to_y, grid_y_, ny, wy);
+
+        Complex acceleration;
+        for (int j = 0; j < ky; ++j)
+        for (int i = 0; i < kx; ++i)
+          acceleration += grid_[ny[j] * grid_x_ + nx[i]] * (wx[i] * wy[j]);
+
+        acceleration *= scale * objects[b].mass();
+        objects[b].addExternalForce(Vec(acceleration.real(), acceleration.imag()));
+      }
+    };
+
+    if (pool)
+      pool->parallelFor(count, gather);
+    else
+      gather(0, count, 0);
+  }
+
+  /** The direct part of P3M: tapered pairwise gravity within the split radius, over the torus */
+  void shortRange(Object* objects, size_t count, Arena* scratch) {
+    const size_t cells_x = std::max<size_t>(1, static_cast<size_t>(width_ / split_radius_));
+    const size_t cells_y = std::max<size_t>(1, static_cast<size_t>(height_ / split_radius_));
+    const Scalar to_x = cells_x / width_;
+    const Scalar to_y = cells_y / height_;
+
+    // bucket the bodies by cell with a counting sort
+    cell_start_.assign(cells_x * cells_y + 1, 0);
+    cell_of_.resize(count);
+    cell_items_.resize(count);
+
+    for (size_t b = 0; b < count; ++b) {
+      size_t cx = wrap(static_cast<long>(std::floor(objects[b].position().x * to_x)), cells_x);
+      size_t cy = wrap(static_cast<long>(std::floor(objects[b].position().y * to_y)), cells_y);
+      cell_of_[b] = cy * cells_x + cx;
+      ++cell_start_[cell_of_[b] + 1];
+    }
+
+    for (size_t c = 1; c < cell_start_.size(); ++c)
+      cell_start_[c] += cell_start_[c - 1];
+
+    ArenaVector<size_t> next(cell_start_.begin(), cell_start_.end() - 1, ArenaAllocator<size_t>(scratch));
+    for (size_t b = 0; b < count; ++b)
+      cell_items_[next[cell_of_[b]]++] = b;
+
+    // each body against the bodies after it in its own cell and the 3x3
+    // neighbourhood (each neighbouring cell visited once even on tiny grids)
+    for (size_t cy = 0; cy < cells_y; ++cy)
+    for (size_t cx = 0; cx < cells_x; ++cx) {
+      size_t cell = cy * cells_x + cx;
+      size_t neighbours[9];
+      size_t neighbour_count = 0;
+
+      for (long dy = -1; dy <= 1; ++dy)
+      for (long dx = -1; dx <= 1; ++dx) {
+        size_t n = wrap(static_cast<long>(cy) + dy, cells_y) * cells_x + wrap(static_cast<long>(cx) + dx, cells_x);
+
+        // only visit neighbours with a higher index, and each only once
+        if (n > cell && std::find(neighbours, neighbours + neighbour_count, n) == neighbours + neighbour_count)
+          neighbours[neighbour_count++] = n;
+      }
+
+      for (size_t a = cell_start_[cell]; a < cell_start_[cell + 1]; ++a) {
+        Object& obj1 = objects[cell_items_[a]];
+
+        for (size_t b = a + 1; b < cell_start_[cell + 1]; ++b)
+          shortRangePair(obj1, objects[cell_items_[b]]);
+
+        for (size_t k = 0; k < neighbour_count; ++k)
+        for (size_t b = cell_start_[neighbours[k]]; b < cell_start_[neighbours[k] + 1]; ++b)
+          shortRangePair(obj1, objects[cell_items_[b]]);
+      }
+    }
+  }
+
+  void shortRangePair(Object& obj1, Object& obj2) {
+    Scalar dx = minimumImage(obj2.position().x - obj1.position().x, width_);
+    Scalar dy = minimumImage(obj2.position().y - obj1.position().y, height_);
+    Scalar r2 = dx*dx + dy*dy;
+
+    if (r2 == 0 || r2 >= split_radius_ * split_radius_)
+      return;
+
+    Scalar r = std::sqrt(r2);
+    Scalar magnitude = gravitationalConstant<Scalar>() * obj1.mass() * obj2.mass() / (r2 * r) * shortRangeWeight(r);
+    Vec force(magnitude * dx, magnitude * dy);
+
+    obj1.addExternalForce(force);
+    obj2.addExternalForce(-force);
+  }
+
+public:
+  /**
+   *  @param gridX, gridY number of grid cells along each axis, powers of two
+   *  @param splitRadius 0 for pure PM, otherwise the P3M split between mesh and direct forces (a few cells wide)
+   */
+  ParticleMesh(size_t gridX = 128, size_t gridY = 128, Assignment assignment = CIC, Scalar splitRadius = 0)
+      : grid_x_(gridX), grid_y_(gridY), assignment_(assignment), split_radius_(splitRadius),
+        width_(0), height_(0), fft_x_(gridX), fft_y_(gridY) {}
+
+  /** Whether the FFT can take n cells along an axis: a power of two, at least 2 */
+  static bool validGridSize(size_t n) { return n >= 2 && (n & (n - 1)) == 0; }
+
+  size_t gridX() const { return grid_x_; }
+  size_t gridY() const { return grid_y_; }
+  Assignment assignment() const { return assignment_; }
+  Scalar splitRadius() const { return split_radius_; }
+
+  /**
+   *  Add the gravitational force of every body on every other to their
+   *  external forces. The step's temporaries come from arena, if given.
+   */
+  void apply(Object* objects, size_t count, Scalar width, Scalar height, ThreadPool* pool = nullptr, StepArena* arena = nullptr) {
+    if (count == 0)
+      return;
+
+    if (width != width_ || height != height_)
+      computeKernel(width, height, pool);
+
+    deposit(objects, count, pool);
+    transform2d(grid_, false, pool, arena);
+
+    for (size_t k = 0; k < grid_.size(); ++k)
+      grid_[k] *= kernel_[k];
+
+    transform2d(grid_, true, pool, arena);
+    interpolate(objects, count, pool);
+
+    if (split_radius_ > 0)
+      shortRange(objects, count, arena ? &arena->main() : nullptr);
+  }
+};
+
+}
+
+#endif // FLATICS_PARTICLEMESH_H
@@ -1,12 +1,18 @@
 #ifndef FLATICS_POINTMASS_H
 #define FLATICS_POINTMASS_H
 
+#include "Summation.h"
+
+#include <type_traits>
+
 namespace flatics {
 
 template <typename Scalar, class Vec>
 class PointMass {
 private:
-  Vec net_external_force_;
+  // summed in double when the simulation runs in single precision, where a
+  // heavy body's pull would otherwise swamp everything else acting on a light one
+  typename std::conditional<WidenForces<Scalar>::value, WideSum<Vec>, PlainSum<Vec> >::type net_external_force_;
 
 protected:
   Scalar mass_;
@@ -42,18 +48,18 @@ public:
   /** Update the position and velocity of the point mass while applying a constant acceleration */
   void update(Scalar dt, const Vec& acceleration) {
     position_ += velocity_ * dt;
-    velocity_ += (net_external_force_ / mass_ + acceleration) * dt;
+    velocity_ += (net_external_force_.value() / mass_ + acceleration) * dt;
     net_external_force_.clear();
   }
 
   /** Update the position and velocity of the point mass */
   void update(Scalar dt) {
     position_ += velocity_ * dt;
-    velocity_ += net_external_force_ / mass_ * dt;
+    velocity_ += net_external_force_.value() / mass_ * dt;
     net_external_force_.clear();
   }
 
-  Scalar mass() const { return mass_; }
+  const Scalar& mass() const { return mass_; }
 
   const Vec& velocity() const { return velocity_; }
 
@@ -112,7 +118,7 @@ public:
 
   /** Sum up external forces. */
   void addExternalForce(const Vec& force) {
-    net_external_force_ += force;
+    net_external_force_.add(force);
   }
 };
 
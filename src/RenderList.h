@@ -0,0 +1,288 @@
+#ifndef FLATICS_RENDERLIST_H
+#define FLATICS_RENDERLIST_H
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace flatics {
+
+struct RenderColor {
+  uint8_t r, g, b, a;
+};
+
+/** The default vertex: a screen position in pixels and a color */
+struct RenderVertex {
+  float x, y;
+  RenderColor color;
+};
+
+/** How to make a Vertex; specialize it to build straight into a renderer's own vertex type */
+template<class Vertex>
+struct RenderVertexTraits;
+
+template<>
+struct RenderVertexTraits<RenderVertex> {
+  static RenderVertex make(float x, float y, const RenderColor& color) {
+    RenderVertex vertex = { x, y, color };
+    return vertex;
+  }
+};
+
+/** What part of the world is on screen: the world point at the top left corner and pixels per world unit */
+struct RenderCamera {
+  double left, top;
+  double scale;
+  size_t width, height;
+};
+
+/** The bodies of one state snapshot, structure of arrays, copied out of a simulation */
+template<typename Scalar>
+struct RenderSnapshot {
+  std::vector<Scalar> x, y, radius;
+  std::vector<Scalar> vx, vy, mass;
+  std::vector<uint64_t> id;
+  size_t count;
+  double origin_x, origin_y;
+
+  RenderSnapshot() : count(0), origin_x(0), origin_y(0) {}
+
+  /** Copy the bodies (anything with position(), velocity(), radius() and mass()) and their ids */
+  template<class Objects, class Ids>
+  void capture(const Objects& objects, const Ids& ids, double originX = 0, double originY = 0) {
+    count = std::min<size_t>(objects.size(), ids.size());
+    x.resize(count);
+    y.resize(count);
+    radius.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    mass.resize(count);
+    id.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+      x[i] = objects[i].position().x;
+      y[i] = objects[i].position().y;
+      radius[i] = objects[i].radius();
+      vx[i] = objects[i].velocity().x;
+      vy[i] = objects[i].velocity().y;
+      mass[i] = objects[i].mass();
+      id[i] = ids[i];
+    }
+
+    origin_x = originX;
+    origin_y = originY;
+  }
+};
+
+/**
+ *  Turns a state snapshot into one packed triangle list for the frame.
+ *
+ *  Bodies entirely off screen are culled. The rest are drawn as triangle fans
+ *  (unrolled into the list) with just enough segments that the outline is
+ *  within half a pixel of a circle, and bodies smaller than a pixel become a
+ *  one pixel square, which is what a point would cover. Everything is one
+ *  primitive type, so the whole frame is a single draw call.
+ *
+ *  The snapshot can be anything with x, y, radius and id arrays (pointers or
+ *  vectors), a count and origin_x/origin_y: a RenderSnapshot, or the view of a
+ *  SharedStateReader in another process. Colors come from the palette by id.
+ *
+ *  Building is two passes over chunks of the bodies, in parallel when given a
+ *  pool: the first culls and picks each body's level of detail, the second
+ *  writes every chunk's vertices at offsets from a prefix sum of the first, so
+ *  the list comes out in body order whatever the scheduling. Nothing here
+ *  depends on a window or a graphics library.
+ */
+template<class Vertex = RenderVertex>
+class RenderList {
+private:
+  // segments of the fan at each level of detail; level 0 is the sub-pixel square
+  static const unsigned LEVELS = 9;
+
+  static double pi() { return 3.14159265358979323846; }
+
+  static unsigned segments(unsigned level) {
+    static const unsigned SEGMENTS[LEVELS] = { 2, 6, 8, 12, 16, 24, 32, 48, 64 };
+    return SEGMENTS[level];
+  }
+
+  static size_t verticesOf(unsigned level) { return 3 * size_t(segments(level)); }
+
+  std::vector<RenderColor> palette_;
+  std::vector<float> cos_[LEVELS], sin_[LEVELS];
+
+  std::vector<Vertex> vertices_;
+  std::vector<uint8_t> level_; // per body, LEVELS when culled
+  std::vector<size_t> chunk_offset_;
+  size_t drawn_;
+  size_t culled_;
+  size_t points_;
+
+  /** Level of detail of a disc of radius pixels: its chord error has to stay under half a pixel */
+  static unsigned levelOf(double radius) {
+    if (radius < 0.5)
+      return 0;
+
+    // a fan of n segments is off by r (1 - cos(pi / n)) ~ r pi^2 / 2n^2
+    const double needed = pi() * std::sqrt(radius);
+
+    for (unsigned level = 1; level < LEVELS; ++level) {
+      if (segments(level) >= needed)
+        return level;
+    }
+
+    return LEVELS - 1;
+  }
+
+public:
+  RenderList() : drawn_(0), culled_(0), points_(0) {
+    static const RenderColor COLORS[] = {
+      { 0, 255, 0, 255 },
+      { 255, 255, 255, 255 },
+      { 255, 0, 0, 255 },
+      { 0, 0, 255, 255 },
+      { 255, 255, 0, 255 },
+      { 255, 0, 255, 255 },
+      { 0, 255, 255, 255 },
+    };
+
+    palette_.assign(COLORS, COLORS + sizeof(COLORS) / sizeof(COLORS[0]));
+
+    for (unsigned level = 1; level < LEVELS; ++level) {
+      const unsigned n = segments(level);
+
+      for (unsigned k = 0; k <= n; ++k) {
+        cos_[level].push_back(static_cast<float>(std::cos(2 * pi() * k / n)));
+        sin_[level].push_back(static_cast<float>(std::sin(2 * pi() * k / n)));
+      }
+    }
+  }
+
+  /** Colors to cycle through by body id */
+  void setPalette(const std::vector<RenderColor>& palette) {
+    if (!palette.empty())
+      palette_ = palette;
+  }
+
+  /** Rebuild the list for snapshot as seen through camera */
+  template<class Snapshot>
+  void build(const Snapshot& snapshot, const RenderCamera& camera, ThreadPool* pool = nullptr) {
+    const size_t count = snapshot.count;
+    const size_t chunks = pool && count > 4096 ? std::max<size_t>(1, pool->size()) : 1;
+
+    level_.resize(count);
+    chunk_offset_.assign(chunks + 1, 0);
+
+    // world to screen, with the snapshot's origin folded in
+    const double shift_x = snapshot.origin_x - camera.left;
+    const double shift_y = snapshot.origin_y - camera.top;
+    const double scale = camera.scale;
+    const double width = static_cast<double>(camera.width);
+    const double height = static_cast<double>(camera.height);
+
+    auto classify = [&](size_t begin, size_t end, size_t chunk) {
+      size_t vertices = 0;
+
+      for (size_t i = begin; i < end; ++i) {
+        const double x = (snapshot.x[i] + shift_x) * scale;
+        const double y = (snapshot.y[i] + shift_y) * scale;
+        const double r = snapshot.radius[i] * scale;
+
+        if (x + r < 0 || x - r > width || y + r < 0 || y - r > height) {
+          level_[i] = LEVELS;
+          continue;
+        }
+
+        const unsigned level = levelOf(r);
+        level_[i] = static_cast<uint8_t>(level);
+        vertices += verticesOf(level);
+      }
+
+      chunk_offset_[chunk + 1] = vertices;
+    };
+
+    auto emit = [&](size_t begin, size_t end, size_t chunk) {
+      Vertex* out = vertices_.data() + chunk_offset_[chunk];
+
+      for (size_t i = begin; i < end; ++i) {
+        const unsigned level = level_[i];
+
+        if (level == LEVELS)
+          continue;
+
+        const float x = static_cast<float>((snapshot.x[i] + shift_x) * scale);
+        const float y = static_cast<float>((snapshot.y[i] + shift_y) * scale);
+        const RenderColor& color = palette_[snapshot.id[i] % palette_.size()];
+
+        if (level == 0) {
+          // the pixel the centre falls in, as two triangles
+          const float x0 = std::floor(x), y0 = std::floor(y);
+          const float x1 = x0 + 1, y1 = y0 + 1;
+
+          *out++ = RenderVertexTraits<Vertex>::make(x0, y0, color);
+          *out++ = RenderVertexTraits<Vertex>::make(x1, y0, color);
+          *out++ = RenderVertexTraits<Vertex>::make(x1, y1, color);
+          *out++ = RenderVertexTraits<Vertex>::make(x0, y0, color);
+          *out++ = RenderVertexTraits<Vertex>::make(x1, y1, color);
+          *out++ = RenderVertexTraits<Vertex>::make(x0, y1, color);
+          continue;
+        }
+
+        const float r = static_cast<float>(snapshot.radius[i] * scale);
+        const std::vector<float>& cos = cos_[level];
+        const std::vector<float>& sin = sin_[level];
+        const Vertex centre = RenderVertexTraits<Vertex>::make(x, y, color);
+
+        for (unsigned k = 0; k < segments(level); ++k) {
+          *out++ = centre;
+          *out++ = RenderVertexTraits<Vertex>::make(x + r * cos[k], y + r * sin[k], color);
+          *out++ = RenderVertexTraits<Vertex>::make(x + r * cos[k + 1], y + r * sin[k + 1], color);
+        }
+      }
+    };
+
+    if (chunks > 1)
+      pool->parallelFor(count, classify, chunks);
+    else
+      classify(0, count, 0);
+
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+      chunk_offset_[chunk + 1] += chunk_offset_[chunk];
+
+    vertices_.resize(chunk_offset_[chunks]);
+
+    if (chunks > 1)
+      pool->parallelFor(count, emit, chunks);
+    else
+      emit(0, count, 0);
+
+    drawn_ = 0;
+    points_ = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      drawn_ += level_[i] < LEVELS;
+      points_ += level_[i] == 0;
+    }
+
+    culled_ = count - drawn_;
+  }
+
+  /** The frame's triangles, three vertices each */
+  const std::vector<Vertex>& vertices() const { return vertices_; }
+
+  /** Bodies in the list and bodies culled by the last build() */
+  size_t drawn() const { return drawn_; }
+
+  size_t culled() const { return culled_; }
+
+  /** Bodies drawn as sub-pixel squares by the last build() */
+  size_t points() const { return points_; }
+};
+
+}
+
+#endif // FLATICS_RENDERLIST_H
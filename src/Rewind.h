@@ -0,0 +1,404 @@
+#ifndef FLATICS_REWIND_H
+#define FLATICS_REWIND_H
+
+#include "Circle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  A bounded history of recent simulation states, kept compact.
+ *
+ *  The history is a run of segments, each a keyframe (every body exactly)
+ *  followed by one record per step: the dt and global gravity of that step and
+ *  how far every body moved, quantized to 16 bits. Quantization is closed loop,
+ *  against what decoding will reconstruct rather than the last exact state, so
+ *  the error doesn't build up along a segment. The scale of a step comes from
+ *  how far the bodies moved the step before, so capturing is a single pass,
+ *  and a body that jumps further than that allows (wrapping around the world,
+ *  say) is stored exactly instead of coarsening everyone else. A new segment starts every keyframe interval, and
+ *  whenever requestKeyframe() says the bodies changed outside a step. The
+ *  oldest segments are dropped to stay within the memory cap.
+ *
+ *  Bodies parked in the far field are kept exactly in every keyframe; parking
+ *  or bringing one back changes the active bodies, so they stay the same over
+ *  a segment.
+ *
+ *  decode() rebuilds any kept step approximately, cheap enough for scrubbing.
+ *  Restoring a simulation exactly goes from a keyframe and steps forward again
+ *  with the recorded dt and gravity, which is Space::rewind().
+ */
+template<typename Scalar, class Vec>
+class RewindBuffer {
+public:
+  typedef Circle<Scalar, Vec> Object;
+
+  /** Every body of one step, structure of arrays, and the parked ones as of its keyframe */
+  struct State {
+    uint64_t step;
+    std::vector<Scalar> x, y, vx, vy, radius, mass;
+    std::vector<size_t> ids;
+    std::vector<Object> parked;
+    std::vector<size_t> parked_ids;
+    double origin_x, origin_y;
+    Vec gravity;
+
+    State() : step(0), origin_x(0), origin_y(0) {}
+
+    /** Active bodies */
+    size_t size() const { return x.size(); }
+
+    size_t bytes() const {
+      return size() * (6 * sizeof(Scalar) + sizeof(size_t)) + parked.size() * (sizeof(Object) + sizeof(size_t));
+    }
+  };
+
+private:
+  /** A body stored exactly because it moved too far for the step's scale */
+  struct Escape {
+    uint32_t index;
+    Scalar x, y, vx, vy;
+  };
+
+  struct Delta {
+    Scalar dt;
+    Vec gravity;
+    double origin_x, origin_y;
+    Scalar position_scale, velocity_scale;
+    std::vector<int16_t> values; // dx, dy, dvx, dvy per body
+    std::vector<Escape> escapes;
+
+    size_t bytes() const { return sizeof(Delta) + values.size() * sizeof(int16_t) + escapes.size() * sizeof(Escape); }
+  };
+
+  struct Segment {
+    State keyframe;
+    std::vector<Delta> deltas;
+    size_t bytes;
+  };
+
+  static const int16_t LIMIT = 32767;
+
+  size_t interval_;
+  size_t max_bytes_;
+  size_t bytes_;
+  bool keyframe_due_;
+  uint64_t step_;
+
+  std::deque<Segment> segments_;
+
+  // the latest step as decode() will see it, which the next delta is taken from
+  State decoded_;
+
+  // largest change of position and velocity in the last delta, for the next one's scales
+  Scalar position_bound_, velocity_bound_;
+
+  // delta storage from dropped segments, to reuse rather than fault in fresh pages
+  std::vector<std::vector<int16_t> > spare_;
+
+  /** The size of change to quantize for: the largest, unless a few are far beyond the typical size */
+  static Scalar boundOf(Scalar largest, Scalar mean) {
+    const Scalar outlier = 1024 * mean;
+    const Scalar bound = largest > outlier && outlier > 0 ? outlier : largest;
+    return bound > 0 ? bound : std::numeric_limits<Scalar>::min() * LIMIT;
+  }
+
+  /** Nearest step of 1 / inverse, within LIMIT since the caller has checked delta against it */
+  static int16_t quantize(Scalar delta, Scalar inverse) {
+    const Scalar steps = delta * inverse;
+    return static_cast<int16_t>(steps < 0 ? steps - Scalar(0.5) : steps + Scalar(0.5));
+  }
+
+  void dropOldest() {
+    while (segments_.size() > 1 && bytes_ > max_bytes_) {
+      bytes_ -= segments_.front().bytes;
+
+      for (Delta& delta : segments_.front().deltas) {
+        if (spare_.size() < interval_)
+          spare_.push_back(std::move(delta.values));
+      }
+
+      segments_.pop_front();
+    }
+  }
+
+  void addKeyframe(const Object* objects, const size_t* ids, size_t count, const Object* parked, const size_t* parkedIds,
+                   size_t parkedCount, const Vec& gravity, double originX, double originY) {
+    segments_.emplace_back();
+    Segment& segment = segments_.back();
+    State& key = segment.keyframe;
+
+    key.step = step_;
+    key.x.resize(count);
+    key.y.resize(count);
+    key.vx.resize(count);
+    key.vy.resize(count);
+    key.radius.resize(count);
+    key.mass.resize(count);
+    key.ids.assign(ids, ids + count);
+    key.parked.assign(parked, parked + parkedCount);
+    key.parked_ids.assign(parkedIds, parkedIds + parkedCount);
+    key.origin_x = originX;
+    key.origin_y = originY;
+    key.gravity = gravity;
+
+    for (size_t i = 0; i < count; ++i) {
+      key.x[i] = objects[i].position().x;
+      key.y[i] = objects[i].position().y;
+      key.vx[i] = objects[i].velocity().x;
+      key.vy[i] = objects[i].velocity().y;
+      key.radius[i] = objects[i].radius();
+      key.mass[i] = objects[i].mass();
+    }
+
+    segment.bytes = sizeof(Segment) + key.bytes();
+    bytes_ += segment.bytes;
+
+    decoded_ = key;
+    keyframe_due_ = false;
+  }
+
+  void addDelta(const Object* objects, size_t count, Scalar dt, const Vec& gravity, double originX, double originY) {
+    Segment& segment = segments_.back();
+    segment.deltas.emplace_back();
+    Delta& delta = segment.deltas.back();
+
+    delta.dt = dt;
+    delta.gravity = gravity;
+    delta.origin_x = originX;
+    delta.origin_y = originY;
+
+    if (!spare_.empty()) {
+      delta.values.swap(spare_.back());
+      spare_.pop_back();
+    }
+
+    delta.values.resize(4 * count);
+
+    // one pass: the scales come from how far the bodies moved last step, with
+    // room to spare, and whatever still doesn't fit is stored exactly
+    if (position_bound_ <= 0 || velocity_bound_ <= 0)
+      measureBounds(objects, count);
+
+    const Scalar position_scale = 2 * position_bound_ / LIMIT, velocity_scale = 2 * velocity_bound_ / LIMIT;
+    const Scalar position_inverse = 1 / position_scale, velocity_inverse = 1 / velocity_scale;
+    const Scalar position_limit = position_scale * LIMIT, velocity_limit = velocity_scale * LIMIT;
+    Scalar position_max = 0, velocity_max = 0, position_sum = 0, velocity_sum = 0;
+
+    delta.position_scale = position_scale;
+    delta.velocity_scale = velocity_scale;
+
+    for (size_t i = 0; i < count; ++i) {
+      const Vec& position = objects[i].position();
+      const Vec& velocity = objects[i].velocity();
+      const Scalar dx = position.x - decoded_.x[i], dy = position.y - decoded_.y[i];
+      const Scalar dvx = velocity.x - decoded_.vx[i], dvy = velocity.y - decoded_.vy[i];
+      const Scalar dp = std::max(std::fabs(dx), std::fabs(dy));
+      const Scalar dv = std::max(std::fabs(dvx), std::fabs(dvy));
+      int16_t* values = &delta.values[4 * i];
+
+      position_max = std::max(position_max, dp);
+      velocity_max = std::max(velocity_max, dv);
+      position_sum += dp;
+      velocity_sum += dv;
+
+      if (dp > position_limit || dv > velocity_limit) {
+        Escape escape = { static_cast<uint32_t>(i), position.x, position.y, velocity.x, velocity.y };
+        delta.escapes.push_back(escape);
+        values[0] = values[1] = values[2] = values[3] = 0;
+
+        decoded_.x[i] = position.x;
+        decoded_.y[i] = position.y;
+        decoded_.vx[i] = velocity.x;
+        decoded_.vy[i] = velocity.y;
+        continue;
+      }
+
+      values[0] = quantize(dx, position_inverse);
+      values[1] = quantize(dy, position_inverse);
+      values[2] = quantize(dvx, velocity_inverse);
+      values[3] = quantize(dvy, velocity_inverse);
+
+      decoded_.x[i] += values[0] * position_scale;
+      decoded_.y[i] += values[1] * position_scale;
+      decoded_.vx[i] += values[2] * velocity_scale;
+      decoded_.vy[i] += values[3] * velocity_scale;
+    }
+
+    position_bound_ = boundOf(position_max, position_sum / count);
+    velocity_bound_ = boundOf(velocity_max, velocity_sum / count);
+
+    segment.bytes += delta.bytes();
+    bytes_ += delta.bytes();
+  }
+
+  /** Bounds for the first delta, when there is no last step to go by */
+  void measureBounds(const Object* objects, size_t count) {
+    Scalar position_max = 0, velocity_max = 0, position_sum = 0, velocity_sum = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const Scalar dp = std::max(std::fabs(objects[i].position().x - decoded_.x[i]), std::fabs(objects[i].position().y - decoded_.y[i]));
+      const Scalar dv = std::max(std::fabs(objects[i].velocity().x - decoded_.vx[i]), std::fabs(objects[i].velocity().y - decoded_.vy[i]));
+      position_max = std::max(position_max, dp);
+      velocity_max = std::max(velocity_max, dv);
+      position_sum += dp;
+      velocity_sum += dv;
+    }
+
+    position_bound_ = boundOf(position_max, position_sum / count);
+    velocity_bound_ = boundOf(velocity_max, velocity_sum / count);
+  }
+
+  /** Apply a delta to state, the same way addDelta() moved decoded_ on */
+  static void apply(const Delta& delta, State& state) {
+    const size_t count = state.size();
+
+    for (size_t i = 0; i < count; ++i) {
+      const int16_t* values = &delta.values[4 * i];
+      state.x[i] += values[0] * delta.position_scale;
+      state.y[i] += values[1] * delta.position_scale;
+      state.vx[i] += values[2] * delta.velocity_scale;
+      state.vy[i] += values[3] * delta.velocity_scale;
+    }
+
+    for (const Escape& escape : delta.escapes) {
+      state.x[escape.index] = escape.x;
+      state.y[escape.index] = escape.y;
+      state.vx[escape.index] = escape.vx;
+      state.vy[escape.index] = escape.vy;
+    }
+
+    state.origin_x = delta.origin_x;
+    state.origin_y = delta.origin_y;
+    state.gravity = delta.gravity;
+  }
+
+  const Segment* segmentOf(uint64_t step) const {
+    for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
+      if (it->keyframe.step <= step)
+        return step <= it->keyframe.step + it->deltas.size() ? &*it : nullptr;
+    }
+
+    return nullptr;
+  }
+
+public:
+  /**
+   *  @param keyframeInterval steps between keyframes; longer is smaller but makes rewinding re-simulate more
+   *  @param maxBytes memory to keep the history in; the newest segment is kept even if it alone is bigger
+   */
+  explicit RewindBuffer(size_t keyframeInterval = 64, size_t maxBytes = size_t(256) << 20)
+      : interval_(std::max<size_t>(1, keyframeInterval)), max_bytes_(maxBytes), bytes_(0), keyframe_due_(true), step_(0),
+        position_bound_(0), velocity_bound_(0) {}
+
+  size_t keyframeInterval() const { return interval_; }
+
+  size_t maxBytes() const { return max_bytes_; }
+
+  /** Memory the kept history takes */
+  size_t bytes() const { return bytes_; }
+
+  /** The next capture() stores a keyframe, e.g. because bodies were added, removed or moved outside a step */
+  void requestKeyframe() { keyframe_due_ = true; }
+
+  /** Step number of the latest capture */
+  uint64_t latest() const { return step_; }
+
+  /** Earliest step still kept */
+  uint64_t oldest() const { return segments_.empty() ? step_ : segments_.front().keyframe.step; }
+
+  /**
+   *  Record the bodies after a step of dt under gravity. The first capture is
+   *  step 0, the state the history starts from, and its dt is ignored. The
+   *  parked bodies only go into keyframes.
+   */
+  void capture(const Object* objects, const size_t* ids, size_t count, Scalar dt, const Vec& gravity, double originX, double originY,
+               const Object* parked = nullptr, const size_t* parkedIds = nullptr, size_t parkedCount = 0) {
+    if (!segments_.empty())
+      ++step_;
+
+    const bool keyframe = keyframe_due_ || segments_.empty() || decoded_.size() != count ||
+                          segments_.back().deltas.size() + 1 >= interval_;
+
+    if (keyframe)
+      addKeyframe(objects, ids, count, parked, parkedIds, parkedCount, gravity, originX, originY);
+    else
+      addDelta(objects, count, dt, gravity, originX, originY);
+
+    dropOldest();
+  }
+
+  /** The keyframe at or before step, or nullptr if that step is no longer kept */
+  const State* keyframeBefore(uint64_t step) const {
+    const Segment* segment = segmentOf(step);
+    return segment ? &segment->keyframe : nullptr;
+  }
+
+  /** The dt and gravity step was taken with; step must be kept and not a keyframe */
+  Scalar dtOf(uint64_t step) const {
+    const Segment* segment = segmentOf(step);
+    return segment->deltas[step - segment->keyframe.step - 1].dt;
+  }
+
+  Vec gravityOf(uint64_t step) const {
+    const Segment* segment = segmentOf(step);
+    return step == segment->keyframe.step ? segment->keyframe.gravity : segment->deltas[step - segment->keyframe.step - 1].gravity;
+  }
+
+  /** Rebuild step into state from its keyframe and the quantized deltas after it; false if it isn't kept */
+  bool decode(uint64_t step, State& state) const {
+    const Segment* segment = segmentOf(step);
+
+    if (!segment)
+      return false;
+
+    state = segment->keyframe;
+
+    for (uint64_t k = segment->keyframe.step; k < step; ++k)
+      apply(segment->deltas[k - segment->keyframe.step], state);
+
+    state.step = step;
+    return true;
+  }
+
+  /** Forget everything after step, which becomes the latest; the next capture starts a keyframe */
+  void truncate(uint64_t step) {
+    while (!segments_.empty() && segments_.back().keyframe.step > step) {
+      bytes_ -= segments_.back().bytes;
+      segments_.pop_back();
+    }
+
+    if (!segments_.empty()) {
+      Segment& segment = segments_.back();
+      const size_t keep = static_cast<size_t>(std::min<uint64_t>(step - segment.keyframe.step, segment.deltas.size()));
+
+      for (size_t k = keep; k < segment.deltas.size(); ++k) {
+        segment.bytes -= segment.deltas[k].bytes();
+        bytes_ -= segment.deltas[k].bytes();
+      }
+
+      segment.deltas.resize(keep);
+    }
+
+    step_ = step;
+    keyframe_due_ = true;
+  }
+
+  void clear() {
+    segments_.clear();
+    bytes_ = 0;
+    step_ = 0;
+    keyframe_due_ = true;
+  }
+};
+
+}
+
+#endif // FLATICS_REWIND_H
@@ -0,0 +1,509 @@
+#ifndef FLATICS_SCENARIO_H
+#define FLATICS_SCENARIO_H
+
+#include "Space.h"
+#include "Utility.h"
+#include "Vector2.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/*
+ *  Scenario files describe a scene instead of building it in code: the world,
+ *  its settings, and regions that bodies are generated in. One statement per
+ *  line, # starts a comment:
+ *
+ *    world 1600 900              size of the Space (default 1600 900)
+ *    boundary bounce             none, wrap or bounce (default bounce)
+ *    gravity 0 9.8               global gravity (default none)
+ *    object_gravity on           on or off (default on)
+ *    seed 42                     the regions' seeds derive from it (default 1)
+ *
+ *  and any number of bodies and regions, each a keyword and key=value pairs:
+ *
+ *    body     at=x,y [velocity=vx,vy] radius=r [mass=m | density=d]
+ *    uniform  count=n min=x,y max=x,y
+ *    disc     count=n center=x,y sigma=s [spin=w]
+ *    lattice  count=n origin=x,y spacing=dx,dy [columns=c] [jitter=j]
+ *    rings    count=n center=x,y inner=r1 outer=r2 [rings=k] [central=mass,radius]
+ *
+ *  Regions also take radius=r or radius=r1..r2 (uniform between, default
+ *  3..15), mass=m or density=d (mass d*r^2, the default with d = 1),
+ *  velocity=vx,vy added to every body, speed=s for a random velocity with
+ *  components of standard deviation s, and seed=n to override the derived
+ *  seed. A disc is a 2D gaussian of standard deviation sigma rotating at
+ *  spin rad/s; a lattice fills rows of columns (default about square) from
+ *  origin, each point moved by up to jitter; rings are circular orbits of the
+ *  central mass (added as a body of its own when given), with the bodies
+ *  spread over rings evenly spaced radii from inner to outer at random angles.
+ *
+ *  The bodies of a region are generated in blocks (Space::addCircles()), in
+ *  parallel straight into the Space, each block from its own generator seeded
+ *  by the region's seed and the block's number, with the random numbers made
+ *  by hand rather than by <random>'s distributions. So a scenario makes the
+ *  same bodies bit for bit whatever the thread pool and the standard library.
+ */
+
+/** One statement of a scenario that makes bodies */
+struct ScenarioRegion {
+  enum Kind {
+    BODY,
+    UNIFORM,
+    DISC,
+    LATTICE,
+    RINGS,
+  };
+
+  Kind kind;
+  size_t count;
+  uint64_t seed;
+
+  double radius_min, radius_max;
+  double mass;             // 0 to use density
+  double density;
+  double vx, vy;           // added to every body; a body's velocity
+  double speed;            // deviation of the random velocity
+
+  double x, y;             // a body's position, center of a disc or rings, origin of a lattice, min of uniform
+  double x2, y2;           // max of uniform, spacing of a lattice
+  double sigma, spin;      // disc
+  size_t columns;          // lattice
+  double jitter;           // lattice
+  double inner, outer;     // rings
+  size_t rings;
+  double central_mass, central_radius;
+};
+
+/** splitmix64, seeded per block; small and quick to seed, unlike the std engines */
+class ScenarioRandom {
+private:
+  uint64_t state_;
+
+public:
+  explicit ScenarioRandom(uint64_t seed) : state_(seed) {}
+
+  /** A seed for one of many streams under seed */
+  static uint64_t mix(uint64_t seed, uint64_t stream) {
+    ScenarioRandom random(seed ^ (stream * 0x9e3779b97f4a7c15ull));
+    random.next();
+    return random.next();
+  }
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  /** Uniform in [0, 1) */
+  double uniform() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  double uniform(double low, double high) { return low + (high - low) * uniform(); }
+
+  /** Two independent standard normals (Box-Muller) */
+  void gaussian(double& a, double& b) {
+    const double radius = std::sqrt(-2 * std::log(1 - uniform()));
+    const double angle = 6.283185307179586 * uniform();
+    a = radius * std::cos(angle);
+    b = radius * std::sin(angle);
+  }
+};
+
+/** A parsed scenario file, which populate() turns into bodies of a Space */
+class Scenario {
+public:
+  // numbered alike in every Space
+  typedef Space<double, Vector2<double> >::BoundaryMode BoundaryMode;
+
+private:
+  double width_, height_;
+  BoundaryMode boundary_;
+  double gravity_x_, gravity_y_;
+  bool object_gravity_;
+  uint64_t seed_;
+  std::vector<ScenarioRegion> regions_;
+  std::string error_;
+
+  static bool parsePair(const std::string& text, double& a, double& b) {
+    const size_t comma = text.find(',');
+    return comma != std::string::npos && parseNumber(text.substr(0, comma), a) && parseNumber(text.substr(comma + 1), b);
+  }
+
+  static bool parseNumber(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(value);
+  }
+
+  static bool parseCount(const std::string& text, size_t& value) {
+    double number;
+
+    if (!parseNumber(text, number) || number < 0 || number != std::floor(number))
+      return false;
+
+    value = static_cast<size_t>(number);
+    return true;
+  }
+
+  /** A seed is a whole 64 bits, beyond what parseCount()'s double holds exactly */
+  static bool parseSeed(const std::string& text, uint64_t& value) {
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+      return false;
+
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long number = std::strtoull(text.c_str(), &end, 10);
+    value = static_cast<uint64_t>(number);
+    return *end == '\0' && errno != ERANGE;
+  }
+
+  bool fail(size_t line, const std::string& message) {
+    std::ostringstream text;
+    text << "line " << line << ": " << message;
+    error_ = text.str();
+    return false;
+  }
+
+  /** Fill region from the key=value pairs after its keyword; seeded tells whether they gave a seed */
+  bool parseRegion(size_t line, std::istringstream& words, ScenarioRegion& region, bool& seeded) {
+    bool has_count = false, has_position = false;
+    seeded = false;
+    std::string word;
+
+    while (words >> word) {
+      const size_t equals = word.find('=');
+
+      if (equals == std::string::npos)
+        return fail(line, "expected key=value, got " + word);
+
+      const std::string key = word.substr(0, equals), value = word.substr(equals + 1);
+      bool ok;
+
+      if (key == "count") {
+        ok = parseCount(value, region.count) && region.count > 0;
+        has_count = true;
+      } else if (key == "seed") {
+        ok = parseSeed(value, region.seed);
+        seeded = true;
+      } else if (key == "radius") {
+        const size_t dots = value.find("..");
+
+        if (dots == std::string::npos) {
+          ok = parseNumber(value, region.radius_min);
+          region.radius_max = region.radius_min;
+        } else {
+          ok = parseNumber(value.substr(0, dots), region.radius_min) && parseNumber(value.substr(dots + 2), region.radius_max);
+        }
+
+        ok = ok && region.radius_min > 0 && region.radius_max >= region.radius_min;
+      } else if (key == "mass") {
+        ok = parseNumber(value, region.mass) && region.mass > 0;
+      } else if (key == "density") {
+        ok = parseNumber(value, region.density) && region.density > 0;
+      } else if (key == "velocity") {
+        ok = parsePair(value, region.vx, region.vy);
+      } else if (key == "speed") {
+        ok = parseNumber(value, region.speed) && region.speed >= 0;
+      } else if (key == "at" || key == "center" || key == "origin" || key == "min") {
+        ok = parsePair(value, region.x, region.y);
+        has_position = true;
+      } else if (key == "max" || key == "spacing") {
+        ok = parsePair(value, region.x2, region.y2);
+      } else if (key == "sigma") {
+        ok = parseNumber(value, region.sigma) && region.sigma >= 0;
+      } else if (key == "spin") {
+        ok = parseNumber(value, region.spin);
+      } else if (key == "columns") {
+        ok = parseCount(value, region.columns) && region.columns > 0;
+      } else if (key == "jitter") {
+        ok = parseNumber(value, region.jitter) && region.jitter >= 0;
+      } else if (key == "inner") {
+        ok = parseNumber(value, region.inner) && region.inner > 0;
+      } else if (key == "outer") {
+        ok = parseNumber(value, region.outer) && region.outer > 0;
+      } else if (key == "rings") {
+        ok = parseCount(value, region.rings) && region.rings > 0;
+      } else if (key == "central") {
+        ok = parsePair(value, region.central_mass, region.central_radius) && region.central_mass >= 0 && region.central_radius > 0;
+      } else {
+        return fail(line, "unknown key " + key);
+      }
+
+      if (!ok)
+        return fail(line, "bad value for " + key + ": " + value);
+    }
+
+    if (region.kind == ScenarioRegion::BODY) {
+      region.count = 1;
+      has_count = true;
+    }
+
+    if (!has_count)
+      return fail(line, "needs a count");
+
+    if (!has_position)
+      return fail(line, region.kind == ScenarioRegion::UNIFORM ? "needs min and max" : "needs a position");
+
+    if (region.kind == ScenarioRegion::UNIFORM && !(region.x2 > region.x && region.y2 > region.y))
+      return fail(line, "max has to be above min");
+
+    if (region.kind == ScenarioRegion::RINGS && !(region.inner > 0 && region.outer >= region.inner))
+      return fail(line, "needs 0 < inner <= outer");
+
+    return true;
+  }
+
+  template<typename Scalar, class Vec>
+  static void generate(const ScenarioRegion& region, size_t begin, size_t end, Circle<Scalar, Vec>* out) {
+    ScenarioRandom random(ScenarioRandom::mix(region.seed, begin / Space<Scalar, Vec>::addBlock()));
+    const size_t columns = region.columns > 0 ? region.columns : static_cast<size_t>(std::ceil(std::sqrt(double(region.count))));
+
+    for (size_t k = begin; k < end; ++k) {
+      const double radius = region.radius_min == region.radius_max ? region.radius_min : random.uniform(region.radius_min, region.radius_max);
+      const double mass = region.mass > 0 ? region.mass : region.density * radius * radius;
+      double x = 0, y = 0, vx = region.vx, vy = region.vy;
+
+      switch (region.kind) {
+      case ScenarioRegion::BODY:
+        x = region.x;
+        y = region.y;
+        break;
+
+      case ScenarioRegion::UNIFORM:
+        x = random.uniform(region.x, region.x2);
+        y = random.uniform(region.y, region.y2);
+        break;
+
+      case ScenarioRegion::DISC: {
+        double dx, dy;
+        random.gaussian(dx, dy);
+        x = region.x + region.sigma * dx;
+        y = region.y + region.sigma * dy;
+        vx -= region.spin * region.sigma * dy;
+        vy += region.spin * region.sigma * dx;
+        break;
+      }
+
+      case ScenarioRegion::LATTICE:
+        x = region.x + region.x2 * double(k % columns) + region.jitter * random.uniform(-1, 1);
+        y = region.y + region.y2 * double(k / columns) + region.jitter * random.uniform(-1, 1);
+        break;
+
+      case ScenarioRegion::RINGS: {
+        const size_t ring = k * region.rings / region.count;
+        const double orbit = region.rings > 1 ? region.inner + (region.outer - region.inner) * double(ring) / double(region.rings - 1) : region.inner;
+        const double angle = random.uniform(0, 6.283185307179586);
+        const double orbital = std::sqrt(gravitationalConstant<double>() * region.central_mass / orbit);
+        x = region.x + orbit * std::cos(angle);
+        y = region.y + orbit * std::sin(angle);
+        vx -= orbital * std::sin(angle);
+        vy += orbital * std::cos(angle);
+        break;
+      }
+      }
+
+      if (region.speed > 0) {
+        double dvx, dvy;
+        random.gaussian(dvx, dvy);
+        vx += region.speed * dvx;
+        vy += region.speed * dvy;
+      }
+
+      out[k - begin] = Circle<Scalar, Vec>(Scalar(radius), Scalar(mass), Vec(Scalar(x), Scalar(y)), Vec(Scalar(vx), Scalar(vy)));
+    }
+  }
+
+public:
+  Scenario() { clear(); }
+
+  void clear() {
+    width_ = 1600;
+    height_ = 900;
+    boundary_ = BoundaryMode::BOUNCE;
+    gravity_x_ = gravity_y_ = 0;
+    object_gravity_ = true;
+    seed_ = 1;
+    regions_.clear();
+    error_.clear();
+  }
+
+  /** Read the scenario at path; false with error() set if it can't be read or parsed */
+  bool load(const std::string& path) {
+    std::ifstream file(path.c_str());
+
+    if (!file) {
+      clear();
+      error_ = "can't open " + path;
+      return false;
+    }
+
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+  }
+
+  /** Parse a scenario from text; false with error() set on the first bad line */
+  bool parse(const std::string& text) {
+    clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    size_t number = 0;
+    std::vector<bool> seeded;
+
+    while (std::getline(lines, line)) {
+      ++number;
+      line = line.substr(0, line.find('#'));
+
+      std::istringstream words(line);
+      std::string keyword;
+
+      if (!(words >> keyword))
+        continue;
+
+      if (keyword == "world") {
+        if (!(words >> width_ >> height_) || width_ <= 0 || height_ <= 0)
+          return fail(number, "world needs a width and a height");
+      } else if (keyword == "boundary") {
+        std::string mode;
+        words >> mode;
+
+        if (mode == "none")
+          boundary_ = BoundaryMode::NONE;
+        else if (mode == "wrap")
+          boundary_ = BoundaryMode::WRAP;
+        else if (mode == "bounce")
+          boundary_ = BoundaryMode::BOUNCE;
+        else
+          return fail(number, "boundary is none, wrap or bounce");
+      } else if (keyword == "gravity") {
+        if (!(words >> gravity_x_ >> gravity_y_))
+          return fail(number, "gravity needs x and y");
+      } else if (keyword == "object_gravity") {
+        std::string setting;
+        words >> setting;
+
+        if (setting != "on" && setting != "off")
+          return fail(number, "object_gravity is on or off");
+
+        object_gravity_ = setting == "on";
+      } else if (keyword == "seed") {
+        std::string value;
+
+        if (!(words >> value) || !parseSeed(value, seed_))
+          return fail(number, "seed needs a number");
+      } else {
+        ScenarioRegion region = ScenarioRegion();
+        region.radius_min = 3;
+        region.radius_max = 15;
+        region.density = 1;
+        region.rings = 1;
+        region.seed = 0;
+
+        if (keyword == "body")
+          region.kind = ScenarioRegion::BODY;
+        else if (keyword == "uniform")
+          region.kind = ScenarioRegion::UNIFORM;
+        else if (keyword == "disc")
+          region.kind = ScenarioRegion::DISC;
+        else if (keyword == "lattice")
+          region.kind = ScenarioRegion::LATTICE;
+        else if (keyword == "rings")
+          region.kind = ScenarioRegion::RINGS;
+        else
+          return fail(number, "unknown statement " + keyword);
+
+        bool own_seed;
+
+        if (!parseRegion(number, words, region, own_seed))
+          return false;
+
+        regions_.push_back(region);
+        seeded.push_back(own_seed);
+      }
+
+      std::string extra;
+
+      if (words >> extra)
+        return fail(number, "unexpected " + extra);
+    }
+
+    // regions without a seed of their own derive it from the scene's, wherever that was set
+    for (size_t k = 0; k < regions_.size(); ++k) {
+      if (!seeded[k])
+        regions_[k].seed = ScenarioRandom::mix(seed_, k);
+    }
+
+    return true;
+  }
+
+  const std::string& error() const { return error_; }
+
+  double width() const { return width_; }
+
+  double height() const { return height_; }
+
+  BoundaryMode boundary() const { return boundary_; }
+
+  uint64_t seed() const { return seed_; }
+
+  const std::vector<ScenarioRegion>& regions() const { return regions_; }
+
+  /** Bodies populate() adds */
+  size_t bodies() const {
+    size_t count = 0;
+
+    for (const ScenarioRegion& region : regions_)
+      count += region.count + (region.kind == ScenarioRegion::RINGS && region.central_mass > 0);
+
+    return count;
+  }
+
+  /**
+   *  Apply the settings to space and add the bodies, region by region, in
+   *  parallel on its thread pool (if it has one). Returns the id of the first
+   *  body added, or noBody() for a scenario without any. The world size isn't
+   *  applied: construct the Space with width() and height().
+   */
+  template<typename Scalar, class Vec>
+  size_t populate(Space<Scalar, Vec>& space) const {
+    typedef Space<Scalar, Vec> World;
+
+    space.setBoundaryMode(static_cast<typename World::BoundaryMode>(boundary_));
+    space.setObjectGravity(object_gravity_);
+    space.setGravity(Vec(Scalar(gravity_x_), Scalar(gravity_y_)));
+    space.reserve(space.objects().size() + bodies());
+
+    size_t first = noBody();
+
+    for (const ScenarioRegion& region : regions_) {
+      if (region.kind == ScenarioRegion::RINGS && region.central_mass > 0) {
+        const size_t id = space.addCircle(Scalar(region.central_radius), Scalar(region.central_mass), Vec(Scalar(region.x), Scalar(region.y)),
+                                          Vec(Scalar(region.vx), Scalar(region.vy)));
+        first = std::min(first, id);
+      }
+
+      const size_t id = space.addCircles(region.count, [&region](size_t begin, size_t end, Circle<Scalar, Vec>* out) {
+        generate<Scalar, Vec>(region, begin, end, out);
+      });
+      first = std::min(first, id);
+    }
+
+    return first;
+  }
+
+  static size_t noBody() { return static_cast<size_t>(-1); }
+};
+
+}
+
+#endif // FLATICS_SCENARIO_H
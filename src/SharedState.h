@@ -0,0 +1,419 @@
+#ifndef FLATICS_SHAREDSTATE_H
+#define FLATICS_SHAREDSTATE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace flatics {
+
+/*
+ *  Per-step simulation state in a named POSIX shared memory segment, so other
+ *  processes (visualizers, analytics) can map it and read the bodies in place.
+ *
+ *  The segment is a fixed header followed by one array per field (structure
+ *  of arrays), each sized for capacity bodies, at the byte offsets recorded in
+ *  the header; anything that can map a file can find them without this code.
+ *
+ *  Consistency is a sequence lock: the writer makes the sequence odd before it
+ *  touches the arrays and even again after, so a reader that saw the same even
+ *  sequence before and after reading got one whole step. Readers never write
+ *  to the segment and never block the simulation.
+ *
+ *  When the bodies outgrow the segment the writer marks it retired and
+ *  replaces it under the same name with twice the room; readers that see the
+ *  flag simply open the name again.
+ *
+ *  Not available on Windows: the open calls fail there.
+ */
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the sequence lock needs lock-free 64 bit atomics to work across processes");
+
+enum SharedStateField {
+  STATE_X,
+  STATE_Y,
+  STATE_VX,
+  STATE_VY,
+  STATE_RADIUS,
+  STATE_MASS,
+  STATE_ID, // uint64_t, the rest are the simulation's Scalar
+  STATE_FIELDS,
+};
+
+struct SharedStateHeader {
+  static const uint32_t MAGIC = 0x54534c46; // "FLST"
+  static const uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t scalar_size;            // bytes per value of the Scalar fields, 4 or 8
+  std::atomic<uint32_t> retired;   // the writer has moved to a new segment
+  uint64_t capacity;               // bodies each array has room for
+  uint64_t offsets[STATE_FIELDS];  // of each array from the start of the segment
+
+  std::atomic<uint64_t> sequence;  // twice the step, plus one while the next is being written
+  uint64_t step;                   // steps published so far
+  uint64_t count;                  // bodies in this step
+  double time;                     // simulated time
+  double origin_x, origin_y;       // add to positions for world coordinates
+  double width, height;
+
+  /** Bytes of a segment holding capacity bodies of scalarSize byte values */
+  static size_t segmentSize(size_t capacity, size_t scalarSize) {
+    return layout(nullptr, capacity, scalarSize);
+  }
+
+  /** Fill in offsets (when given) for the layout and return the total size */
+  static size_t layout(uint64_t* offsets, size_t capacity, size_t scalarSize) {
+    size_t offset = align(sizeof(SharedStateHeader));
+
+    for (size_t field = 0; field < STATE_FIELDS; ++field) {
+      if (offsets)
+        offsets[field] = offset;
+
+      offset = align(offset + capacity * (field == STATE_ID ? sizeof(uint64_t) : scalarSize));
+    }
+
+    return offset;
+  }
+
+  /** Arrays start on cache lines */
+  static size_t align(size_t offset) { return (offset + 63) & ~size_t(63); }
+};
+
+namespace detail {
+
+/** A mapped named segment; unmapped when destroyed */
+class SharedMapping {
+private:
+  void* data_;
+  size_t size_;
+
+public:
+  SharedMapping() : data_(nullptr), size_(0) {}
+
+  ~SharedMapping() { close(); }
+
+  SharedMapping(const SharedMapping&) = delete;
+  SharedMapping& operator=(const SharedMapping&) = delete;
+
+  void* data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  /** Replace any segment called name with a new one of size bytes */
+  bool create(const std::string& name, size_t size) {
+    close();
+#ifndef _WIN32
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+      return false;
+
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+
+    return map(fd, size, PROT_READ | PROT_WRITE);
+#else
+    (void)name;
+    (void)size;
+    return false;
+#endif
+  }
+
+  /** Map an existing segment called name for reading */
+  bool open(const std::string& name) {
+    close();
+#ifndef _WIN32
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SharedStateHeader)) {
+      ::close(fd);
+      return false;
+    }
+
+    return map(fd, static_cast<size_t>(info.st_size), PROT_READ);
+#else
+    (void)name;
+    return false;
+#endif
+  }
+
+  void close() {
+#ifndef _WIN32
+    if (data_)
+      munmap(data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  static void unlink(const std::string& name) {
+#ifndef _WIN32
+    shm_unlink(name.c_str());
+#else
+    (void)name;
+#endif
+  }
+
+private:
+#ifndef _WIN32
+  bool map(int fd, size_t size, int protection) {
+    void* data = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+      return false;
+
+    data_ = data;
+    size_ = size;
+    return true;
+  }
+#endif
+};
+
+}
+
+/** Publishing side, owned by the simulation */
+template<typename Scalar>
+class SharedStateWriter {
+private:
+  std::string name_;
+  detail::SharedMapping mapping_;
+  SharedStateHeader* header_;
+  uint64_t step_;
+  double time_;
+
+  bool allocate(size_t capacity) {
+    // off the name first, so a reader that sees the flag can only find the new one
+    if (header_) {
+      detail::SharedMapping::unlink(name_);
+      header_->retired.store(1, std::memory_order_release);
+    }
+
+    header_ = nullptr;
+
+    if (!mapping_.create(name_, SharedStateHeader::segmentSize(capacity, sizeof(Scalar))))
+      return false;
+
+    header_ = new (mapping_.data()) SharedStateHeader();
+    header_->magic = SharedStateHeader::MAGIC;
+    header_->version = SharedStateHeader::VERSION;
+    header_->scalar_size = sizeof(Scalar);
+    header_->retired.store(0, std::memory_order_relaxed);
+    header_->capacity = capacity;
+    SharedStateHeader::layout(header_->offsets, capacity, sizeof(Scalar));
+    header_->sequence.store(2 * step_, std::memory_order_relaxed);
+    header_->step = step_;
+    header_->count = 0;
+    header_->time = time_;
+    header_->origin_x = header_->origin_y = 0;
+    header_->width = header_->height = 0;
+    return true;
+  }
+
+public:
+  SharedStateWriter() : header_(nullptr), step_(0), time_(0) {}
+
+  /** Unlinks the segment; readers keep what they mapped but see no new steps */
+  ~SharedStateWriter() {
+    if (header_) {
+      detail::SharedMapping::unlink(name_);
+      header_->retired.store(1, std::memory_order_release);
+    }
+  }
+
+  /** Create the segment called name (e.g. "/flatics") with room for capacity bodies */
+  bool open(const std::string& name, size_t capacity) {
+    name_ = name;
+    return allocate(capacity < 64 ? 64 : capacity);
+  }
+
+  const std::string& name() const { return name_; }
+
+  size_t capacity() const { return header_ ? header_->capacity : 0; }
+
+  /**
+   *  Start writing a step of count bodies, growing the segment first if they
+   *  don't fit. Until endWrite() readers see the step as in progress.
+   */
+  bool beginWrite(size_t count) {
+    if (!header_)
+      return false;
+
+    if (count > header_->capacity && !allocate(std::max<size_t>(count, 2 * header_->capacity)))
+      return false;
+
+    uint64_t sequence = header_->sequence.load(std::memory_order_relaxed);
+    header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header_->count = count;
+    return true;
+  }
+
+  Scalar* array(SharedStateField field) {
+    return reinterpret_cast<Scalar*>(static_cast<char*>(mapping_.data()) + header_->offsets[field]);
+  }
+
+  uint64_t* ids() {
+    return reinterpret_cast<uint64_t*>(static_cast<char*>(mapping_.data()) + header_->offsets[STATE_ID]);
+  }
+
+  /** Finish the step begun by beginWrite(), dt after the last one */
+  void endWrite(double dt, double originX, double originY, double width, double height) {
+    time_ += dt;
+    header_->step = ++step_;
+    header_->time = time_;
+    header_->origin_x = originX;
+    header_->origin_y = originY;
+    header_->width = width;
+    header_->height = height;
+
+    header_->sequence.store(header_->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+};
+
+/**
+ *  Reading side, for consumers in other processes: maps the segment read-only
+ *  and hands out pointers straight into it.
+ */
+template<typename Scalar>
+class SharedStateReader {
+public:
+  /** One step, pointing into the segment; only trustworthy while validate() says so */
+  struct View {
+    const Scalar* x;
+    const Scalar* y;
+    const Scalar* vx;
+    const Scalar* vy;
+    const Scalar* radius;
+    const Scalar* mass;
+    const uint64_t* id;
+    size_t count;
+    uint64_t step;
+    double time;
+    double origin_x, origin_y;
+    double width, height;
+  };
+
+private:
+  std::string name_;
+  detail::SharedMapping mapping_;
+  const SharedStateHeader* header_;
+  uint64_t sequence_;
+
+  const char* base() const { return static_cast<const char*>(mapping_.data()); }
+
+public:
+  SharedStateReader() : header_(nullptr), sequence_(0) {}
+
+  /** Map the segment called name; fails if there is none or it isn't a layout of this Scalar */
+  bool open(const std::string& name) {
+    name_ = name;
+    header_ = nullptr;
+
+    if (!mapping_.open(name))
+      return false;
+
+    const SharedStateHeader* header = static_cast<const SharedStateHeader*>(mapping_.data());
+
+    if (header->magic != SharedStateHeader::MAGIC || header->version != SharedStateHeader::VERSION ||
+        header->scalar_size != sizeof(Scalar) || header->retired.load(std::memory_order_acquire) ||
+        mapping_.size() < SharedStateHeader::segmentSize(header->capacity, sizeof(Scalar))) {
+      mapping_.close();
+      return false;
+    }
+
+    header_ = header;
+    return true;
+  }
+
+  bool isOpen() const { return header_ != nullptr; }
+
+  /** Whether the writer has replaced (or dropped) the segment; open() again to follow it */
+  bool retired() const { return header_ && header_->retired.load(std::memory_order_acquire); }
+
+  /** Steps published so far, without reading the bodies; cheap enough to poll every frame */
+  uint64_t step() const {
+    return header_ ? header_->sequence.load(std::memory_order_acquire) / 2 : 0;
+  }
+
+  /**
+   *  Start reading the latest step. False while the writer is in the middle of
+   *  one; otherwise view points at it until validate() fails.
+   */
+  bool begin(View& view) {
+    if (!header_)
+      return false;
+
+    sequence_ = header_->sequence.load(std::memory_order_acquire);
+    if (sequence_ & 1)
+      return false;
+
+    view.x = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_X]);
+    view.y = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_Y]);
+    view.vx = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_VX]);
+    view.vy = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_VY]);
+    view.radius = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_RADIUS]);
+    view.mass = reinterpret_cast<const Scalar*>(base() + header_->offsets[STATE_MASS]);
+    view.id = reinterpret_cast<const uint64_t*>(base() + header_->offsets[STATE_ID]);
+    view.count = static_cast<size_t>(std::min<uint64_t>(header_->count, header_->capacity));
+    view.step = header_->step;
+    view.time = header_->time;
+    view.origin_x = header_->origin_x;
+    view.origin_y = header_->origin_y;
+    view.width = header_->width;
+    view.height = header_->height;
+    return true;
+  }
+
+  /** Whether everything read through the view since begin() belongs to one step */
+  bool validate() const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->sequence.load(std::memory_order_relaxed) == sequence_;
+  }
+
+  /**
+   *  Run consume(view) on a whole step, retrying up to attempts times if the
+   *  writer overwrote it meanwhile. consume must cope with seeing a torn step
+   *  it is about to be told to throw away.
+   */
+  template<class Consume>
+  bool read(Consume consume, unsigned attempts = 16) {
+    View view;
+
+    for (unsigned attempt = 0; attempt < attempts; ++attempt) {
+      if (!begin(view))
+        continue;
+
+      consume(const_cast<const View&>(view));
+
+      if (validate())
+        return true;
+    }
+
+    return false;
+  }
+};
+
+}
+
+#endif // FLATICS_SHAREDSTATE_H
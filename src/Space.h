@@ -1,13 +1,37 @@
 #ifndef SPACE_H
 #define SPACE_H
 
+#include "AabbTree.h"
+#include "Allocator.h"
+#include "Arena.h"
+#include "BlockTimesteps.h"
+#include "Broadphase.h"
 #include "Circle.h"
+#include "Contacts.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "MortonOrder.h"
+#include "NeighbourList.h"
+#include "ParticleMesh.h"
+#include "Rewind.h"
+#include "SharedState.h"
+#include "SpatialHash.h"
+#include "StepPolicies.h"
+#include "Summation.h"
+#include "SweepAndPrune.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 #include "Utility.h"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <cmath>
 #include <random>
+#include <string>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <unordered_set>
 
 // TODO: synchronizing access to objects vector, since
@@ -30,179 +54,1963 @@ public:
     BOUNCE,
   };
 
+  enum RestitutionModel {
+    INELASTIC,
+    ELASTIC,
+  };
+
+  enum BroadphaseMode {
+    BRUTE_FORCE, // test every pair, fused with the pairwise gravity loop
+    AABB_TREE,
+    SWEEP_AND_PRUNE,
+    SPATIAL_HASH,  // hashed grid, sized by the bodies instead of the world; for NONE
+  };
+
+  // what happens to bodies that have left the rest for good, without a boundary
+  enum FarFieldPolicy {
+    KEEP, // simulate them like any other
+    PARK, // take them out of the step and let them coast until they come back in range
+    CULL, // remove them
+  };
+
+  enum GravitySolver {
+    DIRECT,        // exact pairwise sum, O(n^2)
+    PARTICLE_MESH, // FFT on a grid over the periodic world, meant for WRAP
+    CUTOFF,        // tapered to nothing at a cutoff, pairs from Verlet neighbour lists
+  };
+
+  typedef ContactEvent<Scalar, Vec> Contact;
+  typedef typename ParticleMesh<Scalar, Vec>::Assignment MeshAssignment;
+
+  // the body arrays, allocated as setMemoryPolicy() says
+  typedef std::vector<Circle<Scalar, Vec>, BodyAllocator<Circle<Scalar, Vec> > > Objects;
+  typedef std::vector<size_t, BodyAllocator<size_t> > Ids;
+
 private:
   typedef Circle<Scalar, Vec> Object;
 
-  Scalar width_, height_;
-  std::vector<Object> objects_;
+  Scalar width_, height_;
+
+  // huge pages and first touch placement for the arrays below
+  MemoryPolicy memory_;
+  bool first_touch_;
+
+  Objects objects_;
+
+  // stable body ids, parallel to objects_; ids are never reused
+  Ids ids_;
+  size_t next_id_;
+
+  // current index in objects_ of every id ever handed out (noIndex() once gone)
+  std::vector<size_t> index_of_;
+
+  BoundaryMode boundary_mode_;
+  bool object_gravity_;
+  GravitySolver gravity_solver_;
+  std::unique_ptr<ParticleMesh<Scalar, Vec> > particle_mesh_;
+  std::unique_ptr<NeighbourList<Scalar, Vec> > neighbour_list_;
+  std::unique_ptr<BlockTimesteps<Scalar, Vec> > block_timesteps_;
+  std::vector<bool> active_mark_;
+  RestitutionModel restitution_model_;
+  std::mutex mutex_;
+
+  bool contact_events_;
+  ContactTracker<Scalar, Vec> contacts_;
+
+  // optional workers for the parallel parts of a step, owned elsewhere
+  ThreadPool* pool_;
+
+  BroadphaseMode broadphase_mode_;
+  std::unique_ptr<Broadphase<Scalar, Vec> > broadphase_;
+  std::vector<typename Broadphase<Scalar, Vec>::Pair> pairs_;
+
+  // Morton reordering: every reorder_interval_ steps and/or whenever the
+  // disorder of objects_ exceeds reorder_threshold_ (0 disables either)
+  size_t reorder_interval_;
+  Scalar reorder_threshold_;
+  size_t steps_since_reorder_;
+  std::vector<MortonEntry, BodyAllocator<MortonEntry> > morton_;
+  std::vector<MortonEntry, BodyAllocator<MortonEntry> > morton_scratch_;
+
+  // what the bodies are sorted into on a reorder; the two sets of arrays
+  // swap places, so reordering reuses memory instead of allocating
+  Objects reorder_objects_;
+  Ids reorder_ids_;
+
+  // scratch for everything that only lives within a step, reset as each starts
+  StepArena arena_;
+
+  // world coordinates of the local origin positions are relative to, kept in
+  // double so single precision bodies can roam far without losing precision
+  double origin_x_, origin_y_;
+  Scalar rebase_distance_;
+
+  // bodies further than far_field_distance_ from the center of mass and
+  // escaping are parked or culled as far_field_policy_ says; parked ones keep
+  // their ids but have no index
+  FarFieldPolicy far_field_policy_;
+  Scalar far_field_distance_;
+  std::vector<Object> parked_;
+  std::vector<size_t> parked_ids_;
+  std::vector<size_t> leaving_;
+  size_t culled_;
+
+  // per-step state published for other processes, when enabled
+  std::unique_ptr<SharedStateWriter<Scalar> > shared_state_;
+
+  // per-step metrics, measured while integrating when enabled, and where
+  // they go (owned elsewhere)
+  bool metrics_enabled_;
+  bool metrics_measured_;
+  StepMetrics metrics_;
+  MetricsExporter* metrics_exporter_;
+  size_t contacts_resolved_;
+
+  // recent history for rewind(), when enabled
+  std::unique_ptr<RewindBuffer<Scalar, Vec> > rewind_;
+
+  // random numbers of this space (addRandomCircle()), seeded by setDeterministic()
+  std::mt19937_64 rng_;
+  uint64_t seed_;
+
+  // with a fixed step, update() takes as many steps of it as the time passed
+  // to it covers, carrying the rest over in step_debt_
+  Scalar fixed_step_;
+  Scalar step_debt_;
+  uint64_t steps_;
+
+  // journal of every outside change while recording, see startJournal()
+  std::unique_ptr<JournalWriter> journal_;
+  uint64_t hash_interval_;
+  Vec journaled_gravity_;
+
+  /** The bodies changed outside a step, so the rewind history needs a fresh keyframe */
+  void discontinuity() {
+    if (rewind_)
+      rewind_->requestKeyframe();
+  }
+
+  /** Finish the journal, if any, with an END record */
+  void closeJournal() {
+    if (!journal_)
+      return;
+
+    journal_->begin(JOURNAL_END, steps_);
+    journal_->put(stateHash());
+    journal_.reset();
+  }
+
+  void applySetting(JournalSetting setting, uint64_t value) {
+    switch (setting) {
+    case SETTING_BOUNDARY: boundary_mode_ = static_cast<BoundaryMode>(value); break;
+    case SETTING_OBJECT_GRAVITY: object_gravity_ = value != 0; break;
+    case SETTING_RESTITUTION: restitution_model_ = static_cast<RestitutionModel>(value); break;
+    case SETTING_BROADPHASE: resetBroadphase(static_cast<BroadphaseMode>(value)); break;
+    }
+  }
+
+  static bool readValues(JournalReader& reader, Scalar* values, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+      if (!reader.get(values[k]))
+        return false;
+    }
+
+    return true;
+  }
+
+  /** Read a body as journalBody() wrote it */
+  static bool readBody(JournalReader& reader, uint64_t& id, Object& obj) {
+    Scalar values[6];
+
+    if (!reader.getVarint(id) || !readValues(reader, values, 6))
+      return false;
+
+    obj = Object(values[0], values[1], Vec(values[2], values[3]), Vec(values[4], values[5]));
+    return true;
+  }
+
+  /** Replace everything with a JOURNAL_STATE record's payload */
+  bool readState(JournalReader& reader) {
+    uint64_t boundary, object_gravity, restitution, broadphase, interval, next_id, count;
+    Scalar values[5];
+
+    if (!reader.getVarint(boundary) || !reader.getVarint(object_gravity) || !reader.getVarint(restitution) ||
+        !reader.getVarint(broadphase) || !reader.getVarint(interval) || !readValues(reader, values, 2))
+      return false;
+
+    uint64_t far_field;
+    double origin[2];
+
+    if (!reader.getVarint(far_field) || !readValues(reader, values + 2, 3) || !reader.get(origin[0]) ||
+        !reader.get(origin[1]) || !reader.get(step_debt_) || !reader.getVarint(next_id))
+      return false;
+
+    clearBodies();
+    applySetting(SETTING_BOUNDARY, boundary);
+    applySetting(SETTING_OBJECT_GRAVITY, object_gravity);
+    applySetting(SETTING_RESTITUTION, restitution);
+    applySetting(SETTING_BROADPHASE, broadphase);
+    reorder_interval_ = static_cast<size_t>(interval);
+    reorder_threshold_ = values[0];
+    steps_since_reorder_ = 0;
+    rebase_distance_ = values[1];
+    far_field_policy_ = static_cast<FarFieldPolicy>(far_field);
+    far_field_distance_ = values[2];
+    global_gravity_ = Vec(values[3], values[4]);
+
+    origin_x_ = origin[0];
+    origin_y_ = origin[1];
+    next_id_ = static_cast<size_t>(next_id);
+    index_of_.assign(next_id_, noIndex());
+
+    if (!reader.getVarint(count))
+      return false;
+
+    for (uint64_t k = 0; k < count; ++k) {
+      uint64_t id;
+      Object obj(0, 0);
+
+      if (!readBody(reader, id, obj) || id >= next_id_)
+        return false;
+
+      objects_.push_back(obj);
+      ids_.push_back(static_cast<size_t>(id));
+      index_of_[id] = objects_.size() - 1;
+    }
+
+    if (!reader.getVarint(count))
+      return false;
+
+    for (uint64_t k = 0; k < count; ++k) {
+      uint64_t id;
+      Object obj(0, 0);
+
+      if (!readBody(reader, id, obj) || id >= next_id_)
+        return false;
+
+      parked_.push_back(obj);
+      parked_ids_.push_back(static_cast<size_t>(id));
+    }
+
+    discontinuity();
+    return true;
+  }
+
+  /** Hash of the bodies (ids, positions and velocities, bit for bit), parked ones and the origin */
+  uint64_t stateHash() const {
+    StateHash hash;
+
+    for (size_t i = 0; i < objects_.size(); ++i) {
+      hash.add(static_cast<uint64_t>(ids_[i]));
+      hash.add(objects_[i].position().x);
+      hash.add(objects_[i].position().y);
+      hash.add(objects_[i].velocity().x);
+      hash.add(objects_[i].velocity().y);
+    }
+
+    for (size_t k = 0; k < parked_.size(); ++k) {
+      hash.add(static_cast<uint64_t>(parked_ids_[k]));
+      hash.add(parked_[k].position().x);
+      hash.add(parked_[k].position().y);
+    }
+
+    hash.add(origin_x_);
+    hash.add(origin_y_);
+    return hash.value();
+  }
+
+  void journalBody(size_t id, const Object& obj) {
+    journal_->putVarint(id);
+    journal_->put(obj.radius());
+    journal_->put(obj.mass());
+    journal_->put(obj.position().x);
+    journal_->put(obj.position().y);
+    journal_->put(obj.velocity().x);
+    journal_->put(obj.velocity().y);
+  }
+
+  /** Journal the body just added with id */
+  void journalAdd(size_t id) {
+    if (!journal_)
+      return;
+
+    journal_->begin(JOURNAL_ADD, steps_);
+    journalBody(id, objects_[index_of_[id]]);
+  }
+
+  void journalSetting(JournalSetting setting, uint64_t value) {
+    if (!journal_)
+      return;
+
+    journal_->begin(JOURNAL_SETTING, steps_);
+    journal_->putVarint(setting);
+    journal_->putVarint(value);
+  }
+
+  /** The settings a journal starts from, every body and what else a replay needs to pick up from here */
+  void journalState() {
+    journal_->begin(JOURNAL_STATE, steps_);
+    journal_->putVarint(boundary_mode_);
+    journal_->putVarint(object_gravity_);
+    journal_->putVarint(restitution_model_);
+    journal_->putVarint(broadphase_mode_);
+    journal_->putVarint(reorder_interval_);
+    journal_->put(reorder_threshold_);
+    journal_->put(rebase_distance_);
+    journal_->putVarint(far_field_policy_);
+    journal_->put(far_field_distance_);
+    journal_->put(global_gravity_.x);
+    journal_->put(global_gravity_.y);
+    journal_->put(origin_x_);
+    journal_->put(origin_y_);
+    journal_->put(step_debt_);
+    journal_->putVarint(next_id_);
+
+    journal_->putVarint(objects_.size());
+    for (size_t i = 0; i < objects_.size(); ++i)
+      journalBody(ids_[i], objects_[i]);
+
+    journal_->putVarint(parked_.size());
+    for (size_t k = 0; k < parked_.size(); ++k)
+      journalBody(parked_ids_[k], parked_[k]);
+
+    journaled_gravity_ = global_gravity_;
+  }
+
+  /** One whole step of dt: the step itself, then metrics, publishing, history and the journal. The caller must hold mutex_ */
+  void stepOnce(Scalar dt) {
+    // gravity is a public member, so changes to it are only noticed here
+    if (journal_ && (global_gravity_.x != journaled_gravity_.x || global_gravity_.y != journaled_gravity_.y)) {
+      journal_->begin(JOURNAL_GRAVITY, steps_);
+      journal_->put(global_gravity_.x);
+      journal_->put(global_gravity_.y);
+      journaled_gravity_ = global_gravity_;
+    }
+
+    if (!metrics_enabled_) {
+      advance(dt);
+    } else {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      contacts_resolved_ = 0;
+      metrics_measured_ = false;
+
+      advance(dt);
+
+      // block timesteps integrate on their own
+      if (!metrics_measured_)
+        measure();
+
+      metrics_.step_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      metrics_.step += 1;
+      metrics_.bodies = objects_.size();
+      metrics_.parked = parked_.size();
+      metrics_.contacts = contacts_resolved_;
+      metrics_.pairs = ops;
+      metrics_.arena_bytes = arena_.used();
+      metrics_.arena_high_water = arena_.highWater();
+      metrics_.arena_heap_allocations = arena_.heapAllocations();
+      metrics_.accumulate(dt);
+
+      if (metrics_exporter_) {
+        TraceScope trace("export metrics");
+        metrics_exporter_->publish(metrics_);
+      }
+    }
+
+    ++steps_;
+
+    if (journal_ && hash_interval_ != 0 && steps_ % hash_interval_ == 0) {
+      journal_->begin(JOURNAL_HASH, steps_);
+      journal_->put(stateHash());
+    }
+
+    if (shared_state_)
+      publishState(dt);
+
+    if (rewind_)
+      captureRewind(dt);
+  }
+
+  void captureRewind(Scalar dt) {
+    TraceScope trace("capture rewind");
+    rewind_->capture(objects_.data(), ids_.data(), objects_.size(), dt, global_gravity_, origin_x_, origin_y_, parked_.data(),
+                     parked_ids_.data(), parked_.size());
+  }
+
+  size_t assignId() {
+    ids_.push_back(next_id_);
+    index_of_.push_back(objects_.size() - 1);
+    return next_id_++;
+  }
+
+  /** Fill morton_ with the Z-order key of every body, in current memory order */
+  void computeMortonKeys() {
+    const size_t count = objects_.size();
+    morton_.resize(count);
+
+    // key over the bodies' bounding box, so unbounded worlds sort just as well
+    Scalar min_x = objects_[0].position().x, max_x = min_x;
+    Scalar min_y = objects_[0].position().y, max_y = min_y;
+
+    for (const Object& obj : objects_) {
+      min_x = std::min(min_x, obj.position().x);
+      max_x = std::max(max_x, obj.position().x);
+      min_y = std::min(min_y, obj.position().y);
+      max_y = std::max(max_y, obj.position().y);
+    }
+
+    const Scalar scale_x = max_x > min_x ? Scalar(65535) / (max_x - min_x) : Scalar(0);
+    const Scalar scale_y = max_y > min_y ? Scalar(65535) / (max_y - min_y) : Scalar(0);
+
+    auto keys = [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        morton_[i].key = mortonKey(objects_[i].position().x, objects_[i].position().y, min_x, min_y, scale_x, scale_y);
+        morton_[i].index = static_cast<uint32_t>(i);
+      }
+    };
+
+    if (pool_)
+      pool_->parallelFor(count, keys);
+    else
+      keys(0, count, 0);
+  }
+
+  /** Fraction of neighbours in memory whose keys are out of order (0 when sorted, ~0.5 when random) */
+  Scalar disorder() const {
+    size_t descents = 0;
+
+    for (size_t i = 1; i < morton_.size(); ++i)
+      descents += morton_[i].key < morton_[i-1].key;
+
+    return static_cast<Scalar>(descents) / static_cast<Scalar>(morton_.size() - 1);
+  }
+
+  /** Sort morton_ and permute the bodies to match, keeping ids stable */
+  void applyMortonOrder() {
+    radixSort(morton_, morton_scratch_, pool_, &arena_.main());
+
+    reorder_objects_.clear();
+    reorder_objects_.reserve(objects_.size());
+    reorder_ids_.resize(objects_.size());
+
+    for (size_t i = 0; i < morton_.size(); ++i) {
+      reorder_objects_.push_back(objects_[morton_[i].index]);
+      reorder_ids_[i] = ids_[morton_[i].index];
+      index_of_[reorder_ids_[i]] = i;
+    }
+
+    objects_.swap(reorder_objects_);
+    ids_.swap(reorder_ids_);
+    steps_since_reorder_ = 0;
+    discontinuity();
+
+    if (neighbour_list_)
+      neighbour_list_->invalidate();
+
+    if (block_timesteps_)
+      block_timesteps_->invalidate();
+  }
+
+  /** Copy the bodies into the shared state segment as one step */
+  void publishState(Scalar dt) {
+    TraceScope trace("publish state");
+    const size_t count = objects_.size();
+
+    if (!shared_state_->beginWrite(count))
+      return;
+
+    Scalar* x = shared_state_->array(STATE_X);
+    Scalar* y = shared_state_->array(STATE_Y);
+    Scalar* vx = shared_state_->array(STATE_VX);
+    Scalar* vy = shared_state_->array(STATE_VY);
+    Scalar* radius = shared_state_->array(STATE_RADIUS);
+    Scalar* mass = shared_state_->array(STATE_MASS);
+    uint64_t* ids = shared_state_->ids();
+
+    for (size_t i = 0; i < count; ++i) {
+      const Object& obj = objects_[i];
+      x[i] = obj.position().x;
+      y[i] = obj.position().y;
+      vx[i] = obj.velocity().x;
+      vy[i] = obj.velocity().y;
+      radius[i] = obj.radius();
+      mass[i] = obj.mass();
+      ids[i] = ids_[i];
+    }
+
+    shared_state_->endWrite(dt, origin_x_, origin_y_, width_, height_);
+  }
+
+  /** Move the origin to the center of mass if it has wandered further than rebase_distance_ from it */
+  void maybeRebase() {
+    if (boundary_mode_ != NONE || rebase_distance_ <= 0 || objects_.empty())
+      return;
+
+    Scalar mass = pairwiseSum<Scalar>(0, objects_.size(), [this](size_t i) { return objects_[i].mass(); });
+    Vec moment = pairwiseSum<Vec>(0, objects_.size(), [this](size_t i) { return objects_[i].mass() * objects_[i].position(); });
+
+    if (mass <= 0)
+      return;
+
+    Vec center = moment / mass;
+
+    if (center.squared() <= rebase_distance_ * rebase_distance_)
+      return;
+
+    TraceScope trace("rebase");
+
+    for (Object& obj : objects_)
+      obj.translate(-center);
+
+    for (Object& obj : parked_)
+      obj.translate(-center);
+
+    origin_x_ += center.x;
+    origin_y_ += center.y;
+    discontinuity();
+  }
+
+  /**
+   *  Without a boundary, park or cull the bodies that are beyond
+   *  far_field_distance_ from the center of mass and on their way out for good,
+   *  let the parked ones coast through dt, and bring back those that have come
+   *  within the distance again.
+   */
+  void maybePark(Scalar dt) {
+    if (boundary_mode_ != NONE || far_field_policy_ == KEEP || (objects_.empty() && parked_.empty()))
+      return;
+
+    TraceScope trace("far field");
+
+    Scalar mass = pairwiseSum<Scalar>(0, objects_.size(), [this](size_t i) { return objects_[i].mass(); });
+    Vec moment = pairwiseSum<Vec>(0, objects_.size(), [this](size_t i) { return objects_[i].mass() * objects_[i].position(); });
+    Vec momentum = pairwiseSum<Vec>(0, objects_.size(), [this](size_t i) { return objects_[i].momentum(); });
+
+    const Vec center = mass > 0 ? moment / mass : Vec();
+    const Vec drift = mass > 0 ? momentum / mass : Vec();
+    const Scalar limit = far_field_distance_ * far_field_distance_;
+
+    // with object gravity the rest pulls a body back unless it is faster than
+    // escape velocity, v^2 >= 2GM/r, from there
+    const Scalar gm = object_gravity_ ? gravitationalConstant<Scalar>() * mass : 0;
+
+    leaving_.clear();
+
+    for (size_t i = 0; i < objects_.size(); ++i) {
+      const Vec r = objects_[i].position() - center;
+      const Scalar distanceSquared = r.squared();
+
+      if (distanceSquared <= limit)
+        continue;
+
+      const Vec v = objects_[i].velocity() - drift;
+
+      if (Vec::dotProduct(r, v) <= 0 || v.squared() * std::sqrt(distanceSquared) < 2 * gm)
+        continue;
+
+      leaving_.push_back(ids_[i]);
+    }
+
+    if (far_field_policy_ == PARK) {
+      for (size_t id : leaving_) {
+        parked_.push_back(objects_[index_of_[id]]);
+        parked_ids_.push_back(id);
+      }
+    } else {
+      culled_ += leaving_.size();
+    }
+
+    removeIds(leaving_.data(), leaving_.size());
+
+    // parked bodies only feel global gravity; the ones back in range rejoin
+    bool returned = false;
+
+    for (size_t k = 0; k < parked_.size(); ++k) {
+      Object& obj = parked_[k];
+
+      if (global_gravity_)
+        obj.update(dt, global_gravity_);
+      else
+        obj.update(dt);
+
+      if ((obj.position() - center).squared() < limit) {
+        objects_.push_back(obj);
+        ids_.push_back(parked_ids_[k]);
+        index_of_[parked_ids_[k]] = objects_.size() - 1;
+        returned = true;
+      }
+    }
+
+    if (returned) {
+      dropParked([this](size_t id) { return index_of_[id] != noIndex(); });
+      invalidateIndices();
+      discontinuity();
+    }
+  }
+
+  /** Drop the parked bodies whose id satisfies drop, returning how many went */
+  template<class Predicate>
+  size_t dropParked(Predicate drop) {
+    size_t kept = 0;
+
+    for (size_t k = 0; k < parked_.size(); ++k) {
+      if (drop(parked_ids_[k]))
+        continue;
+
+      parked_[kept] = parked_[k];
+      parked_ids_[kept] = parked_ids_[k];
+      ++kept;
+    }
+
+    const size_t dropped = parked_.size() - kept;
+    parked_.erase(parked_.begin() + kept, parked_.end());
+    parked_ids_.erase(parked_ids_.begin() + kept, parked_ids_.end());
+    return dropped;
+  }
+
+  /** Indices into objects_ changed meaning, so the structures that hold them start over */
+  void invalidateIndices() {
+    if (neighbour_list_)
+      neighbour_list_->invalidate();
+
+    if (block_timesteps_)
+      block_timesteps_->invalidate();
+  }
+
+  /**
+   *  Take the bodies with the given ids out of objects_, keeping the order of
+   *  the rest; ids that are unknown or not active are skipped. The caller must
+   *  hold mutex_. Returns how many bodies were removed.
+   */
+  size_t removeIds(const size_t* ids, size_t count) {
+    size_t removed = 0;
+
+    for (size_t k = 0; k < count; ++k) {
+      const size_t id = ids[k];
+
+      if (id >= index_of_.size() || index_of_[id] == noIndex())
+        continue;
+
+      // mark for the compaction below
+      ids_[index_of_[id]] = noIndex();
+      index_of_[id] = noIndex();
+      ++removed;
+
+      if (broadphase_)
+        broadphase_->remove(id);
+    }
+
+    if (removed == 0)
+      return 0;
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < objects_.size(); ++i) {
+      if (ids_[i] == noIndex())
+        continue;
+
+      if (kept != i) {
+        objects_[kept] = objects_[i];
+        ids_[kept] = ids_[i];
+      }
+
+      index_of_[ids_[kept]] = kept;
+      ++kept;
+    }
+
+    objects_.erase(objects_.begin() + kept, objects_.end());
+    ids_.erase(ids_.begin() + kept, ids_.end());
+
+    invalidateIndices();
+    discontinuity();
+    return removed;
+  }
+
+  /** removeIds(), and parked bodies with those ids too. The caller must hold mutex_ */
+  size_t removeBodies(const size_t* ids, size_t count) {
+    size_t removed = removeIds(ids, count);
+
+    if (parked_.empty())
+      return removed;
+
+    // parked bodies have no index, so look for them by id
+    std::unordered_set<size_t> gone(ids, ids + count);
+    return removed + dropParked([&gone](size_t id) { return gone.count(id) != 0; });
+  }
+
+  void maybeReorder() {
+    if (objects_.size() < 2 || (reorder_interval_ == 0 && reorder_threshold_ <= 0))
+      return;
+
+    ++steps_since_reorder_;
+
+    TraceScope trace("reorder");
+
+    if (reorder_interval_ != 0 && steps_since_reorder_ >= reorder_interval_) {
+      computeMortonKeys();
+      applyMortonOrder();
+    } else if (reorder_threshold_ > 0) {
+      computeMortonKeys();
+
+      if (disorder() > reorder_threshold_)
+        applyMortonOrder();
+    }
+  }
+
+  /** Collide and separate two touching bodies, recording the contact if anyone is listening */
+  void resolveContact(size_t i, size_t j, Scalar cr) {
+    Object& obj1 = objects_[i];
+    Object& obj2 = objects_[j];
+
+    ++contacts_resolved_;
+
+    if (contact_events_) {
+      Vec point = obj2.position() + (obj1.position() - obj2.position()) * (obj2.radius() / (obj1.radius() + obj2.radius()));
+      Vec before = obj1.velocity();
+
+      Object::collide(obj1, obj2, cr);
+
+      contacts_.record(ids_[i], ids_[j], obj1.mass() * (obj1.velocity() - before).length(), point);
+    } else {
+      Object::collide(obj1, obj2, cr);
+    }
+
+    Object::unoverlap(obj1, obj2);
+  }
+
+  /** Object gravity from the solvers that don't run inside the pair loop */
+  void applySolverGravity() {
+    switch (gravity_solver_) {
+    case DIRECT:
+    case CUTOFF:
+      // both handled in the pair loop
+      break;
+    case PARTICLE_MESH:
+      particle_mesh_->apply(objects_.data(), objects_.size(), width_, height_, pool_, &arena_);
+      break;
+    }
+  }
+
+public:
+  /** Newtonian attraction between two bodies, added to their external forces */
+  static void applyGravity(Object& obj1, Object& obj2) {
+    Vec r = obj2.position() - obj1.position();
+    Scalar distanceSquared = r.squared();
+
+    // guard against objects on top of each other causing infinite gravity
+    if (distanceSquared > 0) {
+      // G*m1*m2/|r|^2 along r/|r|, with a single sqrt
+      Scalar inverseDistance = 1 / std::sqrt(distanceSquared);
+      Vec force((gravitationalConstant<Scalar>() * obj1.mass() * obj2.mass() * inverseDistance * inverseDistance * inverseDistance) * r);
+
+      obj1.addExternalForce(force);
+      obj2.addExternalForce(-force);
+    }
+  }
+
+  /**
+   *  Newtonian attraction scaled by (1 - (r/cutoff)^2)^2, which takes force and
+   *  its slope smoothly to zero at the cutoff so bodies crossing it get no kick.
+   */
+  static void applyCutoffGravity(Object& obj1, Object& obj2, Scalar cutoff) {
+    Vec r = obj2.position() - obj1.position();
+    Scalar distanceSquared = r.squared();
+    Scalar cutoffSquared = cutoff * cutoff;
+
+    if (distanceSquared > 0 && distanceSquared < cutoffSquared) {
+      Scalar inverseDistance = 1 / std::sqrt(distanceSquared);
+      Scalar taper = 1 - distanceSquared / cutoffSquared;
+      Vec force((gravitationalConstant<Scalar>() * obj1.mass() * obj2.mass() * inverseDistance * inverseDistance * inverseDistance * taper * taper) * r);
+
+      obj1.addExternalForce(force);
+      obj2.addExternalForce(-force);
+    }
+  }
+
+private:
+  // runtime dispatch over the step() specializations, one flag at a time
+  template<class Boundary, bool ObjectGravity, bool GlobalGravity>
+  void dispatchRestitution(Scalar dt) {
+    if (restitution_model_ == ELASTIC)
+      step<Boundary, ObjectGravity, GlobalGravity, ElasticRestitution>(dt);
+    else
+      step<Boundary, ObjectGravity, GlobalGravity, InelasticRestitution>(dt);
+  }
+
+  template<class Boundary, bool ObjectGravity>
+  void dispatchGlobalGravity(Scalar dt) {
+    if (global_gravity_)
+      dispatchRestitution<Boundary, ObjectGravity, true>(dt);
+    else
+      dispatchRestitution<Boundary, ObjectGravity, false>(dt);
+  }
+
+  template<class Boundary>
+  void dispatchObjectGravity(Scalar dt) {
+    if (block_timesteps_) {
+      blockStep<Boundary>(dt);
+      return;
+    }
+
+    // only direct summation is fused into the pair loop
+    if (object_gravity_ && gravity_solver_ == DIRECT)
+      dispatchGlobalGravity<Boundary, true>(dt);
+    else
+      dispatchGlobalGravity<Boundary, false>(dt);
+  }
+
+protected:
+  /** A step with no bodies to move still ends the contacts of the one before */
+  void emptyStep() {
+    if (contact_events_) {
+      contacts_.begin();
+      contacts_.finish();
+    }
+  }
+
+  /**
+   *  One simulation step with every configuration choice fixed at compile time.
+   *  The caller must hold mutex_.
+   */
+  template<class Boundary, bool ObjectGravity, bool GlobalGravity, class Restitution>
+  void step(Scalar dt) {
+    if (objects_.empty()) {
+      emptyStep();
+      return;
+    }
+
+    const Scalar collision_cr = Restitution::template collision<Scalar>();
+    const Scalar boundary_cr = Restitution::template boundary<Scalar>();
+
+    if (contact_events_)
+      contacts_.begin();
+
+    // TODO: for testing only
+    size_t compareCount = 0;
+
+    if (gravity_solver_ == CUTOFF) {
+      // the neighbour lists cover contacts as well as the cutoff, so they
+      // stand in for the broadphase too
+      {
+        TraceScope trace("neighbour lists");
+        neighbour_list_->update(objects_.data(), objects_.size(), pool_, &arena_);
+      }
+
+      TraceScope trace("pairs");
+
+      const std::vector<size_t>& offsets = neighbour_list_->offsets();
+      const std::vector<uint32_t>& neighbours = neighbour_list_->neighbours();
+      const Scalar cutoff = neighbour_list_->cutoff();
+      const bool gravity = object_gravity_;
+
+      for (size_t i = 0; i < objects_.size(); ++i)
+      for (size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+        Object& bad1 = objects_[i];
+        Object& bad2 = objects_[neighbours[k]];
+
+        if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+          resolveContact(i, neighbours[k], collision_cr);
+
+        if (gravity)
+          applyCutoffGravity(bad1, bad2, cutoff);
+      }
+
+      compareCount += neighbours.size();
+    } else if (broadphase_) {
+      // collisions only between the candidates the broadphase hands back...
+      pairs_.clear();
+      {
+        TraceScope trace("broadphase");
+        broadphase_->findPairs(objects_.data(), ids_.data(), objects_.size(), pairs_);
+      }
+
+      TraceScope trace("pairs");
+
+      for (const auto& pair : pairs_) {
+        Object& bad1 = objects_[pair.first];
+        Object& bad2 = objects_[pair.second];
+
+        if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+          resolveContact(pair.first, pair.second, collision_cr);
+      }
+
+      compareCount += pairs_.size();
+
+      // ...while pairwise gravity still needs every pair
+      if (ObjectGravity) {
+        for (size_t i = 0; i < objects_.size()-1; ++i)
+        for (size_t j = i+1; j < objects_.size(); ++j)
+          applyGravity(objects_[i], objects_[j]);
+
+        compareCount += objects_.size() * (objects_.size() - 1) / 2;
+      }
+    } else {
+      // gravity and collisions
+      TraceScope trace("pairs");
+
+      for (size_t i = 0; i < objects_.size()-1; ++i)
+      for (size_t j = i+1; j < objects_.size(); ++j) {
+        Object& bad1 = objects_[i];
+        Object& bad2 = objects_[j];
+
+        compareCount++;
+
+        if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+          resolveContact(i, j, collision_cr);
+
+        if (ObjectGravity)
+          applyGravity(bad1, bad2);
+      }
+    }
+
+    ops = compareCount;
+
+    if (!ObjectGravity && object_gravity_) {
+      TraceScope trace("solver gravity");
+      applySolverGravity();
+    }
+
+    if (metrics_enabled_)
+      integrate<Boundary, GlobalGravity, true>(dt, boundary_cr);
+    else
+      integrate<Boundary, GlobalGravity, false>(dt, boundary_cr);
+
+    if (contact_events_)
+      contacts_.finish();
+  }
+
+  /**
+   *  Apply the boundary to every body and move it on by dt. With Measure the
+   *  same pass sums up the metrics' conserved quantities from the updated
+   *  bodies, while they are in registers anyway.
+   */
+  template<class Boundary, bool GlobalGravity, bool Measure>
+  void integrate(Scalar dt, Scalar boundary_cr) {
+    TraceScope trace("integrate");
+
+    double energy = 0, momentum_x = 0, momentum_y = 0;
+    Scalar max_speed_squared = 0;
+
+    for (Object& obj : objects_) {
+      Boundary::apply(obj, width_, height_, boundary_cr);
+
+      if (GlobalGravity)
+        obj.update(dt, global_gravity_);
+      else
+        obj.update(dt);
+
+      if (Measure) {
+        const Scalar speed_squared = obj.velocity().squared();
+        energy += obj.mass() * speed_squared;
+        momentum_x += obj.mass() * obj.velocity().x;
+        momentum_y += obj.mass() * obj.velocity().y;
+        max_speed_squared = std::max(max_speed_squared, speed_squared);
+      }
+    }
 
-  BoundaryMode boundary_mode_;
-  bool object_gravity_;
-  std::mutex mutex_;
+    if (Measure) {
+      metrics_.kinetic_energy = energy / 2;
+      metrics_.momentum_x = momentum_x;
+      metrics_.momentum_y = momentum_y;
+      metrics_.max_speed = std::sqrt(static_cast<double>(max_speed_squared));
+      metrics_measured_ = true;
+    }
+  }
 
-  bool wrapBoundaries(Object& obj) {
-    if (obj.position().x <= 0)
-      obj.setPosition(width_ + obj.position().x, obj.position().y);
-    else if (obj.position().x >= width_)
-      obj.setPosition(obj.position().x - width_, obj.position().y);
-    else if (obj.position().y <= 0)
-      obj.setPosition(obj.position().x, height_ + obj.position().y);
-    else if (obj.position().y >= height_)
-      obj.setPosition(obj.position().x, obj.position().y - height_);
+  /** The metrics' conserved quantities in a pass of their own, for steps that don't go through integrate() */
+  void measure() {
+    double energy = 0, momentum_x = 0, momentum_y = 0;
+    Scalar max_speed_squared = 0;
 
-    return false;
+    for (const Object& obj : objects_) {
+      const Scalar speed_squared = obj.velocity().squared();
+      energy += obj.mass() * speed_squared;
+      momentum_x += obj.mass() * obj.velocity().x;
+      momentum_y += obj.mass() * obj.velocity().y;
+      max_speed_squared = std::max(max_speed_squared, speed_squared);
+    }
+
+    metrics_.kinetic_energy = energy / 2;
+    metrics_.momentum_x = momentum_x;
+    metrics_.momentum_y = momentum_y;
+    metrics_.max_speed = std::sqrt(static_cast<double>(max_speed_squared));
   }
 
-  bool bounceBoundaries(Object& obj, Scalar restitution_factor = 1.0) {
-    if (obj.minX() <= 0) {
-      if (obj.velocity().x < 0)
-        obj.bounceVertical(restitution_factor);
+  /** Acceleration of body i from every other body and global gravity, for block timesteps */
+  Vec accelerationOf(const Object* objects, size_t i) const {
+    Vec acceleration = global_gravity_;
 
-      obj.translateX(-obj.minX());
-    } else if (obj.maxX() >= width_) {
-      if (obj.velocity().x > 0)
-        obj.bounceVertical(restitution_factor);
+    if (!object_gravity_)
+      return acceleration;
 
-      obj.translateX(width_ - obj.maxX());
-    } if (obj.minY() <= 0) {
-      if (obj.velocity().y < 0)
-        obj.bounceHorizontal(restitution_factor);
+    const Vec& position = objects[i].position();
 
-      obj.translateY(-obj.minY());
-    } else if (obj.maxY() >= height_) {
-      if (obj.velocity().y > 0)
-        obj.bounceHorizontal(restitution_factor);
+    for (size_t j = 0; j < objects_.size(); ++j) {
+      Vec r = objects[j].position() - position;
+      Scalar distanceSquared = r.squared();
 
-      obj.translateY(height_ - obj.maxY());
+      if (j != i && distanceSquared > 0) {
+        Scalar inverseDistance = 1 / std::sqrt(distanceSquared);
+        acceleration += (gravitationalConstant<Scalar>() * objects[j].mass() * inverseDistance * inverseDistance * inverseDistance) * r;
+      }
     }
 
-    return false; // TODO: make these void functions...
+    return acceleration;
   }
 
-  static void applyGravity(Object& obj1, Object& obj2) {
-    Vec r = obj2.position() - obj1.position();
+  /**
+   *  Resolve the contacts of the given bodies with every other body, for
+   *  block timesteps. Pairs where both are listed are handled once.
+   */
+  void resolveContactsOf(const std::vector<size_t>& active, Scalar cr) {
+    if (active.size() == objects_.size()) {
+      if (broadphase_) {
+        pairs_.clear();
+        broadphase_->findPairs(objects_.data(), ids_.data(), objects_.size(), pairs_);
 
-    // guard against objects on top of each other causing infinite gravity
-    if (r) {
-      Scalar forceMagnitude = G * obj1.mass() * obj2.mass() / r.squared();
+        for (const auto& pair : pairs_) {
+          Object& bad1 = objects_[pair.first];
+          Object& bad2 = objects_[pair.second];
 
-      Vec force(forceMagnitude, r);
+          if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+            resolveContact(pair.first, pair.second, cr);
+        }
 
-      obj1.addExternalForce(force);
-      obj2.addExternalForce(-force);
+        ops += pairs_.size();
+        return;
+      }
+
+      for (size_t i = 0; i < objects_.size()-1; ++i)
+      for (size_t j = i+1; j < objects_.size(); ++j) {
+        Object& bad1 = objects_[i];
+        Object& bad2 = objects_[j];
+
+        if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+          resolveContact(i, j, cr);
+      }
+
+      ops += objects_.size() * (objects_.size() - 1) / 2;
+      return;
+    }
+
+    active_mark_.assign(objects_.size(), false);
+    for (size_t i : active)
+      active_mark_[i] = true;
+
+    for (size_t i : active)
+    for (size_t j = 0; j < objects_.size(); ++j) {
+      if (j == i || (active_mark_[j] && j < i))
+        continue;
+
+      Object& bad1 = objects_[std::min(i, j)];
+      Object& bad2 = objects_[std::max(i, j)];
+
+      if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius())
+        resolveContact(std::min(i, j), std::max(i, j), cr);
+    }
+
+    ops += active.size() * objects_.size();
+  }
+
+  /**
+   *  With first touch placement, copy the body arrays into fresh ones of
+   *  exactly their length whenever they have grown, so that every page is
+   *  placed by the worker that handles that part of the bodies again.
+   */
+  void maybeLayOut() {
+    if (!first_touch_ || objects_.capacity() == objects_.size())
+      return;
+
+    TraceScope trace("lay out");
+    Objects(objects_.begin(), objects_.end(), objects_.get_allocator()).swap(objects_);
+    Ids(ids_.begin(), ids_.end(), ids_.get_allocator()).swap(ids_);
+  }
+
+  /** One step of the current configuration, without publishing or recording it; the caller must hold mutex_ */
+  void advance(Scalar dt) {
+    arena_.reset();
+    maybeLayOut();
+    maybeRebase();
+    maybePark(dt);
+    maybeReorder();
+
+    switch (boundary_mode_) {
+    case NONE:
+      dispatchObjectGravity<NoBoundary>(dt);
+      break;
+    case WRAP:
+      dispatchObjectGravity<WrapBoundary>(dt);
+      break;
+    case BOUNCE:
+      dispatchObjectGravity<BounceBoundary>(dt);
+      break;
+    }
+  }
+
+  /**
+   *  One step with individual block timesteps: every body is integrated on
+   *  its own level, and its contacts are resolved whenever one of its steps
+   *  ends. The caller must hold mutex_.
+   */
+  template<class Boundary>
+  void blockStep(Scalar dt) {
+    if (objects_.empty()) {
+      emptyStep();
+      return;
     }
+
+    const bool elastic = restitution_model_ == ELASTIC;
+    const Scalar collision_cr = elastic ? ElasticRestitution::collision<Scalar>() : InelasticRestitution::collision<Scalar>();
+    const Scalar boundary_cr = elastic ? ElasticRestitution::boundary<Scalar>() : InelasticRestitution::boundary<Scalar>();
+    const Scalar width = width_;
+    const Scalar height = height_;
+
+    if (contact_events_)
+      contacts_.begin();
+
+    ops = 0;
+
+    TraceScope trace("block timesteps");
+    block_timesteps_->advance(objects_.data(), objects_.size(), dt,
+        [this](const Object* objects, size_t i) { return accelerationOf(objects, i); },
+        [=](Object& obj) { Boundary::apply(obj, width, height, boundary_cr); },
+        [=](const std::vector<size_t>& active) { resolveContactsOf(active, collision_cr); },
+        pool_);
+
+    ops += block_timesteps_->evaluations() * objects_.size();
+
+    if (contact_events_)
+      contacts_.finish();
   }
 
+  std::mutex& mutex() { return mutex_; }
+
 public:
   // TODO: make this private...
   // gravity's acceleration vector
   Vec global_gravity_;
 
   Space(size_t width, size_t height, BoundaryMode boundaryMode = BoundaryMode::BOUNCE, const Vec& gravity = Vec())
-      : width_(width), height_(height), boundary_mode_(boundaryMode), object_gravity_(true), global_gravity_(gravity) {
+      : width_(width), height_(height), first_touch_(false), objects_(BodyAllocator<Object>(&memory_)),
+        ids_(BodyAllocator<size_t>(&memory_)), next_id_(0), boundary_mode_(boundaryMode), object_gravity_(true), gravity_solver_(DIRECT),
+        restitution_model_(INELASTIC), contact_events_(false), pool_(nullptr), broadphase_mode_(BRUTE_FORCE),
+        reorder_interval_(0), reorder_threshold_(0), steps_since_reorder_(0), morton_(BodyAllocator<MortonEntry>(&memory_)),
+        morton_scratch_(BodyAllocator<MortonEntry>(&memory_)), reorder_objects_(BodyAllocator<Object>(&memory_)),
+        reorder_ids_(BodyAllocator<size_t>(&memory_)), origin_x_(0), origin_y_(0),
+        rebase_distance_(0), far_field_policy_(KEEP), far_field_distance_(0), culled_(0),
+        metrics_enabled_(false), metrics_measured_(false), metrics_exporter_(nullptr), contacts_resolved_(0),
+        seed_(std::mt19937_64::default_seed), fixed_step_(0), step_debt_(0), steps_(0), hash_interval_(0), global_gravity_(gravity) {
   }
 
-  const std::vector<Object>& objects() { return objects_; }
+  const Objects& objects() const { return objects_; }
 
-  void addRandomCircle() {
-    std::lock_guard<std::mutex> lock(mutex_);
+  /** Stable ids of the bodies, in the same order as objects() */
+  const Ids& ids() const { return ids_; }
+
+  /**
+   *  Call visit(objects(), ids(), originX(), originY()) under the lock update()
+   *  takes, so a thread other than the one stepping sees one whole step
+   */
+  template<typename Visit>
+  void visit(Visit visit) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    const Objects& objects = objects_;
+    const Ids& ids = ids_;
+    visit(objects, ids, origin_x_, origin_y_);
+  }
+
+  static size_t noIndex() { return static_cast<size_t>(-1); }
+
+  /** Current index in objects() of the body with the given id, or noIndex() if it is gone or parked */
+  size_t indexOf(size_t id) const { return id < index_of_.size() ? index_of_[id] : noIndex(); }
+
+  size_t addRandomCircle() {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
 
     // TODO: clean this up
-    static std::uniform_real_distribution<Scalar> radius(3, 15);
+    std::uniform_real_distribution<Scalar> radius(3, 15);
 
-    Scalar rad = radius(randGen);
+    Scalar rad = radius(rng_);
     Scalar mass = rad * rad;
 
-    static std::normal_distribution<Scalar> velocity(0.0, 200);
+    std::normal_distribution<Scalar> velocity(0.0, 200);
+
+    std::uniform_real_distribution<Scalar> xVal(101, width_-101);
+    std::uniform_real_distribution<Scalar> yVal(101, height_-101);
 
-    static std::uniform_real_distribution<Scalar> xVal(101, width_-101);
-    static std::uniform_real_distribution<Scalar> yVal(101, height_-101);
+    // one draw per statement, so the order doesn't depend on the compiler
+    const Scalar x = xVal(rng_);
+    const Scalar y = yVal(rng_);
+    const Scalar vx = velocity(rng_);
+    const Scalar vy = velocity(rng_);
 
-    objects_.emplace_back(rad, mass, Vec(xVal(randGen), yVal(randGen)), Vec(velocity(randGen), velocity(randGen)));
+    objects_.emplace_back(rad, mass, Vec(x, y), Vec(vx, vy));
+    discontinuity();
 
     std::cout << "Just created " << objects_.back() << " for a total of " << objects_.size() << std::endl;
+
+    const size_t id = assignId();
+    journalAdd(id);
+    return id;
   }
 
-  void addRandomCircle(Scalar x, Scalar y, Scalar mass = 0, Scalar rad = 0) {
-    std::lock_guard<std::mutex> lock(mutex_);
+  size_t addRandomCircle(Scalar x, Scalar y, Scalar mass = 0, Scalar rad = 0) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
 
     // TODO: clean this up
-    static std::uniform_real_distribution<Scalar> radius(5, 10);
+    std::uniform_real_distribution<Scalar> radius(5, 10);
 
     if (rad == 0)
-      rad = radius(randGen);
+      rad = radius(rng_);
 
     if (mass == 0)
       mass = rad * rad;
 
     objects_.emplace_back(rad, mass, Vec(x, y), Vec());
+    discontinuity();
+
+    const size_t id = assignId();
+    journalAdd(id);
+    return id;
   }
 
+  /** Add a circle, returning its id */
   template<typename... Args>
-  void addCircle(Args&&... args) {
-    std::lock_guard<std::mutex> lock(mutex_);
+  size_t addCircle(Args&&... args) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
     objects_.emplace_back(args...);
+    discontinuity();
+
+    const size_t id = assignId();
+    journalAdd(id);
+    return id;
+  }
+
+  /** Bodies addCircles() has generated at a time */
+  static size_t addBlock() { return 4096; }
+
+  /**
+   *  Add count circles at once, written straight into the body array by
+   *  generate(begin, end, out), which makes bodies begin to end of the batch
+   *  in out[0] to out[end - begin - 1]. The batch is cut into blocks of
+   *  addBlock() bodies generated in parallel on the thread pool; the cuts
+   *  depend only on count, so a generator that seeds by block makes the same
+   *  bodies whatever the pool. Returns the id of the first body, the rest
+   *  follow in order.
+   */
+  template<class Generate>
+  size_t addCircles(size_t count, Generate generate) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    TraceScope trace("add circles");
+
+    const size_t first = objects_.size();
+    const size_t first_id = next_id_;
+
+    objects_.resize(first + count, Object(0, 0));
+    ids_.resize(first + count);
+    index_of_.resize(first_id + count);
+
+    const size_t block = addBlock();
+
+    auto fill = [&](size_t begin_block, size_t end_block, size_t) {
+      for (size_t b = begin_block; b < end_block; ++b) {
+        const size_t begin = b * block, end = std::min(count, begin + block);
+        generate(begin, end, &objects_[first + begin]);
+
+        for (size_t k = begin; k < end; ++k) {
+          ids_[first + k] = first_id + k;
+          index_of_[first_id + k] = first + k;
+        }
+      }
+    };
+
+    const size_t blocks = (count + block - 1) / block;
+
+    if (pool_)
+      pool_->parallelFor(blocks, fill);
+    else
+      fill(0, blocks, 0);
+
+    next_id_ += count;
+    discontinuity();
+
+    for (size_t k = 0; journal_ && k < count; ++k)
+      journalAdd(first_id + k);
+
+    return first_id;
+  }
+
+  /**
+   *  Take the bodies with the given ids out of the simulation, keeping the
+   *  order of the rest; ids that are unknown or already gone are skipped.
+   *  Parked bodies can be removed too. Returns how many bodies were removed.
+   */
+  size_t removeCircles(const size_t* ids, size_t count) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (journal_) {
+      journal_->begin(JOURNAL_REMOVE, steps_);
+      journal_->putVarint(count);
+
+      for (size_t k = 0; k < count; ++k)
+        journal_->putVarint(ids[k]);
+    }
+
+    return removeBodies(ids, count);
+  }
+
+  size_t removeCircle(size_t id) { return removeCircles(&id, 1); }
+
+  /** Make room for count bodies in all, so adding a batch doesn't reallocate along the way */
+  void reserve(size_t count) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    objects_.reserve(count);
+    ids_.reserve(count);
   }
 
+  /**
+   *  Advance the simulation, dispatching to the step() specialized for the
+   *  current configuration. With a fixed step (setDeterministic()), dt is
+   *  only how much time has passed: as many fixed steps are taken as it
+   *  covers, the remainder is carried over to the next call, and at most 8
+   *  steps' worth is ever owed, so a stall is dropped instead of caught up.
+   */
   void update(Scalar dt) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // the scope ends after the lock is released, so a stall trigger on it
+    // writes its trace without holding up the threads waiting on the Space
+    TraceScope trace("Space::update");
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
 
-    if (objects_.empty())
+    if (fixed_step_ <= 0) {
+      stepOnce(dt);
       return;
+    }
 
-    // TODO: for testing only
-    size_t compareCount = 0;
+    step_debt_ = std::min(step_debt_ + dt, 8 * fixed_step_);
+
+    while (step_debt_ >= fixed_step_) {
+      step_debt_ -= fixed_step_;
+      stepOnce(fixed_step_);
+    }
+  }
 
-    // gravity and collisions
-    for (size_t i = 0; i < objects_.size()-1; ++i)
-    for (size_t j = i+1; j < objects_.size(); ++j) {
-      Object& bad1 = objects_[i];
-      Object& bad2 = objects_[j];
+  /** Steps taken so far */
+  uint64_t steps() const { return steps_; }
 
-      compareCount++;
+  BoundaryMode boundaryMode() const { return boundary_mode_; }
 
-      if (Object::distance(bad1, bad2) <= bad1.radius() + bad2.radius()) {
-        Object::collide(bad1, bad2);
-        Object::unoverlap(bad1, bad2);
-      }
+  void setBoundaryMode(BoundaryMode mode) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    boundary_mode_ = mode;
+    journalSetting(SETTING_BOUNDARY, mode);
+  }
+
+  bool objectGravity() const { return object_gravity_; }
+
+  void setObjectGravity(bool enabled) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    object_gravity_ = enabled;
+    journalSetting(SETTING_OBJECT_GRAVITY, enabled);
+  }
+
+  GravitySolver gravitySolver() const { return gravity_solver_; }
+
+  /** Choose how object gravity is computed (when it is enabled at all) */
+  void setGravitySolver(GravitySolver solver) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    gravity_solver_ = solver;
+
+    if (solver == PARTICLE_MESH && !particle_mesh_)
+      particle_mesh_.reset(new ParticleMesh<Scalar, Vec>());
+
+    if (solver == CUTOFF && !neighbour_list_)
+      neighbour_list_.reset(new NeighbourList<Scalar, Vec>(std::min(width_, height_) / 16));
+  }
 
-      if (object_gravity_)
-        applyGravity(bad1, bad2);
+  /**
+   *  Set up the particle-mesh solver and switch to it. The grid sizes have to
+   *  be powers of two (2, 4, ... 128, ...) for the FFT; for any other size
+   *  nothing changes and it returns false.
+   *
+   *  @param gridX, gridY grid cells along each axis, powers of two
+   *  @param splitRadius 0 for pure PM, otherwise pairs closer than this also get a direct short-range correction (P3M)
+   */
+  bool setParticleMesh(size_t gridX, size_t gridY, MeshAssignment assignment = ParticleMesh<Scalar, Vec>::CIC, Scalar splitRadius = 0) {
+    if (!ParticleMesh<Scalar, Vec>::validGridSize(gridX) || !ParticleMesh<Scalar, Vec>::validGridSize(gridY))
+      return false;
+
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    particle_mesh_.reset(new ParticleMesh<Scalar, Vec>(gridX, gridY, assignment, splitRadius));
+    gravity_solver_ = PARTICLE_MESH;
+    return true;
+  }
+
+  /**
+   *  Switch to cutoff gravity: only bodies closer than cutoff attract, and
+   *  both gravity and contacts come from neighbour lists rebuilt whenever some
+   *  body has moved more than skin/2 (0 picks cutoff/5).
+   */
+  void setCutoffGravity(Scalar cutoff, Scalar skin = 0) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    neighbour_list_.reset(new NeighbourList<Scalar, Vec>(cutoff, skin));
+    gravity_solver_ = CUTOFF;
+  }
+
+  /** The cutoff solver's lists, for tuning the skin; nullptr until CUTOFF has been used */
+  const NeighbourList<Scalar, Vec>* neighbourList() const { return neighbour_list_.get(); }
+
+  /**
+   *  Give every body its own power-of-two fraction of the step passed to
+   *  update(), down to dt / 2^maxLevel, so only the bodies that need tiny steps
+   *  pay for them. Gravity is summed directly for whichever bodies are due,
+   *  whatever the gravity solver. maxLevel 0 turns block timesteps off.
+   */
+  void setBlockTimesteps(unsigned maxLevel, Scalar eta = 0.25) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (maxLevel == 0)
+      block_timesteps_.reset();
+    else
+      block_timesteps_.reset(new BlockTimesteps<Scalar, Vec>(maxLevel, eta));
+  }
+
+  /** The block timestep scheduler for inspecting levels, nullptr when off */
+  const BlockTimesteps<Scalar, Vec>* blockTimesteps() const { return block_timesteps_.get(); }
+
+  /**
+   *  Without a boundary, keep positions relative to a movable origin and move
+   *  it to the center of mass whenever that is more than distance away (0
+   *  never does). Positions near zero keep the most precision, which matters
+   *  in single precision once bodies drift far from where they started.
+   */
+  void setRebaseDistance(Scalar distance) { rebase_distance_ = distance; }
+
+  /**
+   *  Without a boundary, deal with bodies that have escaped: once one is
+   *  further than distance from the center of mass, moving away from it, and
+   *  (with object gravity) faster than the escape velocity from there, PARK
+   *  takes it out of the step into parked(), where it coasts under global
+   *  gravity alone until it is back within distance, and CULL removes it.
+   *  Either way stray debris stops costing the broadphase and gravity
+   *  anything, and stops stretching the bounds that Morton keys, rebasing and
+   *  the render camera are computed over. Parked bodies keep their ids but
+   *  have no index, and energy() and momentum() leave them out. KEEP, the
+   *  default, brings every parked body back on the next step.
+   */
+  void setFarField(FarFieldPolicy policy, Scalar distance) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    far_field_policy_ = policy;
+    far_field_distance_ = distance;
+
+    if (policy != KEEP || parked_.empty())
+      return;
+
+    for (size_t k = 0; k < parked_.size(); ++k) {
+      objects_.push_back(parked_[k]);
+      ids_.push_back(parked_ids_[k]);
+      index_of_[parked_ids_[k]] = objects_.size() - 1;
     }
 
-    ops = compareCount;
+    parked_.clear();
+    parked_ids_.clear();
+    invalidateIndices();
+    discontinuity();
+  }
 
-    for (Object& obj : objects_) {
+  FarFieldPolicy farFieldPolicy() const { return far_field_policy_; }
 
-      // TODO: move this check elsewhere?
-      if (boundary_mode_ == BOUNCE) {
-        bounceBoundaries(obj);
-      } else if (boundary_mode_ == WRAP) {
-        wrapBoundaries(obj);
-      }
+  /** Bodies taken out of the step by PARK, with their ids */
+  const std::vector<Object>& parked() const { return parked_; }
+
+  const std::vector<size_t>& parkedIds() const { return parked_ids_; }
+
+  /** Bodies removed by CULL so far */
+  size_t culled() const { return culled_; }
+
+  /** World coordinates of the origin: a body is at position() + (originX(), originY()) */
+  double originX() const { return origin_x_; }
+
+  double originY() const { return origin_y_; }
+
+  /**
+   *  Publish the bodies after every step to the shared memory segment called
+   *  name (e.g. "/flatics"), for other processes to read in place with a
+   *  SharedStateReader. capacity presizes it; it grows as needed anyway. An
+   *  empty name stops publishing. Returns false if the segment couldn't be made.
+   */
+  bool setSharedState(const std::string& name, size_t capacity = 0) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    shared_state_.reset();
+
+    if (name.empty())
+      return true;
+
+    std::unique_ptr<SharedStateWriter<Scalar> > writer(new SharedStateWriter<Scalar>());
+
+    if (!writer->open(name, std::max(capacity, objects_.size())))
+      return false;
+
+    shared_state_ = std::move(writer);
+    return true;
+  }
+
+  /**
+   *  Measure every step as a by-product of it: body count, kinetic energy,
+   *  momentum and top speed summed up in the integration pass (in double,
+   *  after the step), contacts resolved, pairs tested and the wall time of
+   *  update(), with running totals, for metrics(). exporter, if given, gets
+   *  them after every update(); it is owned elsewhere and must outlive its
+   *  use here. Unlike energy() and momentum() this costs no pass of its own,
+   *  except with block timesteps. Enabling starts the totals over.
+   */
+  void setMetrics(bool enabled, MetricsExporter* exporter = nullptr) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    metrics_enabled_ = enabled;
+    metrics_exporter_ = enabled ? exporter : nullptr;
+    metrics_.reset();
+  }
+
+  /** The last step's metrics; read it from the thread driving update() */
+  const StepMetrics& metrics() const { return metrics_; }
+
+  /**
+   *  The scratch memory of the steps: what the last one used, the high-water
+   *  mark and how often it has had to grow. Read it from the thread driving
+   *  update().
+   */
+  const StepArena& arena() const { return arena_; }
 
-      obj.update(dt, global_gravity_);
+  /**
+   *  Keep the recent history for rewind(): a keyframe of every body each
+   *  keyframeInterval steps and quantized changes in between, within maxBytes.
+   *  Starts from the current state; 0 bytes turns it off and drops the history.
+   */
+  void setRewind(size_t keyframeInterval, size_t maxBytes) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (maxBytes == 0) {
+      rewind_.reset();
+      return;
     }
+
+    rewind_.reset(new RewindBuffer<Scalar, Vec>(keyframeInterval, maxBytes));
+    captureRewind(0);
   }
 
-  Scalar energy() const {
-    Scalar total = 0;
+  /** The history, e.g. to decode() past steps for display; nullptr when off */
+  const RewindBuffer<Scalar, Vec>* rewindBuffer() const { return rewind_.get(); }
 
-    for (const Object& obj : objects_) {
-      total += obj.energy();
+  /**
+   *  Go back steps updates, or as far as the history reaches: restore the
+   *  keyframe at or before then and step forward again with the recorded dt
+   *  and global gravity, with the bodies parked then parked again as they
+   *  were. Settings changed since apply to the replayed steps, and contacts
+   *  may resolve in a different order once the broadphase is rebuilt.
+   *  History after the restored step is dropped. Returns how many steps back
+   *  it went.
+   */
+  size_t rewind(size_t steps) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    TraceScope trace("rewind");
+
+    if (!rewind_)
+      return 0;
+
+    // a journal only goes forward
+    closeJournal();
+
+    const uint64_t latest = rewind_->latest();
+    const uint64_t target = latest - std::min<uint64_t>(steps, latest - rewind_->oldest());
+    const typename RewindBuffer<Scalar, Vec>::State* key = rewind_->keyframeBefore(target);
+
+    if (!key)
+      return 0;
+
+    objects_.clear();
+    ids_.assign(key->ids.begin(), key->ids.end());
+    std::fill(index_of_.begin(), index_of_.end(), noIndex());
+
+    for (size_t i = 0; i < key->size(); ++i) {
+      objects_.emplace_back(key->radius[i], key->mass[i], Vec(key->x[i], key->y[i]), Vec(key->vx[i], key->vy[i]));
+      index_of_[ids_[i]] = i;
+    }
+
+    origin_x_ = key->origin_x;
+    origin_y_ = key->origin_y;
+    global_gravity_ = key->gravity;
+    parked_.assign(key->parked.begin(), key->parked.end());
+    parked_ids_.assign(key->parked_ids.begin(), key->parked_ids.end());
+    contacts_.clear();
+
+    if (broadphase_)
+      broadphase_->clear();
+
+    if (neighbour_list_)
+      neighbour_list_->invalidate();
+
+    if (block_timesteps_)
+      block_timesteps_->invalidate();
+
+    for (uint64_t step = key->step + 1; step <= target; ++step) {
+      global_gravity_ = rewind_->gravityOf(step);
+      advance(rewind_->dtOf(step));
     }
 
-    return total;
+    rewind_->truncate(target);
+    steps_ -= latest - target;
+
+    if (shared_state_)
+      publishState(0);
+
+    return static_cast<size_t>(latest - target);
   }
 
-  Vec momentum() const {
-    Vec total;
+  /**
+   *  Deterministic execution: reseed this space's random numbers and take
+   *  steps of exactly fixedStep whatever dt update() is given (see update()).
+   *  Two spaces set up alike, given the same changes before the same steps,
+   *  then evolve bit for bit alike, on the same build and the same number of
+   *  pool workers. A fixedStep of 0 goes back to stepping by dt.
+   */
+  void setDeterministic(uint64_t seed, Scalar fixedStep) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    seed_ = seed;
+    rng_.seed(seed);
+    fixed_step_ = fixedStep > 0 ? fixedStep : 0;
+    step_debt_ = 0;
+  }
 
-    for (const Object& obj : objects_) {
-      total += obj.momentum();
+  Scalar fixedStep() const { return fixed_step_; }
+
+  uint64_t seed() const { return seed_; }
+
+  /**
+   *  Record a journal (see Journal.h) at path from now on: the current state,
+   *  then every change made through this class (bodies added or removed,
+   *  clear(), energize(), halt(), gravity, and the boundary, object gravity,
+   *  restitution and broadphase settings) with the step it came before, and
+   *  a hash of the state every hashInterval steps (0 never). Other settings
+   *  are only recorded as they are now. Needs a fixed step; returns false
+   *  without one or if the file can't be created. Recording ends with
+   *  stopJournal(), rewind() or the Space going away.
+   */
+  bool startJournal(const std::string& path, uint64_t hashInterval = 60) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    closeJournal();
+
+    if (fixed_step_ <= 0)
+      return false;
+
+    JournalHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = JournalHeader::MAGIC;
+    header.version = JournalHeader::VERSION;
+    header.scalar_size = sizeof(Scalar);
+    header.threads = pool_ ? static_cast<uint32_t>(pool_->size()) : 0;
+    header.seed = seed_;
+    header.step = fixed_step_;
+    header.width = width_;
+    header.height = height_;
+    header.hash_interval = hashInterval;
+
+    journal_.reset(new JournalWriter());
+
+    if (!journal_->open(path, header)) {
+      journal_.reset();
+      return false;
+    }
+
+    hash_interval_ = hashInterval;
+    journalState();
+    return true;
+  }
+
+  /** End the journal with the final state's hash */
+  void stopJournal() {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    closeJournal();
+  }
+
+  bool journaling() const { return journal_ != nullptr; }
+
+  /** Bytes of journal written so far */
+  uint64_t journalBytes() const { return journal_ ? journal_->bytes() : 0; }
+
+  /**
+   *  Re-execute the session journaled at path, as fast as it will go: load
+   *  its starting state, then step with its fixed step, applying each change
+   *  before the step it was made before and comparing the state hashes along
+   *  the way. Configure this space as the recording one was beyond what the
+   *  journal holds (thread pool, gravity solver, neighbour list, ...) or it
+   *  diverges. The bodies and settings are replaced; false if path isn't a
+   *  journal for this Scalar. A cut off journal replays as far as it goes.
+   */
+  bool replay(const std::string& path, JournalReplay& result) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    TraceScope trace("Space::replay");
+    std::memset(&result, 0, sizeof(result));
+    closeJournal();
+
+    JournalReader reader;
+
+    if (!reader.open(path) || reader.header().scalar_size != sizeof(Scalar))
+      return false;
+
+    const JournalHeader& header = reader.header();
+    width_ = static_cast<size_t>(header.width);
+    height_ = static_cast<size_t>(header.height);
+    seed_ = header.seed;
+    rng_.seed(seed_);
+    fixed_step_ = static_cast<Scalar>(header.step);
+
+    JournalRecordType type;
+    uint64_t step;
+
+    if (!reader.next(type, step) || type != JOURNAL_STATE || !readState(reader))
+      return false;
+
+    steps_ = step;
+    const uint64_t first = step;
+
+    auto diverged = [&result](uint64_t at) {
+      if (result.diverged_step == 0)
+        result.diverged_step = at;
+    };
+
+    while (reader.next(type, step)) {
+      while (steps_ < step)
+        stepOnce(fixed_step_);
+
+      ++result.records;
+      bool read = true;
+      Scalar values[6];
+      uint64_t value, hash = 0;
+
+      switch (type) {
+      case JOURNAL_ADD:
+        read = reader.getVarint(value) && readValues(reader, values, 6);
+
+        if (read) {
+          if (value != next_id_)
+            diverged(step);
+
+          objects_.emplace_back(values[0], values[1], Vec(values[2], values[3]), Vec(values[4], values[5]));
+          assignId();
+          discontinuity();
+        }
+        break;
+
+      case JOURNAL_REMOVE: {
+        std::vector<size_t> ids;
+        read = reader.getVarint(value);
+
+        for (uint64_t k = 0; read && k < value; ++k) {
+          uint64_t id;
+          read = reader.getVarint(id);
+          ids.push_back(static_cast<size_t>(id));
+        }
+
+        if (read)
+          removeBodies(ids.data(), ids.size());
+        break;
+      }
+
+      case JOURNAL_CLEAR:
+        clearBodies();
+        break;
+
+      case JOURNAL_ENERGIZE:
+        read = readValues(reader, values, 1);
+
+        for (size_t i = 0; read && i < objects_.size(); ++i)
+          objects_[i].scaleVelocity(values[0]);
+
+        discontinuity();
+        break;
+
+      case JOURNAL_HALT:
+        for (Object& obj : objects_)
+          obj.setVelocity(Vec());
+
+        discontinuity();
+        break;
+
+      case JOURNAL_GRAVITY:
+        read = readValues(reader, values, 2);
+
+        if (read)
+          global_gravity_ = Vec(values[0], values[1]);
+        break;
+
+      case JOURNAL_SETTING: {
+        uint64_t setting;
+        read = reader.getVarint(setting) && reader.getVarint(value);
+
+        if (read)
+          applySetting(static_cast<JournalSetting>(setting), value);
+        break;
+      }
+
+      case JOURNAL_HASH:
+      case JOURNAL_END:
+        read = reader.get(hash);
+
+        if (read) {
+          ++result.hashes;
+
+          if (hash != stateHash())
+            diverged(step);
+        }
+
+        result.complete = read && type == JOURNAL_END;
+        break;
+
+      default:
+        read = false;
+      }
+
+      if (!read || result.complete)
+        break;
+    }
+
+    result.steps = steps_ - first;
+    result.simulated_seconds = static_cast<double>(result.steps) * fixed_step_;
+    return true;
+  }
+
+  RestitutionModel restitutionModel() const { return restitution_model_; }
+
+  void setRestitutionModel(RestitutionModel model) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    restitution_model_ = model;
+    journalSetting(SETTING_RESTITUTION, model);
+  }
+
+  bool contactEvents() const { return contact_events_; }
+
+  /** Start or stop collecting contact events; nothing is recorded while disabled */
+  void setContactEvents(bool enabled) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    contact_events_ = enabled;
+    contacts_.clear();
+  }
+
+  /** Workers for the parallel parts of a step (Morton sorting, ...); nullptr runs them serially */
+  void setThreadPool(ThreadPool* pool) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    pool_ = pool;
+    memory_.first_touch = first_touch_ ? pool : nullptr;
+    arena_.setWorkers(pool ? pool->size() : 1);
+
+    if (broadphase_)
+      broadphase_->setThreadPool(pool);
+  }
+
+  /**
+   *  How the body arrays (bodies, ids, Morton keys) are allocated. Arrays of
+   *  2MB or more are mapped on their own; hugePages backs them with 2MB pages
+   *  (reserved ones if there are any, else transparent huge pages), cutting
+   *  TLB misses with millions of bodies. firstTouch has the thread pool's
+   *  workers touch each new array first, so on a NUMA machine every part of
+   *  it ends up on the node of the worker that steps those bodies; pin the
+   *  pool (ThreadPool::pin()) so the workers stay there. The current arrays
+   *  are copied over right away. Both off is what a plain std::vector does.
+   */
+  void setMemoryPolicy(bool hugePages, bool firstTouch) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    memory_.huge_pages = hugePages;
+    first_touch_ = firstTouch;
+    memory_.first_touch = firstTouch ? pool_ : nullptr;
+
+    Objects(objects_.begin(), objects_.end(), objects_.get_allocator()).swap(objects_);
+    Ids(ids_.begin(), ids_.end(), ids_.get_allocator()).swap(ids_);
+    morton_.clear();
+    morton_.shrink_to_fit();
+    morton_scratch_.clear();
+    morton_scratch_.shrink_to_fit();
+    Objects(reorder_objects_.get_allocator()).swap(reorder_objects_);
+    Ids(reorder_ids_.get_allocator()).swap(reorder_ids_);
+  }
+
+  /** What the big body arrays allocated so far were backed by */
+  const MemoryPolicy& memoryPolicy() const { return memory_; }
+
+  BroadphaseMode broadphaseMode() const { return broadphase_mode_; }
+
+  /** Choose how collision candidates are found; switching starts the new structure from scratch */
+  void setBroadphase(BroadphaseMode mode) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    resetBroadphase(mode);
+    journalSetting(SETTING_BROADPHASE, mode);
+  }
+
+private:
+  void resetBroadphase(BroadphaseMode mode) {
+    broadphase_mode_ = mode;
+
+    switch (mode) {
+    case BRUTE_FORCE:
+      broadphase_.reset();
+      break;
+    case AABB_TREE:
+      broadphase_.reset(new AabbTree<Scalar, Vec>());
+      break;
+    case SWEEP_AND_PRUNE:
+      broadphase_.reset(new SweepAndPrune<Scalar, Vec>());
+      break;
+    case SPATIAL_HASH:
+      broadphase_.reset(new SpatialHash<Scalar, Vec>());
+      break;
+    }
+
+    if (broadphase_) {
+      broadphase_->setThreadPool(pool_);
+      broadphase_->setArena(&arena_);
     }
+  }
 
-    return total;
+public:
+  /** The active broadphase for tuning (e.g. dynamic_cast to AabbTree, SweepAndPrune or SpatialHash), nullptr for BRUTE_FORCE */
+  Broadphase<Scalar, Vec>* broadphase() { return broadphase_.get(); }
+
+  /**
+   *  Keep bodies that are close in space close in memory by sorting them along a
+   *  Z-order curve every interval steps, and/or whenever the fraction of
+   *  out-of-order neighbours in memory exceeds disorderThreshold. 0 disables a criterion.
+   *  The first reorder sets aside a second copy of the body arrays to sort
+   *  into, which every later one reuses.
+   */
+  void setReorderPolicy(size_t interval, Scalar disorderThreshold = 0) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    reorder_interval_ = interval;
+    reorder_threshold_ = disorderThreshold;
+    steps_since_reorder_ = 0;
+  }
+
+  /** Sort the bodies into Z-order now; ids stay valid, indices do not */
+  void reorder() {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (objects_.size() < 2)
+      return;
+
+    computeMortonKeys();
+    applyMortonOrder();
+  }
+
+  /**
+   *  The begin/persist/end contact events of the last step, ordered by body ids.
+   *  Valid until the next update(); read it from the thread driving update().
+   */
+  const std::vector<Contact>& contacts() const { return contacts_.events(); }
+
+  // pairwise sums, so single precision totals stay accurate over many bodies
+  Scalar energy() const {
+    return pairwiseSum<Scalar>(0, objects_.size(), [this](size_t i) { return objects_[i].energy(); });
+  }
+
+  Vec momentum() const {
+    return pairwiseSum<Vec>(0, objects_.size(), [this](size_t i) { return objects_[i].momentum(); });
   }
 
   void report() const {
@@ -213,20 +2021,67 @@ public:
   }
 
   void energize(Scalar ratio) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (journal_) {
+      journal_->begin(JOURNAL_ENERGIZE, steps_);
+      journal_->put(ratio);
+    }
+
     for (Object& obj : objects_) {
       obj.scaleVelocity(ratio);
     }
+
+    discontinuity();
   }
 
   void halt() {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (journal_)
+      journal_->begin(JOURNAL_HALT, steps_);
+
     for (Object& obj : objects_) {
       obj.setVelocity(Vec());
     }
+
+    discontinuity();
+  }
+
+  /** Set global gravity between steps; writing global_gravity_ directly races with update() */
+  void setGravity(const Vec& gravity) {
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+    global_gravity_ = gravity;
   }
 
   void clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    TracedLock<std::mutex> lock(mutex_, "wait for Space");
+
+    if (journal_)
+      journal_->begin(JOURNAL_CLEAR, steps_);
+
+    clearBodies();
+  }
+
+private:
+  void clearBodies() {
     objects_.clear();
+    ids_.clear();
+    std::fill(index_of_.begin(), index_of_.end(), noIndex());
+    parked_.clear();
+    parked_ids_.clear();
+    contacts_.clear();
+
+    if (broadphase_)
+      broadphase_->clear();
+
+    if (neighbour_list_)
+      neighbour_list_->invalidate();
+
+    if (block_timesteps_)
+      block_timesteps_->invalidate();
+
+    discontinuity();
   }
 };
 
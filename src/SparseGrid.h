@@ -0,0 +1,172 @@
+#ifndef FLATICS_SPARSEGRID_H
+#define FLATICS_SPARSEGRID_H
+
+#include "Arena.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Items binned by integer cell coordinates, with only the occupied cells
+ *  stored: a hash table from cell key to a range of a flat item array. Memory
+ *  grows with the number of items, never with how far apart they are, so a
+ *  grid over an unbounded world costs the same whether a stray body is one
+ *  cell or a billion cells away from the rest.
+ *
+ *  build() takes the key of every item and bins them in one pass; cells are
+ *  numbered in order of first appearance, and each cell lists its items in
+ *  ascending order.
+ */
+class SparseGrid {
+private:
+  static const uint32_t EMPTY = 0xffffffffu;
+
+  struct Slot {
+    uint64_t key;
+    uint32_t cell;
+  };
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+
+  std::vector<uint64_t> cell_keys_;
+  std::vector<uint32_t> cell_start_;
+  std::vector<uint32_t> cell_of_;
+  std::vector<uint32_t> items_;
+
+  static size_t hash(uint64_t key) {
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32);
+  }
+
+  /** The slot holding key, or the empty one where it would go */
+  size_t probe(uint64_t key) const {
+    size_t slot = hash(key) & mask_;
+
+    while (slots_[slot].cell != EMPTY && slots_[slot].key != key)
+      slot = (slot + 1) & mask_;
+
+    return slot;
+  }
+
+public:
+  SparseGrid() : mask_(0) {}
+
+  /** Key of the cell at (x, y) */
+  static uint64_t key(int32_t x, int32_t y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+  }
+
+  static int32_t x(uint64_t key) { return static_cast<int32_t>(static_cast<uint32_t>(key >> 32)); }
+
+  static int32_t y(uint64_t key) { return static_cast<int32_t>(static_cast<uint32_t>(key)); }
+
+  /**
+   *  The cell coordinate a coordinate falls in, clamped to the int32 range.
+   *  Clamping keeps the order of coordinates, so neighbours stay neighbours
+   *  even out at the clamped edge (they just share cells).
+   */
+  template<typename Scalar>
+  static int32_t cellOf(Scalar coordinate, Scalar cellSize) {
+    const double cell = std::floor(static_cast<double>(coordinate) / static_cast<double>(cellSize));
+
+    if (!(cell > std::numeric_limits<int32_t>::min()))
+      return std::numeric_limits<int32_t>::min();
+
+    if (cell >= std::numeric_limits<int32_t>::max())
+      return std::numeric_limits<int32_t>::max();
+
+    return static_cast<int32_t>(cell);
+  }
+
+  /** Bin items 0..count-1, item i into the cell keys[i]; scratch (if any) holds the pass's temporaries */
+  void build(const uint64_t* keys, size_t count, Arena* scratch = nullptr) {
+    size_t size = 16;
+    while (size < 2 * count)
+      size *= 2;
+
+    Slot empty = { 0, EMPTY };
+    slots_.assign(size, empty);
+    mask_ = size - 1;
+
+    cell_keys_.clear();
+    cell_start_.clear();
+    cell_of_.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+      Slot& slot = slots_[probe(keys[i])];
+
+      if (slot.cell == EMPTY) {
+        slot.key = keys[i];
+        slot.cell = static_cast<uint32_t>(cell_keys_.size());
+        cell_keys_.push_back(keys[i]);
+        cell_start_.push_back(0);
+      }
+
+      cell_of_[i] = slot.cell;
+      ++cell_start_[slot.cell];
+    }
+
+    // counts to exclusive prefix sums, then scatter in item order
+    uint32_t total = 0;
+    for (uint32_t& start : cell_start_) {
+      const uint32_t cellCount = start;
+      start = total;
+      total += cellCount;
+    }
+    cell_start_.push_back(total);
+
+    items_.resize(count);
+    ArenaVector<uint32_t> next(cell_start_.begin(), cell_start_.end() - 1, ArenaAllocator<uint32_t>(scratch));
+
+    for (size_t i = 0; i < count; ++i)
+      items_[next[cell_of_[i]]++] = static_cast<uint32_t>(i);
+  }
+
+  /** Occupied cells */
+  size_t cells() const { return cell_keys_.size(); }
+
+  uint64_t cellKey(size_t cell) const { return cell_keys_[cell]; }
+
+  /** Number of the cell with the given key, or cells() if it is empty */
+  size_t find(uint64_t key) const {
+    if (slots_.empty())
+      return cells();
+
+    const Slot& slot = slots_[probe(key)];
+    return slot.cell == EMPTY ? cells() : slot.cell;
+  }
+
+  /** The cell an item was binned into */
+  size_t cellOfItem(size_t item) const { return cell_of_[item]; }
+
+  /** Items of a cell: items()[begin(cell)] up to items()[end(cell)] */
+  size_t begin(size_t cell) const { return cell_start_[cell]; }
+
+  size_t end(size_t cell) const { return cell_start_[cell + 1]; }
+
+  const std::vector<uint32_t>& items() const { return items_; }
+
+  /** Bytes held, for comparing against a dense grid */
+  size_t memoryBytes() const {
+    return slots_.capacity() * sizeof(Slot) + cell_keys_.capacity() * sizeof(uint64_t) +
+           (cell_start_.capacity() + cell_of_.capacity() + items_.capacity()) * sizeof(uint32_t);
+  }
+
+  void clear() {
+    std::vector<Slot>().swap(slots_);
+    std::vector<uint64_t>().swap(cell_keys_);
+    std::vector<uint32_t>().swap(cell_start_);
+    std::vector<uint32_t>().swap(cell_of_);
+    std::vector<uint32_t>().swap(items_);
+    mask_ = 0;
+  }
+};
+
+}
+
+#endif // FLATICS_SPARSEGRID_H
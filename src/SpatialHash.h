@@ -0,0 +1,159 @@
+#ifndef FLATICS_SPATIALHASH_H
+#define FLATICS_SPATIALHASH_H
+
+#include "Broadphase.h"
+#include "SparseGrid.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Broadphase over a hashed grid of square cells, for worlds without a
+ *  boundary.
+ *
+ *  Every body goes into the cell holding the min corner of its box. Cells are
+ *  at least as wide as the largest box, so two overlapping boxes have their
+ *  corners in the same cell or in adjacent ones, and each cell only has to be
+ *  checked against itself and four of its neighbours (right, and the three
+ *  above) for every pair to come up once. Only occupied cells exist (see
+ *  SparseGrid), so bodies scattered over any distance cost no more than
+ *  bodies packed together, unlike a grid or tree sized to the world.
+ *
+ *  The grid is rebuilt from scratch every step; nothing is kept per body id.
+ */
+template<typename Scalar, class Vec>
+class SpatialHash : public Broadphase<Scalar, Vec> {
+public:
+  typedef typename Broadphase<Scalar, Vec>::Object Object;
+  typedef typename Broadphase<Scalar, Vec>::Pair Pair;
+
+private:
+  Scalar min_cell_size_;
+  Scalar cell_size_;
+
+  SparseGrid grid_;
+  std::vector<uint64_t> keys_;
+
+  ThreadPool* pool_;
+  StepArena* arena_;
+  std::vector<std::vector<Pair> > chunk_pairs_;
+
+  /** Append the overlapping pairs of one cell with itself and its forward neighbours */
+  void pairsOf(const Object* objects, size_t cell, std::vector<Pair>& pairs) const {
+    const std::vector<uint32_t>& items = grid_.items();
+    const size_t begin = grid_.begin(cell), end = grid_.end(cell);
+
+    for (size_t a = begin; a < end; ++a)
+    for (size_t b = a + 1; b < end; ++b) {
+      if (Broadphase<Scalar, Vec>::overlaps(objects[items[a]], objects[items[b]]))
+        pairs.push_back(Pair(items[a], items[b]));
+    }
+
+    static const int offsets[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+    const uint64_t key = grid_.cellKey(cell);
+
+    for (const int* offset : offsets) {
+      const int64_t x = int64_t(SparseGrid::x(key)) + offset[0];
+      const int64_t y = int64_t(SparseGrid::y(key)) + offset[1];
+
+      if (x < INT32_MIN || x > INT32_MAX || y > INT32_MAX)
+        continue;
+
+      const size_t other = grid_.find(SparseGrid::key(int32_t(x), int32_t(y)));
+
+      if (other == grid_.cells())
+        continue;
+
+      for (size_t a = begin; a < end; ++a)
+      for (size_t b = grid_.begin(other); b < grid_.end(other); ++b) {
+        const uint32_t i = items[a], j = items[b];
+
+        if (Broadphase<Scalar, Vec>::overlaps(objects[i], objects[j]))
+          pairs.push_back(i < j ? Pair(i, j) : Pair(j, i));
+      }
+    }
+  }
+
+public:
+  /** @param minCellSize cells are at least this wide, and always as wide as the largest body */
+  explicit SpatialHash(Scalar minCellSize = 0) : min_cell_size_(minCellSize), cell_size_(0), pool_(nullptr), arena_(nullptr) {}
+
+  /** Width of the cells of the last update */
+  Scalar cellSize() const { return cell_size_; }
+
+  /** Occupied cells in the last update */
+  size_t cells() const { return grid_.cells(); }
+
+  /** Bytes held by the grid */
+  size_t memoryBytes() const { return grid_.memoryBytes() + keys_.capacity() * sizeof(uint64_t); }
+
+  void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+
+  void setArena(StepArena* arena) { arena_ = arena; }
+
+  void findPairs(const Object* objects, const size_t*, size_t count, std::vector<Pair>& pairs) {
+    if (count == 0)
+      return;
+
+    Scalar extent = 0;
+    for (size_t i = 0; i < count; ++i)
+      extent = std::max(extent, std::max(objects[i].maxX() - objects[i].minX(), objects[i].maxY() - objects[i].minY()));
+
+    cell_size_ = std::max(min_cell_size_, extent);
+
+    // all points, as with every body at the same spot
+    if (!(cell_size_ > 0))
+      cell_size_ = 1;
+
+    keys_.resize(count);
+
+    auto key = [this, objects](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i)
+        keys_[i] = SparseGrid::key(SparseGrid::cellOf(objects[i].minX(), cell_size_), SparseGrid::cellOf(objects[i].minY(), cell_size_));
+    };
+
+    if (pool_)
+      pool_->parallelFor(count, key);
+    else
+      key(0, count, 0);
+
+    grid_.build(keys_.data(), count, arena_ ? &arena_->main() : nullptr);
+
+    if (!pool_ || pool_->size() < 2) {
+      for (size_t cell = 0; cell < grid_.cells(); ++cell)
+        pairsOf(objects, cell, pairs);
+      return;
+    }
+
+    // cells in parallel, concatenated in chunk order so the pair order
+    // doesn't depend on scheduling. With fewer cells than workers some
+    // chunks don't run, so every list is emptied first.
+    chunk_pairs_.resize(pool_->size());
+
+    for (std::vector<Pair>& chunk : chunk_pairs_)
+      chunk.clear();
+
+    pool_->parallelFor(grid_.cells(), [this, objects](size_t begin, size_t end, size_t chunk) {
+      for (size_t cell = begin; cell < end; ++cell)
+        pairsOf(objects, cell, chunk_pairs_[chunk]);
+    }, chunk_pairs_.size());
+
+    for (const std::vector<Pair>& chunk : chunk_pairs_)
+      pairs.insert(pairs.end(), chunk.begin(), chunk.end());
+  }
+
+  void remove(size_t) {}
+
+  void clear() {
+    grid_.clear();
+    std::vector<uint64_t>().swap(keys_);
+    chunk_pairs_.clear();
+  }
+};
+
+}
+
+#endif // FLATICS_SPATIALHASH_H
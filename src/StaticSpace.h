@@ -0,0 +1,50 @@
+#ifndef FLATICS_STATICSPACE_H
+#define FLATICS_STATICSPACE_H
+
+#include "Space.h"
+#include "StepPolicies.h"
+
+#include <mutex>
+
+namespace flatics {
+
+/**
+ *  A Space whose boundary handling, object gravity, global gravity and
+ *  restitution model are fixed at compile time. update() goes straight to the
+ *  matching step() specialization instead of through Space's runtime dispatch.
+ *
+ *  The runtime setters inherited from Space are ignored by update().
+ */
+template<typename Scalar, class Vec,
+         class Boundary = BounceBoundary,
+         bool ObjectGravity = true,
+         bool GlobalGravity = false,
+         class Restitution = InelasticRestitution>
+class StaticSpace : public Space<Scalar, Vec> {
+private:
+  typedef Space<Scalar, Vec> Base;
+
+  static typename Base::BoundaryMode boundaryMode(NoBoundary*) { return Base::NONE; }
+  static typename Base::BoundaryMode boundaryMode(WrapBoundary*) { return Base::WRAP; }
+  static typename Base::BoundaryMode boundaryMode(BounceBoundary*) { return Base::BOUNCE; }
+
+  static typename Base::RestitutionModel restitutionModel(InelasticRestitution*) { return Base::INELASTIC; }
+  static typename Base::RestitutionModel restitutionModel(ElasticRestitution*) { return Base::ELASTIC; }
+
+public:
+  StaticSpace(size_t width, size_t height, const Vec& gravity = Vec())
+      : Base(width, height, boundaryMode(static_cast<Boundary*>(nullptr)), gravity) {
+    // keep the runtime view of the configuration truthful for report() and friends
+    Base::setObjectGravity(ObjectGravity);
+    Base::setRestitutionModel(restitutionModel(static_cast<Restitution*>(nullptr)));
+  }
+
+  void update(Scalar dt) {
+    std::lock_guard<std::mutex> lock(this->mutex());
+    this->template step<Boundary, ObjectGravity, GlobalGravity, Restitution>(dt);
+  }
+};
+
+}
+
+#endif // FLATICS_STATICSPACE_H
@@ -0,0 +1,84 @@
+#ifndef FLATICS_STEPPOLICIES_H
+#define FLATICS_STEPPOLICIES_H
+
+namespace flatics {
+
+/*
+ *  Compile-time policies for the step kernel in Space.
+ *
+ *  Each boundary policy provides apply(obj, width, height, restitution_factor),
+ *  and each restitution model provides the coefficients used for body-body and
+ *  body-boundary contacts. Space::step() is instantiated once per combination,
+ *  so none of these choices are branched on inside the hot loops.
+ */
+
+/** Bodies are free to leave the world */
+struct NoBoundary {
+  template<class Object, typename Scalar>
+  static void apply(Object&, Scalar, Scalar, Scalar) {}
+};
+
+/** The world is a torus: leaving one edge re-enters at the opposite edge */
+struct WrapBoundary {
+  template<class Object, typename Scalar>
+  static void apply(Object& obj, Scalar width, Scalar height, Scalar) {
+    if (obj.position().x <= 0)
+      obj.setPosition(width + obj.position().x, obj.position().y);
+    else if (obj.position().x >= width)
+      obj.setPosition(obj.position().x - width, obj.position().y);
+    else if (obj.position().y <= 0)
+      obj.setPosition(obj.position().x, height + obj.position().y);
+    else if (obj.position().y >= height)
+      obj.setPosition(obj.position().x, obj.position().y - height);
+  }
+};
+
+/** The edges of the world are walls */
+struct BounceBoundary {
+  template<class Object, typename Scalar>
+  static void apply(Object& obj, Scalar width, Scalar height, Scalar restitution_factor) {
+    if (obj.minX() <= 0) {
+      if (obj.velocity().x < 0)
+        obj.bounceVertical(restitution_factor);
+
+      obj.translateX(-obj.minX());
+    } else if (obj.maxX() >= width) {
+      if (obj.velocity().x > 0)
+        obj.bounceVertical(restitution_factor);
+
+      obj.translateX(width - obj.maxX());
+    } if (obj.minY() <= 0) {
+      if (obj.velocity().y < 0)
+        obj.bounceHorizontal(restitution_factor);
+
+      obj.translateY(-obj.minY());
+    } else if (obj.maxY() >= height) {
+      if (obj.velocity().y > 0)
+        obj.bounceHorizontal(restitution_factor);
+
+      obj.translateY(height - obj.maxY());
+    }
+  }
+};
+
+/** Lossy body-body collisions, lossless walls (the historical behaviour) */
+struct InelasticRestitution {
+  template<typename Scalar>
+  static Scalar collision() { return Scalar(0.6); }
+
+  template<typename Scalar>
+  static Scalar boundary() { return Scalar(1.0); }
+};
+
+/** Every contact conserves kinetic energy */
+struct ElasticRestitution {
+  template<typename Scalar>
+  static Scalar collision() { return Scalar(1.0); }
+
+  template<typename Scalar>
+  static Scalar boundary() { return Scalar(1.0); }
+};
+
+}
+
+#endif // FLATICS_STEPPOLICIES_H
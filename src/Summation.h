@@ -0,0 +1,83 @@
+#ifndef FLATICS_SUMMATION_H
+#define FLATICS_SUMMATION_H
+
+#include <cstddef>
+
+namespace flatics {
+
+/*
+ *  Sums that don't lose the small terms, for reductions over many bodies in
+ *  single precision.
+ */
+
+/** A plain running sum, with the same interface as WideSum */
+template<typename Type>
+class PlainSum {
+private:
+  Type sum_;
+
+public:
+  PlainSum() : sum_() {}
+
+  void add(const Type& value) { sum_ += value; }
+
+  const Type& value() const { return sum_; }
+
+  void clear() { sum_ = Type(); }
+};
+
+/**
+ *  A running sum of 2D vectors kept in double whatever the vectors' own
+ *  precision. For float terms one double add is both cheaper than a
+ *  compensated float add and at least as accurate.
+ */
+template<class Vec>
+class WideSum {
+private:
+  double x_, y_;
+
+public:
+  WideSum() : x_(0), y_(0) {}
+
+  void add(const Vec& value) {
+    x_ += value.x;
+    y_ += value.y;
+  }
+
+  Vec value() const { return Vec(static_cast<decltype(Vec().x)>(x_), static_cast<decltype(Vec().y)>(y_)); }
+
+  void clear() {
+    x_ = 0;
+    y_ = 0;
+  }
+};
+
+/** Whether per-body force sums in this precision should be kept wider than the forces */
+template<typename Scalar>
+struct WidenForces {
+  static const bool value = sizeof(Scalar) < sizeof(double);
+};
+
+/**
+ *  Pairwise (cascade) sum of term(i) for i in [begin, end): the error grows
+ *  with the log of the count rather than the count, and unlike a compensated
+ *  sum the halves are independent.
+ */
+template<typename Type, class Term>
+Type pairwiseSum(size_t begin, size_t end, const Term& term) {
+  if (end - begin <= 16) {
+    Type total = Type();
+
+    for (size_t i = begin; i < end; ++i)
+      total += term(i);
+
+    return total;
+  }
+
+  size_t middle = begin + (end - begin) / 2;
+  return pairwiseSum<Type>(begin, middle, term) + pairwiseSum<Type>(middle, end, term);
+}
+
+}
+
+#endif // FLATICS_SUMMATION_H
@@ -0,0 +1,295 @@
+#ifndef FLATICS_SWEEPANDPRUNE_H
+#define FLATICS_SWEEPANDPRUNE_H
+
+#include "Arena.h"
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Incremental sweep-and-prune broadphase.
+ *
+ *  The min and max endpoints of every body's box along one axis are kept
+ *  sorted between steps. Each step the endpoints are refreshed and re-sorted by
+ *  insertion sort, which is close to O(n) when bodies barely move, and every
+ *  swap of a min past a max (or back) adds or removes that pair from the set of
+ *  pairs overlapping on the sweep axis. Those are then filtered by the other
+ *  axis on output.
+ *
+ *  The sweep axis follows whichever axis the bodies are more spread out along;
+ *  switching axes costs one full sort and sweep.
+ *
+ *  Removing a body only marks it absent; its endpoints and overlaps are
+ *  dropped in one pass at the next findPairs(), however many went.
+ *
+ *  The overlap set's nodes are recycled, so the pairs churning in and out of
+ *  it from step to step don't go to the heap once it has reached its size.
+ */
+template<typename Scalar, class Vec>
+class SweepAndPrune : public Broadphase<Scalar, Vec> {
+public:
+  typedef typename Broadphase<Scalar, Vec>::Object Object;
+  typedef typename Broadphase<Scalar, Vec>::Pair Pair;
+
+private:
+  struct Endpoint {
+    Scalar value;
+    uint32_t id;
+    bool is_max;
+  };
+
+  struct Bounds {
+    Scalar min[2];
+    Scalar max[2];
+    bool present;
+  };
+
+  std::vector<Endpoint> endpoints_;
+  std::vector<Bounds> bounds_;        // by body id
+  std::vector<size_t> index_of_;      // by body id, refreshed each call
+
+  typedef std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, RecyclingAllocator<uint64_t> > PairSet;
+  NodeRecycler recycler_; // before axis_pairs_, which gives its nodes back on destruction
+  PairSet axis_pairs_;
+
+  int axis_;
+
+  // the spread along the other axis must beat the current one by this factor
+  // before switching, so the axis doesn't flip back and forth
+  Scalar switch_factor_;
+  size_t axis_check_interval_;
+  size_t updates_since_check_;
+
+  size_t swaps_;
+  size_t removed_; // bodies marked absent since the last compact()
+  std::vector<uint32_t> active_;
+  std::vector<size_t> active_slot_;
+
+  // ids are packed 32 bits each; the tables are indexed by id, so ids never
+  // get near 2^32 here (Space hands them out from 0 and reuses none)
+  static uint64_t pairKey(uint32_t id1, uint32_t id2) {
+    if (id2 < id1)
+      std::swap(id1, id2);
+
+    return (static_cast<uint64_t>(id1) << 32) | id2;
+  }
+
+  Scalar value(const Endpoint& endpoint) const {
+    const Bounds& bounds = bounds_[endpoint.id];
+    return endpoint.is_max ? bounds.max[axis_] : bounds.min[axis_];
+  }
+
+  /** Drop the endpoints and overlaps of the bodies removed since the last call */
+  void compact() {
+    if (removed_ == 0)
+      return;
+
+    endpoints_.erase(std::remove_if(endpoints_.begin(), endpoints_.end(), [this](const Endpoint& endpoint) {
+      return !bounds_[endpoint.id].present;
+    }), endpoints_.end());
+
+    for (typename PairSet::iterator it = axis_pairs_.begin(); it != axis_pairs_.end();) {
+      if (!bounds_[*it >> 32].present || !bounds_[*it & 0xffffffffu].present)
+        it = axis_pairs_.erase(it);
+      else
+        ++it;
+    }
+
+    removed_ = 0;
+  }
+
+  /** Re-sort the endpoints, adding and removing axis overlaps as mins and maxes pass each other */
+  void insertionSort() {
+    for (size_t i = 1; i < endpoints_.size(); ++i) {
+      Endpoint moving = endpoints_[i];
+      size_t j = i;
+
+      while (j > 0 && moving.value < endpoints_[j-1].value) {
+        const Endpoint& passed = endpoints_[j-1];
+
+        if (!moving.is_max && passed.is_max)
+          axis_pairs_.insert(pairKey(moving.id, passed.id));
+        else if (moving.is_max && !passed.is_max)
+          axis_pairs_.erase(pairKey(moving.id, passed.id));
+
+        endpoints_[j] = passed;
+        --j;
+        ++swaps_;
+      }
+
+      endpoints_[j] = moving;
+    }
+  }
+
+  /** Sort from scratch and rebuild the axis overlaps with a single sweep */
+  void rebuild() {
+    for (Endpoint& endpoint : endpoints_)
+      endpoint.value = value(endpoint);
+
+    std::sort(endpoints_.begin(), endpoints_.end(), [](const Endpoint& a, const Endpoint& b) {
+      // mins before maxes on ties, so touching boxes count as overlapping
+      return a.value < b.value || (a.value == b.value && !a.is_max && b.is_max);
+    });
+
+    axis_pairs_.clear();
+    active_.clear();
+    active_slot_.resize(bounds_.size());
+
+    for (const Endpoint& endpoint : endpoints_) {
+      if (!endpoint.is_max) {
+        for (uint32_t other : active_)
+          axis_pairs_.insert(pairKey(endpoint.id, other));
+
+        active_slot_[endpoint.id] = active_.size();
+        active_.push_back(endpoint.id);
+      } else {
+        size_t slot = active_slot_[endpoint.id];
+        active_[slot] = active_.back();
+        active_slot_[active_[slot]] = slot;
+        active_.pop_back();
+      }
+    }
+  }
+
+  /** Pick the axis along which the body centers have the larger variance */
+  int preferredAxis(size_t count) const {
+    Scalar sum[2] = { 0, 0 };
+    Scalar sum_squares[2] = { 0, 0 };
+
+    for (const Endpoint& endpoint : endpoints_) {
+      if (endpoint.is_max)
+        continue;
+
+      const Bounds& bounds = bounds_[endpoint.id];
+
+      for (int axis = 0; axis < 2; ++axis) {
+        Scalar center = (bounds.min[axis] + bounds.max[axis]) / 2;
+        sum[axis] += center;
+        sum_squares[axis] += center * center;
+      }
+    }
+
+    Scalar variance[2];
+    for (int axis = 0; axis < 2; ++axis)
+      variance[axis] = sum_squares[axis] / count - (sum[axis] / count) * (sum[axis] / count);
+
+    return variance[1 - axis_] > switch_factor_ * variance[axis_] ? 1 - axis_ : axis_;
+  }
+
+public:
+  /**
+   *  @param axisCheckInterval re-evaluate the sweep axis every this many updates (0 never)
+   *  @param switchFactor how much more spread the other axis needs before switching to it
+   */
+  explicit SweepAndPrune(size_t axisCheckInterval = 64, Scalar switchFactor = 1.5)
+      : axis_pairs_(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), RecyclingAllocator<uint64_t>(&recycler_)),
+        axis_(0), switch_factor_(switchFactor), axis_check_interval_(axisCheckInterval),
+        updates_since_check_(0), swaps_(0), removed_(0) {}
+
+  /** 0 for x, 1 for y */
+  int axis() const { return axis_; }
+
+  /** Endpoint swaps performed by the last update's insertion sort */
+  size_t swaps() const { return swaps_; }
+
+  void findPairs(const Object* objects, const size_t* ids, size_t count, std::vector<Pair>& pairs) {
+    swaps_ = 0;
+    size_t added = 0;
+
+    // before any id can come back and be added again
+    compact();
+
+    for (size_t i = 0; i < count; ++i) {
+      size_t id = ids[i];
+
+      if (id >= bounds_.size()) {
+        Bounds absent = { { 0, 0 }, { 0, 0 }, false };
+        bounds_.resize(id + 1, absent);
+        index_of_.resize(id + 1);
+      }
+
+      Bounds& bounds = bounds_[id];
+      const Object& obj = objects[i];
+
+      bounds.min[0] = obj.minX();
+      bounds.min[1] = obj.minY();
+      bounds.max[0] = obj.maxX();
+      bounds.max[1] = obj.maxY();
+      index_of_[id] = i;
+
+      if (!bounds.present) {
+        // new bodies enter at the far end and get sorted into place like
+        // everything else, which also discovers their overlaps
+        Endpoint min = { 0, static_cast<uint32_t>(id), false };
+        Endpoint max = { 0, static_cast<uint32_t>(id), true };
+        endpoints_.push_back(min);
+        endpoints_.push_back(max);
+        bounds.present = true;
+        ++added;
+      }
+    }
+
+    if (count == 0)
+      return;
+
+    if (axis_check_interval_ != 0 && ++updates_since_check_ >= axis_check_interval_) {
+      updates_since_check_ = 0;
+      int axis = preferredAxis(count);
+
+      if (axis != axis_) {
+        axis_ = axis;
+        rebuild();
+      }
+    }
+
+    if (added * 8 > count) {
+      // sorting many unsorted newcomers into place one by one is quadratic
+      rebuild();
+    } else {
+      for (Endpoint& endpoint : endpoints_)
+        endpoint.value = value(endpoint);
+
+      insertionSort();
+    }
+
+    const int other = 1 - axis_;
+
+    for (uint64_t key : axis_pairs_) {
+      const Bounds& a = bounds_[key >> 32];
+      const Bounds& b = bounds_[key & 0xffffffffu];
+
+      if (a.min[other] <= b.max[other] && b.min[other] <= a.max[other]) {
+        size_t i = index_of_[key >> 32];
+        size_t j = index_of_[key & 0xffffffffu];
+        pairs.push_back(i < j ? Pair(i, j) : Pair(j, i));
+      }
+    }
+  }
+
+  void remove(size_t id) {
+    if (id >= bounds_.size() || !bounds_[id].present)
+      return;
+
+    bounds_[id].present = false;
+    ++removed_;
+  }
+
+  void clear() {
+    endpoints_.clear();
+    bounds_.clear();
+    index_of_.clear();
+    axis_pairs_.clear();
+    updates_since_check_ = 0;
+    removed_ = 0;
+  }
+};
+
+}
+
+#endif // FLATICS_SWEEPANDPRUNE_H
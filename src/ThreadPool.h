@@ -0,0 +1,360 @@
+#ifndef FLATICS_THREADPOOL_H
+#define FLATICS_THREADPOOL_H
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  A fixed set of work-stealing worker threads for data-parallel loops.
+ *
+ *  Every worker has its own task deque, plus one shared by all other threads.
+ *  Tasks submitted from a worker go to the back of its own deque and it takes
+ *  its work from there, newest first, while idle workers steal the oldest
+ *  task from the front of someone else's. Nested parallel work therefore
+ *  stays on the thread that made it unless another thread runs dry.
+ *
+ *  parallelFor() splits a range into one chunk per worker, runs the first
+ *  chunk on the calling thread and helps with the rest until every chunk is
+ *  done. Called from outside the pool, chunk k goes on worker k - 1's own
+ *  deque, so the same part of an array is worked on by the same thread step
+ *  after step unless an idle worker steals it; with pin(), that keeps the
+ *  memory a thread first touched next to the core it runs on.
+ */
+class ThreadPool {
+private:
+  /** A double-ended queue of tasks in a ring that only grows, so steady use never allocates */
+  class TaskRing {
+  private:
+    std::vector<std::function<void()> > slots_;
+    size_t head_;
+    size_t count_;
+
+  public:
+    TaskRing() : slots_(16), head_(0), count_(0) {}
+
+    bool empty() const { return count_ == 0; }
+
+    void push_back(std::function<void()>&& task) {
+      if (count_ == slots_.size()) {
+        std::vector<std::function<void()> > grown(slots_.size() * 2);
+
+        for (size_t i = 0; i < count_; ++i)
+          grown[i].swap(slots_[(head_ + i) % slots_.size()]);
+
+        slots_.swap(grown);
+        head_ = 0;
+      }
+
+      slots_[(head_ + count_++) % slots_.size()] = std::move(task);
+    }
+
+    std::function<void()>& back() { return slots_[(head_ + count_ - 1) % slots_.size()]; }
+    std::function<void()>& front() { return slots_[head_]; }
+
+    void pop_back() {
+      back() = nullptr;
+      --count_;
+    }
+
+    void pop_front() {
+      front() = nullptr;
+      head_ = (head_ + 1) % slots_.size();
+      --count_;
+    }
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    TaskRing tasks;
+  };
+
+  /** What the chunks of one parallelFor() share; tasks only point at it, so they fit in std::function without allocating */
+  template<class Function>
+  struct Loop {
+    Function* fn;
+    std::atomic<size_t> remaining;
+    size_t count;
+    size_t chunks;
+
+    void run(size_t chunk) {
+      (*fn)(count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+      remaining.fetch_sub(1, std::memory_order_release);
+    }
+  };
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<Queue> > queues_; // one per worker, then the shared one
+  std::atomic<size_t> pending_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stopping_;
+
+  static size_t& currentIndex() {
+    static thread_local size_t index = static_cast<size_t>(-1);
+    return index;
+  }
+
+  /** Take a task from the back of queue index, or steal one from the front of another */
+  bool takeTask(size_t index, std::function<void()>& task) {
+    {
+      Queue& own = *queues_[index];
+      std::lock_guard<std::mutex> lock(own.mutex);
+
+      if (!own.tasks.empty()) {
+        task.swap(own.tasks.back());
+        own.tasks.pop_back();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    for (size_t k = 1; k < queues_.size(); ++k) {
+      Queue& victim = *queues_[(index + k) % queues_.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+
+      if (!victim.tasks.empty()) {
+        task.swap(victim.tasks.front());
+        victim.tasks.pop_front();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void work(size_t index) {
+    currentIndex() = index;
+
+    while (true) {
+      std::function<void()> task;
+
+      if (takeTask(index, task)) {
+        task();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_relaxed) != 0; });
+
+      if (stopping_ && pending_.load(std::memory_order_relaxed) == 0)
+        return;
+    }
+  }
+
+  /** Queue a task on a given worker's own deque, where it stays unless stolen */
+  void submitTo(size_t index, std::function<void()> task) {
+    {
+      // counted before it can be taken, or a thief's decrement could come first and wrap
+      Queue& queue = *queues_[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      pending_.fetch_add(1, std::memory_order_relaxed);
+      queue.tasks.push_back(std::move(task));
+    }
+
+    // a worker about to sleep checks pending_ under this lock, so once it is
+    // free the worker has either seen the task or is waiting to be woken
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+
+  /** Logical cpus listed in a sysfs cpulist ("0-3,8-11") */
+  static std::vector<unsigned> parseCpuList(const std::string& list) {
+    std::vector<unsigned> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+
+    while (std::getline(ranges, range, ',')) {
+      unsigned first = 0, last = 0;
+      int fields = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+
+      if (fields < 1)
+        continue;
+      if (fields == 1)
+        last = first;
+
+      for (unsigned cpu = first; cpu <= last; ++cpu)
+        cpus.push_back(cpu);
+    }
+
+    return cpus;
+  }
+
+  /** Take and run one queued task on the calling thread, if there is one */
+  bool runPendingTask() {
+    std::function<void()> task;
+
+    if (!takeTask(workerIndex(), task))
+      return false;
+
+    task();
+    return true;
+  }
+
+public:
+  /** @param threads number of worker threads; 0 runs everything on the caller */
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency()) : pending_(0), stopping_(false) {
+    for (size_t i = 0; i <= threads; ++i)
+      queues_.emplace_back(new Queue());
+
+    for (size_t i = 0; i < threads; ++i)
+      workers_.emplace_back(&ThreadPool::work, this, i);
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stopping_ = true;
+    }
+
+    wake_.notify_all();
+
+    for (std::thread& worker : workers_)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /** Number of worker threads */
+  size_t size() const { return workers_.size(); }
+
+  /**
+   *  The logical cpus this process may run on, grouped by NUMA node (all of
+   *  node 0's, then node 1's, ...), so that neighbouring entries share memory.
+   *  Without topology information it is just 0 .. hardware_concurrency - 1.
+   */
+  static std::vector<unsigned> cpusByNode() {
+    std::vector<unsigned> cpus;
+
+  #ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool masked = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for (unsigned node = 0;; ++node) {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string list;
+
+      if (!file || !std::getline(file, list))
+        break;
+
+      for (unsigned cpu : parseCpuList(list)) {
+        if (!masked || CPU_ISSET(cpu, &allowed))
+          cpus.push_back(cpu);
+      }
+    }
+  #endif
+
+    if (cpus.empty()) {
+      for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+        cpus.push_back(cpu);
+    }
+
+    return cpus;
+  }
+
+  /**
+   *  Pin the calling thread to cpus[0] and worker i to cpus[i + 1], wrapping
+   *  around (cpusByNode() when cpus is empty). Call it from the thread that
+   *  runs the parallel loops, since it does chunk 0 of every one. Returns
+   *  false if any thread couldn't be pinned; only Linux supports it so far.
+   */
+  bool pin(std::vector<unsigned> cpus = std::vector<unsigned>()) {
+    if (cpus.empty())
+      cpus = cpusByNode();
+
+    bool pinned = pinThread(cpus[0]);
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+  #ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[(i + 1) % cpus.size()], &set);
+      pinned = pthread_setaffinity_np(workers_[i].native_handle(), sizeof(set), &set) == 0 && pinned;
+  #else
+      pinned = false;
+  #endif
+    }
+
+    return pinned;
+  }
+
+  /** Index of the calling worker in [0, size()), or size() on any other thread */
+  size_t workerIndex() const {
+    size_t index = currentIndex();
+    return index < workers_.size() ? index : workers_.size();
+  }
+
+  /** Queue a task for any worker; from a worker, it goes on that worker's own deque */
+  void submit(std::function<void()> task) {
+    submitTo(workerIndex(), std::move(task));
+    wake_.notify_one();
+  }
+
+  /**
+   *  Run fn(begin, end, chunk) over [0, count) split into at most chunks pieces
+   *  (one per worker by default), returning when all of them are done.
+   *  Chunk boundaries depend only on count and chunks, never on timing.
+   */
+  template<class Function>
+  void parallelFor(size_t count, Function fn, size_t chunks = 0) {
+    if (chunks == 0)
+      chunks = std::max<size_t>(1, workers_.size());
+
+    chunks = std::min(chunks, count);
+
+    if (chunks <= 1 || workers_.empty()) {
+      for (size_t chunk = 0; chunk < chunks; ++chunk)
+        fn(count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+      return;
+    }
+
+    Loop<Function> loop;
+    loop.fn = &fn;
+    loop.remaining.store(chunks - 1, std::memory_order_relaxed);
+    loop.count = count;
+    loop.chunks = chunks;
+
+    const bool outside = workerIndex() == workers_.size();
+
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+      Loop<Function>* shared = &loop;
+      std::function<void()> task = [shared, chunk] { shared->run(chunk); };
+
+      if (outside)
+        submitTo((chunk - 1) % workers_.size(), std::move(task));
+      else
+        submit(std::move(task));
+    }
+
+    if (outside)
+      wake_.notify_all();
+
+    fn(0, count / chunks, 0);
+
+    // help out instead of sleeping, so parallelFor() can be nested inside a task
+    while (loop.remaining.load(std::memory_order_acquire) != 0) {
+      if (!runPendingTask())
+        std::this_thread::yield();
+    }
+  }
+};
+
+}
+
+#endif // FLATICS_THREADPOOL_H
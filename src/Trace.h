@@ -0,0 +1,299 @@
+#ifndef FLATICS_TRACE_H
+#define FLATICS_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace flatics {
+
+/**
+ *  Timeline tracing of scopes across threads, exported as Chrome trace event
+ *  JSON (chrome://tracing, ui.perfetto.dev).
+ *
+ *  Every thread that records gets its own ring buffer of begin/end events, so
+ *  recording is a clock read and a store with no locks or shared writes; the
+ *  buffer keeps the most recent events and drops the oldest. write() can be
+ *  called at any time from any thread and takes whatever every ring holds.
+ *
+ *  A stall trigger names a scope and a duration: whenever that scope runs
+ *  longer, the trace is written out to a file right away, so the events
+ *  leading up to a hitch are kept without anyone watching.
+ *
+ *  Names must be string literals (or otherwise outlive the trace), since only
+ *  the pointer is stored. While disabled, a scope costs one relaxed load.
+ */
+class Trace {
+private:
+  struct Event {
+    uint64_t time;    // nanoseconds since the trace was created
+    const char* name;
+    char phase;       // 'B'egin or 'E'nd
+  };
+
+  /** One thread's events; only that thread writes, anyone may read */
+  struct Ring {
+    std::vector<Event> events;
+    std::atomic<uint64_t> written; // events ever recorded; slot is written % size
+    uint32_t thread;
+    std::string name;
+
+    explicit Ring(size_t capacity, uint32_t thread) : events(capacity), written(0), thread(thread) {}
+  };
+
+  struct StallTrigger {
+    const char* name;
+    uint64_t threshold;
+  };
+
+  static const size_t MAX_TRIGGERS = 8;
+
+  std::chrono::steady_clock::time_point start_;
+  std::atomic<bool> enabled_;
+  size_t capacity_;
+
+  std::mutex rings_mutex_; // registration and export only
+  std::vector<std::unique_ptr<Ring> > rings_;
+
+  StallTrigger triggers_[MAX_TRIGGERS];
+  std::atomic<size_t> trigger_count_;
+  std::string stall_path_;
+  std::mutex stall_mutex_;
+  std::atomic<uint64_t> last_stall_;
+  std::atomic<size_t> stalls_;
+
+  Trace() : start_(std::chrono::steady_clock::now()), enabled_(false), capacity_(1 << 16), trigger_count_(0),
+            stall_path_("flatics-stall.json"), last_stall_(0), stalls_(0) {}
+
+  Ring& ring() {
+    static thread_local Ring* ring = nullptr;
+
+    if (!ring) {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.emplace_back(new Ring(capacity_, static_cast<uint32_t>(rings_.size() + 1)));
+      ring = rings_.back().get();
+    }
+
+    return *ring;
+  }
+
+  static void writeEvent(std::ostream& os, bool& first, const Event& event, uint32_t thread) {
+    os << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+       << "\",\"ts\":" << event.time / 1000 << '.' << (event.time / 100) % 10 << (event.time / 10) % 10 << event.time % 10
+       << ",\"pid\":1,\"tid\":" << thread << '}';
+    first = false;
+  }
+
+  /** Write the trace for a stall at most once a second, so a run of slow frames doesn't turn into a run of slow writes */
+  void stalled(uint64_t now) {
+    uint64_t last = last_stall_.load(std::memory_order_relaxed);
+
+    if (last != 0 && now - last < 1000000000ull)
+      return;
+
+    if (!last_stall_.compare_exchange_strong(last, now))
+      return;
+
+    stalls_.fetch_add(1, std::memory_order_relaxed);
+
+    std::string path;
+    {
+      std::lock_guard<std::mutex> lock(stall_mutex_);
+      path = stall_path_;
+    }
+
+    writeFile(path);
+  }
+
+public:
+  /** The one trace of the process */
+  static Trace& instance() {
+    static Trace trace;
+    return trace;
+  }
+
+  Trace(const Trace&) = delete;
+  Trace& operator=(const Trace&) = delete;
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+  /** Events each thread keeps; only affects threads that haven't recorded yet */
+  void setCapacity(size_t events) {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    capacity_ = events > 0 ? events : 1;
+  }
+
+  /** Label the calling thread in the exported timeline */
+  void setThreadName(const std::string& name) {
+    Ring& own = ring();
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    own.name = name;
+  }
+
+  /** Nanoseconds since the trace was created */
+  uint64_t now() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+  }
+
+  void record(const char* name, char phase, uint64_t time) {
+    Ring& own = ring();
+    uint64_t written = own.written.load(std::memory_order_relaxed);
+
+    Event& event = own.events[written % own.events.size()];
+    event.time = time;
+    event.name = name;
+    event.phase = phase;
+
+    own.written.store(written + 1, std::memory_order_release);
+  }
+
+  /**
+   *  Write the trace to stall path whenever a scope called name lasts longer
+   *  than seconds. Set the triggers up before recording starts.
+   */
+  void addStallTrigger(const char* name, double seconds) {
+    size_t count = trigger_count_.load(std::memory_order_relaxed);
+
+    if (count == MAX_TRIGGERS)
+      return;
+
+    triggers_[count].name = name;
+    triggers_[count].threshold = static_cast<uint64_t>(seconds * 1e9);
+    trigger_count_.store(count + 1, std::memory_order_release);
+  }
+
+  void setStallPath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(stall_mutex_);
+    stall_path_ = path;
+  }
+
+  /** Stalls that have triggered a write so far */
+  size_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+  /** Called at the end of every scope that began while enabled */
+  void checkStall(const char* name, uint64_t begin, uint64_t end) {
+    size_t count = trigger_count_.load(std::memory_order_acquire);
+
+    for (size_t t = 0; t < count; ++t) {
+      if ((triggers_[t].name == name || std::strcmp(triggers_[t].name, name) == 0) && end - begin > triggers_[t].threshold) {
+        stalled(end);
+        return;
+      }
+    }
+  }
+
+  /**
+   *  Everything the rings hold, as Chrome trace event JSON. Scopes cut in half
+   *  by a ring wrapping show up as unmatched ends, which the viewers ignore.
+   */
+  void write(std::ostream& os) {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    std::vector<Event> events;
+    bool first = true;
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for (const std::unique_ptr<Ring>& ring : rings_) {
+      if (!ring->name.empty()) {
+        os << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->thread
+           << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+        first = false;
+      }
+
+      // copy what is there, then keep only what wasn't overwritten meanwhile
+      const uint64_t size = ring->events.size();
+      const uint64_t end = ring->written.load(std::memory_order_acquire);
+      const uint64_t begin = end > size ? end - size : 0;
+
+      events.clear();
+      for (uint64_t k = begin; k < end; ++k)
+        events.push_back(ring->events[k % size]);
+
+      // the slot after the last written may be half way through being overwritten too
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t now = ring->written.load(std::memory_order_relaxed) + 1;
+      const uint64_t valid = now > size ? now - size : 0;
+
+      for (uint64_t k = std::max(begin, valid); k < end; ++k)
+        writeEvent(os, first, events[k - begin], ring->thread);
+    }
+
+    os << "\n]}\n";
+  }
+
+  /** write() to a file; false if it couldn't be opened */
+  bool writeFile(const std::string& path) {
+    std::ofstream file(path.c_str());
+
+    if (!file)
+      return false;
+
+    write(file);
+    return static_cast<bool>(file);
+  }
+};
+
+/** Records a begin event now and the matching end when it goes out of scope */
+class TraceScope {
+private:
+  const char* name_;
+  uint64_t begin_;
+
+public:
+  explicit TraceScope(const char* name) : name_(nullptr), begin_(0) {
+    Trace& trace = Trace::instance();
+
+    if (trace.enabled()) {
+      name_ = name;
+      begin_ = trace.now();
+      trace.record(name, 'B', begin_);
+    }
+  }
+
+  ~TraceScope() {
+    if (name_) {
+      Trace& trace = Trace::instance();
+      uint64_t end = trace.now();
+      trace.record(name_, 'E', end);
+      trace.checkStall(name_, begin_, end);
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+};
+
+/** A lock_guard that shows up on the timeline as a scope called name, but only when it had to wait */
+template<class Mutex>
+class TracedLock {
+private:
+  Mutex& mutex_;
+
+public:
+  TracedLock(Mutex& mutex, const char* name) : mutex_(mutex) {
+    if (mutex_.try_lock())
+      return;
+
+    TraceScope wait(name);
+    mutex_.lock();
+  }
+
+  ~TracedLock() { mutex_.unlock(); }
+
+  TracedLock(const TracedLock&) = delete;
+  TracedLock& operator=(const TracedLock&) = delete;
+};
+
+}
+
+#endif // FLATICS_TRACE_H
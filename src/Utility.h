@@ -11,10 +11,20 @@
 #define FLATICS_POSIX
 #endif
 
+#ifdef FLATICS_WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace flatics {
 
   #ifdef FLATICS_WINDOWS
-  #include <windows.h>
   inline void sleep_s(unsigned long s) {
     Sleep(s * 1000);
   }
@@ -24,8 +34,11 @@ namespace flatics {
   inline void sleep_us(unsigned long us) {
     Sleep(us/1000);
   }
+  /** Pin the calling thread to one logical cpu; returns false if that isn't possible */
+  inline bool pinThread(unsigned cpu) {
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+  }
   #else //POSIX style
-  #include <unistd.h>
   inline void sleep_s(unsigned long s) {
     sleep(s);
   }
@@ -35,6 +48,18 @@ namespace flatics {
   inline void sleep_us(unsigned long us) {
     usleep(us);
   }
+  /** Pin the calling thread to one logical cpu; returns false if that isn't possible */
+  inline bool pinThread(unsigned cpu) {
+  #ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+  #else
+    (void)cpu;
+    return false;
+  #endif
+  }
   #endif
 
   // The rdtsc update frequency (uh, not rate) on my processor -- don't hard code this
@@ -106,15 +131,23 @@ namespace flatics {
     return val2 > val1 ? val2 : val1;
   }
 
-  // Constants
-  const double EARTH_GRAVITY_ACCEL = 9.80665d;
-  const double G = 6.6738480e-11d;
+  // Constants, in whatever precision the simulation runs at so float code
+  // doesn't round trip every product through double
+  template<typename Scalar>
+  constexpr Scalar earthGravityAccel() { return static_cast<Scalar>(9.80665); }
+
+  template<typename Scalar>
+  constexpr Scalar gravitationalConstant() { return static_cast<Scalar>(6.6738480e-11); }
+
+  const double EARTH_GRAVITY_ACCEL = earthGravityAccel<double>();
+  const double G = gravitationalConstant<double>();
 
   // A random number for general use
   std::default_random_engine randGen;
 
-  void init() {
-    // TODO: set the random seed
+  /** Seed randGen; a Space has its own generator, see Space::setDeterministic() */
+  void init(unsigned seed = std::default_random_engine::default_seed) {
+    randGen.seed(seed);
   }
 }
 
@@ -4,6 +4,15 @@
 #include <cmath>
 #include <iostream>
 
+// SSE2 backed specializations of Vector2<double> and Vector2<float> are opt-in:
+// define FLATICS_SIMD_VECTOR2 to use them. In loops over many bodies the compiler
+// already vectorizes the scalar code across elements, and packing a single vector
+// into a register measured slower there (see bench/kernel_bench.cpp).
+#if defined(__SSE2__) && defined(FLATICS_SIMD_VECTOR2)
+#define FLATICS_SIMD
+#include <emmintrin.h>
+#endif
+
 namespace flatics {
 
 /** A vector of 2 dimensions */
@@ -41,7 +50,7 @@ public:
   bool operator!=(const Vector2<Scalar>& other) const;
 
   /** cast a vector to a bool: true if non-zero, false if zero */
-  operator bool() { return x != 0 || y != 0 ? true : false; }
+  operator bool() const { return x != 0 || y != 0 ? true : false; }
 
   bool isFinite() { return isfinite(x) && isfinite(y); }
 
@@ -70,6 +79,12 @@ public:
 
   Vector2<Scalar> normalized() const;
 
+  /** The unit vector in this direction, also handing back the original length (one sqrt for both) */
+  Vector2<Scalar> normalized(Scalar& length) const;
+
+  /** The unit vector in this direction, trading a little accuracy for speed where the hardware allows it */
+  Vector2<Scalar> normalizedFast() const;
+
   // TODO: make sure this works...
   /** The angle with respect to the x-axis */
   Scalar angle() const;
@@ -103,6 +118,10 @@ std::ostream& operator<<(std::ostream& os, const Vector2<Scalar>& vec);
 
 #include "Vector2.inl"
 
+#ifdef FLATICS_SIMD
+#include "Vector2Simd.inl"
+#endif
+
 } // namespace flatics
 
 #endif //FLATICS_VECTOR2_H
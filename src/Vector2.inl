@@ -118,7 +118,20 @@ inline Scalar Vector2<Scalar>::squared() const {
 
 template<typename Scalar>
 inline Vector2<Scalar> Vector2<Scalar>::normalized() const {
-  return Vector2(x/length(), y/length());
+  Scalar len = length();
+  return Vector2(x/len, y/len);
+}
+
+template<typename Scalar>
+inline Vector2<Scalar> Vector2<Scalar>::normalized(Scalar& length) const {
+  length = sqrt(x*x + y*y);
+  Scalar inverse = 1 / length;
+  return Vector2(x * inverse, y * inverse);
+}
+
+template<typename Scalar>
+inline Vector2<Scalar> Vector2<Scalar>::normalizedFast() const {
+  return normalized();
 }
 
 // TODO: make sure this works...
@@ -0,0 +1,269 @@
+// SSE2 specializations of the Vector2 hot paths.
+//
+// The layout of Vector2 is unchanged (x and y stay plain public members), so
+// the registers are loaded straight from &x. Vector2<double> fills an __m128d;
+// Vector2<float> uses the low half of an __m128.
+
+static_assert(sizeof(Vector2<double>) == 2 * sizeof(double), "Vector2<double> must be two packed doubles");
+static_assert(sizeof(Vector2<float>) == 2 * sizeof(float), "Vector2<float> must be two packed floats");
+
+namespace simd {
+  inline __m128d load(const Vector2<double>& vec) { return _mm_loadu_pd(&vec.x); }
+  inline void store(Vector2<double>& vec, __m128d v) { _mm_storeu_pd(&vec.x, v); }
+
+  inline Vector2<double> make(__m128d v) {
+    Vector2<double> result;
+    store(result, v);
+    return result;
+  }
+
+  /** x*x' + y*y' in the low lane */
+  inline __m128d dot(__m128d a, __m128d b) {
+    __m128d product = _mm_mul_pd(a, b);
+    return _mm_add_sd(product, _mm_unpackhi_pd(product, product));
+  }
+
+  inline __m128 load(const Vector2<float>& vec) {
+    return _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(&vec.x));
+  }
+  inline void store(Vector2<float>& vec, __m128 v) { _mm_storel_pi(reinterpret_cast<__m64*>(&vec.x), v); }
+
+  inline Vector2<float> make(__m128 v) {
+    Vector2<float> result;
+    store(result, v);
+    return result;
+  }
+
+  /** x*x' + y*y' in the low lane */
+  inline __m128 dot(__m128 a, __m128 b) {
+    __m128 product = _mm_mul_ps(a, b);
+    return _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+  }
+}
+
+// Vector2<double>
+
+template<>
+inline Vector2<double>::Vector2(double length, const Vector2<double>& direction) {
+  __m128d d = simd::load(direction);
+  __m128d scale = _mm_div_sd(_mm_set_sd(length), _mm_sqrt_sd(d, simd::dot(d, d)));
+  simd::store(*this, _mm_mul_pd(d, _mm_unpacklo_pd(scale, scale)));
+}
+
+template<>
+inline Vector2<double>& Vector2<double>::operator+=(const Vector2<double>& other) {
+  simd::store(*this, _mm_add_pd(simd::load(*this), simd::load(other)));
+  return *this;
+}
+
+template<>
+inline Vector2<double>& Vector2<double>::operator-=(const Vector2<double>& other) {
+  simd::store(*this, _mm_sub_pd(simd::load(*this), simd::load(other)));
+  return *this;
+}
+
+template<>
+inline Vector2<double>& Vector2<double>::operator*=(double n) {
+  simd::store(*this, _mm_mul_pd(simd::load(*this), _mm_set1_pd(n)));
+  return *this;
+}
+
+template<>
+inline Vector2<double>& Vector2<double>::operator/=(double n) {
+  simd::store(*this, _mm_div_pd(simd::load(*this), _mm_set1_pd(n)));
+  return *this;
+}
+
+template<>
+inline Vector2<double> Vector2<double>::operator+(const Vector2<double>& other) const {
+  return simd::make(_mm_add_pd(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::operator-(const Vector2<double>& other) const {
+  return simd::make(_mm_sub_pd(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::operator-() const {
+  return simd::make(_mm_xor_pd(simd::load(*this), _mm_set1_pd(-0.0)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::operator*(double n) const {
+  return simd::make(_mm_mul_pd(simd::load(*this), _mm_set1_pd(n)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::operator/(double n) const {
+  return simd::make(_mm_div_pd(simd::load(*this), _mm_set1_pd(n)));
+}
+
+template<>
+inline double Vector2<double>::dotProduct(const Vector2<double>& other) const {
+  return _mm_cvtsd_f64(simd::dot(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline double Vector2<double>::dotProduct(const Vector2<double>& left, const Vector2<double>& right) {
+  return _mm_cvtsd_f64(simd::dot(simd::load(left), simd::load(right)));
+}
+
+template<>
+inline double Vector2<double>::squared() const {
+  __m128d v = simd::load(*this);
+  return _mm_cvtsd_f64(simd::dot(v, v));
+}
+
+template<>
+template<>
+inline double Vector2<double>::length<double>() const {
+  __m128d v = simd::load(*this);
+  return _mm_cvtsd_f64(_mm_sqrt_sd(v, simd::dot(v, v)));
+}
+
+template<>
+template<>
+inline double Vector2<double>::distance<double>(const Vector2<double>& vec1, const Vector2<double>& vec2) {
+  __m128d d = _mm_sub_pd(simd::load(vec1), simd::load(vec2));
+  return _mm_cvtsd_f64(_mm_sqrt_sd(d, simd::dot(d, d)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::normalized() const {
+  __m128d v = simd::load(*this);
+  __m128d len = _mm_sqrt_sd(v, simd::dot(v, v));
+  return simd::make(_mm_div_pd(v, _mm_unpacklo_pd(len, len)));
+}
+
+template<>
+inline Vector2<double> Vector2<double>::normalized(double& length) const {
+  __m128d v = simd::load(*this);
+  __m128d len = _mm_sqrt_sd(v, simd::dot(v, v));
+  length = _mm_cvtsd_f64(len);
+  return simd::make(_mm_div_pd(v, _mm_unpacklo_pd(len, len)));
+}
+
+template<>
+inline Vector2<double> operator*(double n, const Vector2<double>& vec) {
+  return simd::make(_mm_mul_pd(_mm_set1_pd(n), simd::load(vec)));
+}
+
+// Vector2<float>
+
+template<>
+inline Vector2<float>::Vector2(float length, const Vector2<float>& direction) {
+  __m128 d = simd::load(direction);
+  __m128 scale = _mm_div_ss(_mm_set_ss(length), _mm_sqrt_ss(simd::dot(d, d)));
+  simd::store(*this, _mm_mul_ps(d, _mm_shuffle_ps(scale, scale, 0)));
+}
+
+template<>
+inline Vector2<float>& Vector2<float>::operator+=(const Vector2<float>& other) {
+  simd::store(*this, _mm_add_ps(simd::load(*this), simd::load(other)));
+  return *this;
+}
+
+template<>
+inline Vector2<float>& Vector2<float>::operator-=(const Vector2<float>& other) {
+  simd::store(*this, _mm_sub_ps(simd::load(*this), simd::load(other)));
+  return *this;
+}
+
+template<>
+inline Vector2<float>& Vector2<float>::operator*=(float n) {
+  simd::store(*this, _mm_mul_ps(simd::load(*this), _mm_set1_ps(n)));
+  return *this;
+}
+
+template<>
+inline Vector2<float>& Vector2<float>::operator/=(float n) {
+  simd::store(*this, _mm_div_ps(simd::load(*this), _mm_set1_ps(n)));
+  return *this;
+}
+
+template<>
+inline Vector2<float> Vector2<float>::operator+(const Vector2<float>& other) const {
+  return simd::make(_mm_add_ps(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::operator-(const Vector2<float>& other) const {
+  return simd::make(_mm_sub_ps(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::operator-() const {
+  return simd::make(_mm_xor_ps(simd::load(*this), _mm_set1_ps(-0.0f)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::operator*(float n) const {
+  return simd::make(_mm_mul_ps(simd::load(*this), _mm_set1_ps(n)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::operator/(float n) const {
+  return simd::make(_mm_div_ps(simd::load(*this), _mm_set1_ps(n)));
+}
+
+template<>
+inline float Vector2<float>::dotProduct(const Vector2<float>& other) const {
+  return _mm_cvtss_f32(simd::dot(simd::load(*this), simd::load(other)));
+}
+
+template<>
+inline float Vector2<float>::dotProduct(const Vector2<float>& left, const Vector2<float>& right) {
+  return _mm_cvtss_f32(simd::dot(simd::load(left), simd::load(right)));
+}
+
+template<>
+inline float Vector2<float>::squared() const {
+  __m128 v = simd::load(*this);
+  return _mm_cvtss_f32(simd::dot(v, v));
+}
+
+template<>
+template<>
+inline float Vector2<float>::length<float>() const {
+  __m128 v = simd::load(*this);
+  return _mm_cvtss_f32(_mm_sqrt_ss(simd::dot(v, v)));
+}
+
+template<>
+template<>
+inline float Vector2<float>::distance<float>(const Vector2<float>& vec1, const Vector2<float>& vec2) {
+  __m128 d = _mm_sub_ps(simd::load(vec1), simd::load(vec2));
+  return _mm_cvtss_f32(_mm_sqrt_ss(simd::dot(d, d)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::normalized() const {
+  __m128 v = simd::load(*this);
+  __m128 len = _mm_sqrt_ss(simd::dot(v, v));
+  return simd::make(_mm_div_ps(v, _mm_shuffle_ps(len, len, 0)));
+}
+
+template<>
+inline Vector2<float> Vector2<float>::normalized(float& length) const {
+  __m128 v = simd::load(*this);
+  __m128 len = _mm_sqrt_ss(simd::dot(v, v));
+  length = _mm_cvtss_f32(len);
+  return simd::make(_mm_div_ps(v, _mm_shuffle_ps(len, len, 0)));
+}
+
+// rsqrt estimate refined by one Newton-Raphson step: ~22 bits, no sqrt or divide
+template<>
+inline Vector2<float> Vector2<float>::normalizedFast() const {
+  __m128 v = simd::load(*this);
+  __m128 squared = simd::dot(v, v);
+  __m128 estimate = _mm_rsqrt_ss(squared);
+  __m128 refined = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), estimate),
+                              _mm_sub_ss(_mm_set_ss(3.0f), _mm_mul_ss(squared, _mm_mul_ss(estimate, estimate))));
+  return simd::make(_mm_mul_ps(v, _mm_shuffle_ps(refined, refined, 0)));
+}
+
+template<>
+inline Vector2<float> operator*(float n, const Vector2<float>& vec) {
+  return simd::make(_mm_mul_ps(_mm_set1_ps(n), simd::load(vec)));
+}
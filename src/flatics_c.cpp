@@ -0,0 +1,235 @@
+// The C interface of flatics_c.h over Space, built as a shared library:
+//
+//   g++ -std=c++11 -O2 -shared -fPIC -fvisibility=hidden -pthread -DFLATICS_C_BUILD flatics_c.cpp -o libflatics.so
+//
+// (cb/FlaticsC.cbp builds the same on Windows, as flatics.dll). Add
+// -DFLATICS_C_FLOAT for a single precision library.
+
+#include "flatics_c.h"
+
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+#include <cstddef>
+#include <memory>
+
+using namespace flatics;
+
+typedef Space<flatics_real, Vector2<flatics_real> > World;
+typedef World::Objects::value_type Body;
+
+struct flatics_space {
+  std::unique_ptr<ThreadPool> pool; // outlives the world using it
+  World world;
+
+  flatics_space(size_t width, size_t height, World::BoundaryMode boundary) : world(width, height, boundary) {}
+};
+
+namespace {
+
+// the C enums are numbered like Space's, so they convert by value
+static_assert(int(FLATICS_NONE) == int(World::NONE) && int(FLATICS_WRAP) == int(World::WRAP) &&
+              int(FLATICS_BOUNCE) == int(World::BOUNCE), "boundary modes");
+static_assert(int(FLATICS_BRUTE_FORCE) == int(World::BRUTE_FORCE) && int(FLATICS_AABB_TREE) == int(World::AABB_TREE) &&
+              int(FLATICS_SWEEP_AND_PRUNE) == int(World::SWEEP_AND_PRUNE) && int(FLATICS_SPATIAL_HASH) == int(World::SPATIAL_HASH),
+              "broadphase modes");
+static_assert(int(FLATICS_KEEP) == int(World::KEEP) && int(FLATICS_PARK) == int(World::PARK) && int(FLATICS_CULL) == int(World::CULL),
+              "far field policies");
+static_assert(int(FLATICS_INELASTIC) == int(World::INELASTIC) && int(FLATICS_ELASTIC) == int(World::ELASTIC), "restitution models");
+
+/** Run call, turning anything it throws into a 0 return: exceptions can't cross into C */
+template<typename Call>
+int guarded(Call call) {
+  try {
+    call();
+    return 1;
+  } catch (...) {
+    return 0;
+  }
+}
+
+/** A view of the field member is the first body's value of */
+flatics_view viewOf(const World::Objects& objects, const flatics_real& member) {
+  flatics_view view = { &member, sizeof(Body), objects.size() };
+  return view;
+}
+
+}
+
+extern "C" {
+
+FLATICS_API int flatics_version(void) { return FLATICS_C_VERSION; }
+
+FLATICS_API size_t flatics_real_size(void) { return sizeof(flatics_real); }
+
+FLATICS_API flatics_space* flatics_create(size_t width, size_t height, flatics_boundary boundary) {
+  try {
+    return new flatics_space(width, height, static_cast<World::BoundaryMode>(boundary));
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+FLATICS_API void flatics_destroy(flatics_space* space) {
+  delete space;
+}
+
+FLATICS_API int flatics_step(flatics_space* space, flatics_real dt) {
+  return guarded([&] { space->world.update(dt); });
+}
+
+FLATICS_API size_t flatics_add(flatics_space* space, size_t count, const flatics_real* x, const flatics_real* y,
+                               const flatics_real* vx, const flatics_real* vy, const flatics_real* radius,
+                               const flatics_real* mass, size_t* ids) {
+  // exceptions can't cross into C; a failure just stops adding
+  size_t added = 0;
+
+  try {
+    space->world.reserve(space->world.objects().size() + count);
+
+    for (; added < count; ++added) {
+      const Vector2<flatics_real> velocity(vx ? vx[added] : 0, vy ? vy[added] : 0);
+      const size_t id = space->world.addCircle(radius[added], mass[added], Vector2<flatics_real>(x[added], y[added]), velocity);
+
+      if (ids)
+        ids[added] = id;
+    }
+  } catch (...) {
+  }
+
+  return added;
+}
+
+FLATICS_API int flatics_remove(flatics_space* space, const size_t* ids, size_t count, size_t* removed) {
+  return guarded([&] {
+    const size_t gone = space->world.removeCircles(ids, count);
+
+    if (removed)
+      *removed = gone;
+  });
+}
+
+FLATICS_API int flatics_clear(flatics_space* space) {
+  return guarded([&] { space->world.clear(); });
+}
+
+FLATICS_API size_t flatics_count(const flatics_space* space) {
+  return space->world.objects().size();
+}
+
+FLATICS_API size_t flatics_index_of(const flatics_space* space, size_t id) {
+  return space->world.indexOf(id);
+}
+
+FLATICS_API int flatics_view_of(const flatics_space* space, flatics_field field, flatics_view* view) {
+  const World::Objects& objects = space->world.objects();
+
+  if (objects.empty()) {
+    flatics_view empty = { nullptr, sizeof(Body), 0 };
+    *view = empty;
+    return field >= FLATICS_POSITION_X && field <= FLATICS_MASS;
+  }
+
+  const Body& first = objects.front();
+
+  switch (field) {
+  case FLATICS_POSITION_X:
+    *view = viewOf(objects, first.position().x);
+    return 1;
+  case FLATICS_POSITION_Y:
+    *view = viewOf(objects, first.position().y);
+    return 1;
+  case FLATICS_VELOCITY_X:
+    *view = viewOf(objects, first.velocity().x);
+    return 1;
+  case FLATICS_VELOCITY_Y:
+    *view = viewOf(objects, first.velocity().y);
+    return 1;
+  case FLATICS_RADIUS:
+    *view = viewOf(objects, first.radius());
+    return 1;
+  case FLATICS_MASS:
+    *view = viewOf(objects, first.mass());
+    return 1;
+  }
+
+  return 0;
+}
+
+FLATICS_API const size_t* flatics_ids(const flatics_space* space, size_t* count) {
+  if (count)
+    *count = space->world.ids().size();
+
+  return space->world.ids().data();
+}
+
+FLATICS_API void flatics_origin(const flatics_space* space, double* x, double* y) {
+  *x = space->world.originX();
+  *y = space->world.originY();
+}
+
+FLATICS_API flatics_real flatics_energy(const flatics_space* space) {
+  return space->world.energy();
+}
+
+FLATICS_API int flatics_set_boundary(flatics_space* space, flatics_boundary boundary) {
+  return guarded([&] { space->world.setBoundaryMode(static_cast<World::BoundaryMode>(boundary)); });
+}
+
+FLATICS_API int flatics_set_gravity(flatics_space* space, flatics_real x, flatics_real y) {
+  return guarded([&] { space->world.setGravity(Vector2<flatics_real>(x, y)); });
+}
+
+FLATICS_API int flatics_set_object_gravity(flatics_space* space, int enabled) {
+  return guarded([&] { space->world.setObjectGravity(enabled != 0); });
+}
+
+FLATICS_API int flatics_set_broadphase(flatics_space* space, flatics_broadphase broadphase) {
+  return guarded([&] { space->world.setBroadphase(static_cast<World::BroadphaseMode>(broadphase)); });
+}
+
+FLATICS_API int flatics_set_restitution(flatics_space* space, flatics_restitution restitution) {
+  return guarded([&] { space->world.setRestitutionModel(static_cast<World::RestitutionModel>(restitution)); });
+}
+
+FLATICS_API int flatics_set_reorder(flatics_space* space, size_t interval, flatics_real disorder) {
+  return guarded([&] { space->world.setReorderPolicy(interval, disorder); });
+}
+
+FLATICS_API int flatics_set_rebase_distance(flatics_space* space, flatics_real distance) {
+  return guarded([&] { space->world.setRebaseDistance(distance); });
+}
+
+FLATICS_API int flatics_set_memory_policy(flatics_space* space, int huge_pages, int first_touch) {
+  return guarded([&] { space->world.setMemoryPolicy(huge_pages != 0, first_touch != 0); });
+}
+
+FLATICS_API int flatics_set_far_field(flatics_space* space, flatics_far_field policy, flatics_real distance) {
+  return guarded([&] { space->world.setFarField(static_cast<World::FarFieldPolicy>(policy), distance); });
+}
+
+FLATICS_API size_t flatics_parked_count(const flatics_space* space) {
+  return space->world.parked().size();
+}
+
+FLATICS_API int flatics_set_threads(flatics_space* space, size_t threads) {
+  return guarded([&] {
+    // detach the old pool before it goes
+    space->world.setThreadPool(nullptr);
+    space->pool.reset();
+
+    if (threads == 0)
+      return;
+
+    space->pool.reset(new ThreadPool(threads));
+    space->world.setThreadPool(space->pool.get());
+  });
+}
+
+FLATICS_API int flatics_set_shared_state(flatics_space* space, const char* name, size_t capacity) {
+  bool opened = false;
+  return guarded([&] { opened = space->world.setSharedState(name ? name : "", capacity); }) && opened;
+}
+
+}
@@ -0,0 +1,163 @@
+#ifndef FLATICS_C_H
+#define FLATICS_C_H
+
+/*
+ *  C interface to Flatics, for hosts that link the compiled library instead
+ *  of building Space themselves.
+ *
+ *  A flatics_space owns one simulation and, optionally, a thread pool for
+ *  it. Bodies go in and out in bulk, by arrays, and their state comes back
+ *  as views: a pointer to the first body's value and the distance in bytes
+ *  to the next one's, straight into the simulation's own arrays, so reading
+ *  a million positions is a loop over memory with no copies and no calls.
+ *
+ *  A view stays valid until the next call that changes the space (a step,
+ *  adding or removing bodies, clearing, rewinding, or any setter), which may
+ *  move, reorder or reallocate the arrays; fetch it again after that. Calls
+ *  on one space must not overlap with each other, or with reading its views.
+ *
+ *  Functions that can fail return nonzero on success and 0 on failure, which
+ *  is how any error inside the library (running out of memory, say) comes
+ *  back: nothing is thrown across the interface. The
+ *  library is built with double precision unless FLATICS_C_FLOAT is defined,
+ *  and a host must be compiled the same way: check flatics_real_size().
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  ifdef FLATICS_C_BUILD
+#    define FLATICS_API __declspec(dllexport)
+#  else
+#    define FLATICS_API __declspec(dllimport)
+#  endif
+#else
+#  define FLATICS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped whenever a declaration here changes incompatibly */
+#define FLATICS_C_VERSION 2
+
+#ifdef FLATICS_C_FLOAT
+typedef float flatics_real;
+#else
+typedef double flatics_real;
+#endif
+
+/* returned by flatics_index_of() for ids that aren't in the simulation */
+#define FLATICS_NO_INDEX ((size_t)-1)
+
+typedef struct flatics_space flatics_space;
+
+typedef enum flatics_boundary {
+  FLATICS_NONE = 0,
+  FLATICS_WRAP = 1,
+  FLATICS_BOUNCE = 2
+} flatics_boundary;
+
+typedef enum flatics_broadphase {
+  FLATICS_BRUTE_FORCE = 0,
+  FLATICS_AABB_TREE = 1,
+  FLATICS_SWEEP_AND_PRUNE = 2,
+  FLATICS_SPATIAL_HASH = 3
+} flatics_broadphase;
+
+typedef enum flatics_far_field {
+  FLATICS_KEEP = 0,
+  FLATICS_PARK = 1,
+  FLATICS_CULL = 2
+} flatics_far_field;
+
+typedef enum flatics_restitution {
+  FLATICS_INELASTIC = 0,
+  FLATICS_ELASTIC = 1
+} flatics_restitution;
+
+typedef enum flatics_field {
+  FLATICS_POSITION_X = 0,
+  FLATICS_POSITION_Y = 1,
+  FLATICS_VELOCITY_X = 2,
+  FLATICS_VELOCITY_Y = 3,
+  FLATICS_RADIUS = 4,
+  FLATICS_MASS = 5
+} flatics_field;
+
+/* One field of every body: body i's value is at (const char*)data + i * stride */
+typedef struct flatics_view {
+  const flatics_real* data;
+  size_t stride;
+  size_t count;
+} flatics_view;
+
+/* FLATICS_C_VERSION of the library, and sizeof(flatics_real) it was built with */
+FLATICS_API int flatics_version(void);
+FLATICS_API size_t flatics_real_size(void);
+
+/* A world of the given size; NULL if it couldn't be made */
+FLATICS_API flatics_space* flatics_create(size_t width, size_t height, flatics_boundary boundary);
+FLATICS_API void flatics_destroy(flatics_space* space);
+
+/* Advance by dt seconds */
+FLATICS_API int flatics_step(flatics_space* space, flatics_real dt);
+
+/*
+ *  Add count bodies from parallel arrays; vx, vy and ids may be NULL (at rest,
+ *  ids not wanted). Each body's stable id is written to ids. Returns how many
+ *  were added, which is less than count only if memory ran out.
+ */
+FLATICS_API size_t flatics_add(flatics_space* space, size_t count, const flatics_real* x, const flatics_real* y,
+                               const flatics_real* vx, const flatics_real* vy, const flatics_real* radius,
+                               const flatics_real* mass, size_t* ids);
+
+/* Remove the bodies with the given ids, skipping unknown ones; how many went is written to removed if not NULL */
+FLATICS_API int flatics_remove(flatics_space* space, const size_t* ids, size_t count, size_t* removed);
+
+FLATICS_API int flatics_clear(flatics_space* space);
+
+FLATICS_API size_t flatics_count(const flatics_space* space);
+
+/* Current index of a body in the views, or FLATICS_NO_INDEX */
+FLATICS_API size_t flatics_index_of(const flatics_space* space, size_t id);
+
+/* A view of one field of every body, in the same order as flatics_ids(); 0 for an unknown field */
+FLATICS_API int flatics_view_of(const flatics_space* space, flatics_field field, flatics_view* view);
+
+/* The bodies' ids, contiguous, in view order; count is written if not NULL */
+FLATICS_API const size_t* flatics_ids(const flatics_space* space, size_t* count);
+
+/* World coordinates of the point positions are relative to (non-zero once an unbounded world rebases) */
+FLATICS_API void flatics_origin(const flatics_space* space, double* x, double* y);
+
+FLATICS_API flatics_real flatics_energy(const flatics_space* space);
+
+/* Configuration; each returns 0 if it failed */
+FLATICS_API int flatics_set_boundary(flatics_space* space, flatics_boundary boundary);
+FLATICS_API int flatics_set_gravity(flatics_space* space, flatics_real x, flatics_real y);
+FLATICS_API int flatics_set_object_gravity(flatics_space* space, int enabled);
+FLATICS_API int flatics_set_broadphase(flatics_space* space, flatics_broadphase broadphase);
+FLATICS_API int flatics_set_restitution(flatics_space* space, flatics_restitution restitution);
+FLATICS_API int flatics_set_reorder(flatics_space* space, size_t interval, flatics_real disorder);
+FLATICS_API int flatics_set_rebase_distance(flatics_space* space, flatics_real distance);
+FLATICS_API int flatics_set_memory_policy(flatics_space* space, int huge_pages, int first_touch);
+
+/* Without a boundary, park or cull bodies escaping beyond distance from the center of mass */
+FLATICS_API int flatics_set_far_field(flatics_space* space, flatics_far_field policy, flatics_real distance);
+
+/* Bodies currently parked; they are not in the views */
+FLATICS_API size_t flatics_parked_count(const flatics_space* space);
+
+/* Step on threads worker threads owned by the space (0 steps on the caller only); 0 on failure */
+FLATICS_API int flatics_set_threads(flatics_space* space, size_t threads);
+
+/* Publish every step to shared memory under name (see SharedState.h); NULL stops. 0 on failure */
+FLATICS_API int flatics_set_shared_state(flatics_space* space, const char* name, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLATICS_C_H */
@@ -1,5 +1,10 @@
 #include "Space.h"
 #include "Circle.h"
+#include "Heatmap.h"
+#include "RenderList.h"
+#include "Scenario.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 #include "Vector2.h"
 #include "Utility.h"
 
@@ -9,6 +14,17 @@
 #include <chrono>
 #include <thread>
 
+namespace flatics {
+
+template<>
+struct RenderVertexTraits<sf::Vertex> {
+  static sf::Vertex make(float x, float y, const RenderColor& color) {
+    return sf::Vertex(sf::Vector2f(x, y), sf::Color(color.r, color.g, color.b, color.a));
+  }
+};
+
+}
+
 template<typename SFMLType, typename FlaticsType>
 sf::Vector2<SFMLType> toSf(flatics::Vector2<FlaticsType> vec) {
   return sf::Vector2<SFMLType>(vec.x, vec.y);
@@ -18,19 +34,22 @@ void updateInAThreadTest(flatics::Space<double, flatics::Vector2<double> >* spac
   using namespace flatics;
   using namespace std::chrono;
 
+  Trace::instance().setThreadName("physics");
+
   high_resolution_clock::time_point printTimerStart = high_resolution_clock::now();
 
   double dt = 2e-6;
 
-  uint64_t start = cycleCount();
-  uint64_t end;
+  // the space takes fixed steps, so dt is only how much real time to cover
+  steady_clock::time_point start = steady_clock::now();
+  steady_clock::time_point end;
 
   while (1) {
     space->update(dt);
 
-    end = cycleCount();
-    dt = static_cast<double>(end - start) / TICK_RATE;
-    start = cycleCount();
+    end = steady_clock::now();
+    dt = duration<double>(end - start).count();
+    start = end;
 
     duration<double> printTime = duration_cast<duration<double> >(high_resolution_clock::now() - printTimerStart);
 
@@ -41,7 +60,7 @@ void updateInAThreadTest(flatics::Space<double, flatics::Vector2<double> >* spac
   }
 }
 
-int main() {
+int main(int argc, char** argv) {
   using namespace flatics;
   using namespace std::chrono;
   using namespace std;
@@ -61,48 +80,49 @@ int main() {
   sf::RenderWindow window(sf::VideoMode(WIDTH, HEIGHT), "flatics!", sf::Style::Default, settings);
   window.setFramerateLimit(60);
 
-  const Scalar RADIUS = 25;
-
-  const Vec start0 = {600, 150};
-  const Vec start1 = {700, 400};
-  const Vec start2 = {200, 500};
-  const Vec start3 = {800, 500};
-  const Vec start4 = {900, 500};
-  const Vec start5 = {1000, 600};
-
-  const Vec planet = {800, 500};
-  const Vec satellite = {800, 200};
-  const Vec satelliteMotion = {150, 0};
-
-  const Vec moveUp = {0, -100};
-  const Vec moveDown = {0, 1};
-  const Vec moveRight = {200, 0};
-  const Vec moveLeft = {-70, 0};
-  const Vec still = {0, 0};
-
-  Space space(WIDTH, HEIGHT);
-
-
-  space.addCircle(50, 1e17, planet, still);
-  //space.addCircle(50, 1e17, start5, still);
-  space.addCircle(3, 100,  satellite, satelliteMotion);
-
-  space.addCircle(RADIUS, RADIUS*RADIUS, start2, moveRight);
-/*
-  space.addCircle(RADIUS, RADIUS*RADIUS,   start3, still);
-  space.addCircle(RADIUS, 10,   150, -5);
-  space.addCircle(RADIUS, 101,   start4, moveLeft);
-*/
-
-  const sf::Color COLORS[] = {
-    sf::Color::Green,
-    sf::Color::White,
-    sf::Color::Red,
-    sf::Color::Blue,
-    sf::Color::Yellow,
-    sf::Color::Magenta,
-    sf::Color::Cyan,
-  };
+  // the scene comes from a scenario file, the demo's own unless one is given
+  const std::string scenePath = argc > 1 ? argv[1] : "../scenes/demo.scene";
+  Scenario scenario;
+
+  if (!scenario.load(scenePath))
+    std::cout << scenePath << ": " << scenario.error() << "; starting empty" << std::endl;
+
+  // serves the step metrics on a loopback port to a local Prometheus (or
+  // tools/metrics_scraper 9464); declared first so it outlives the space
+  SocketExporter metricsExporter;
+
+  // builds each frame's vertex list, and generates the scene to begin with
+  ThreadPool renderPool;
+
+  Space space(static_cast<size_t>(scenario.width()), static_cast<size_t>(scenario.height()));
+
+  // fixed steps and a seed, so the session can be replayed from its journal
+  // with tools/replay
+  space.setDeterministic(static_cast<uint64_t>(system_clock::now().time_since_epoch().count()), 1.0 / 240);
+
+  if (metricsExporter.open(9464))
+    space.setMetrics(true, &metricsExporter);
+
+  space.setThreadPool(&renderPool);
+  scenario.populate(space);
+  space.setThreadPool(nullptr);
+  std::cout << "Loaded " << space.objects().size() << " bodies from " << scenePath << std::endl;
+
+  if (space.startJournal("flatics-journal.flj"))
+    std::cout << "Journaling the session to flatics-journal.flj" << std::endl;
+
+  // the frame is built as one vertex list on renderPool, then drawn in one call
+  RenderSnapshot<Scalar> snapshot;
+  RenderList<sf::Vertex> renderList;
+  const RenderCamera camera = { 0, 0, 1, static_cast<size_t>(WIDTH), static_cast<size_t>(HEIGHT) };
+
+  // past this many bodies the frame is a density image instead, uploaded as one texture; H cycles what it shows
+  const size_t HEATMAP_BODIES = 100000;
+  Heatmap heatmap;
+  heatmap.setBlur(1.5);
+  sf::Texture heatmapTexture;
+  heatmapTexture.create(camera.width, camera.height);
+  sf::Sprite heatmapSprite(heatmapTexture);
 
   /* Just testing this out... remove this code later
   sf::ConvexShape polygon;
@@ -123,11 +143,21 @@ int main() {
 
   unsigned short timer = 0;
 
+  // record the timeline from the start; T writes it out, and a frame or
+  // physics step over 50 ms writes it to flatics-stall.json by itself
+  Trace& trace = Trace::instance();
+  trace.setThreadName("render");
+  trace.addStallTrigger("frame", 0.05);
+  trace.addStallTrigger("Space::update", 0.05);
+  trace.setEnabled(true);
+
   // START THE PHYSICS THREAD
   std::thread physics(updateInAThreadTest, &space);
   physics.detach();
 
   while (window.isOpen()) {
+    TraceScope frame("frame");
+
     sf::Event event;
     while (window.pollEvent(event)) {
       switch (event.type) {
@@ -159,25 +189,23 @@ int main() {
           space.energize(0.75);
           break;
         case sf::Keyboard::Down:
-          space.global_gravity_.y += INCREMENT;
+          space.setGravity(space.global_gravity_ + Vec(0, INCREMENT));
           break;
         case sf::Keyboard::Up:
-          space.global_gravity_.y -= INCREMENT;
+          space.setGravity(space.global_gravity_ - Vec(0, INCREMENT));
           break;
         case sf::Keyboard::Left:
-          space.global_gravity_.x -= INCREMENT;
+          space.setGravity(space.global_gravity_ - Vec(INCREMENT, 0));
           break;
         case sf::Keyboard::Right:
-          space.global_gravity_.x += INCREMENT;
+          space.setGravity(space.global_gravity_ + Vec(INCREMENT, 0));
           break;
         case sf::Keyboard::Space:
-          space.global_gravity_.x = 0;
-          space.global_gravity_.y = EARTH_GRAVITY_ACCEL;
+          space.setGravity(Vec(0, EARTH_GRAVITY_ACCEL));
           break;
         case sf::Keyboard::Numpad0:
         case sf::Keyboard::Num0:
-          space.global_gravity_.x = 0;
-          space.global_gravity_.y = 0;
+          space.setGravity(Vec(0, 0));
           break;
         case sf::Keyboard::X:
           space.halt();
@@ -194,6 +222,14 @@ int main() {
           space.clear();
         case sf::Keyboard::R:
           space.report();
+          break;
+        case sf::Keyboard::H:
+          heatmap.setQuantity(Heatmap::Quantity((heatmap.quantity() + 1) % (Heatmap::SPEED + 1)));
+          break;
+        case sf::Keyboard::T:
+          if (trace.writeFile("flatics-trace.json"))
+            std::cout << "Wrote the trace to flatics-trace.json" << std::endl;
+          break;
         default:
           break;
         }
@@ -207,33 +243,39 @@ int main() {
 
 
     {
+      TraceScope draw("draw");
       window.clear();
-      //for (const auto& obj : space.objects()) {
-      for (size_t i = 0; i < space.objects().size(); ++i) {
-        const auto& obj(space.objects()[i]);
-        /*
-            // collisions with triangle
-            if (Vec::closeToRectangle(obj.position(), w_pt1, w_pt2, RADIUS) && Vec::distancePointToLine(obj.position(), w_pt1, w_pt2) <= RADIUS) {
-              obj.bounce(pt1-pt2);
-              std::cout << obj.position() << " just hit side 1 <" << w_pt1 << ", " << w_pt2 << ">!\n";
-            } else if (Vec::closeToRectangle(obj.position(), w_pt3, w_pt1, RADIUS) && Vec::distancePointToLine(obj.position(), w_pt3, w_pt1) <= RADIUS) {
-              obj.bounce(pt1-pt3);
-              std::cout << obj.position() << " just hit side 3 <" << w_pt3 << ", " << w_pt1 << ">!\n";
-            } else if (Vec::closeToRectangle(obj.position(), w_pt3, w_pt2, RADIUS) && Vec::distancePointToLine(obj.position(), w_pt3, w_pt2) <= RADIUS) {
-              obj.bounce(pt2-pt3);
-              std::cout << obj.position() << " just hit side 2 <" << w_pt2 << ", " << w_pt3 << ">!\n";
-            }
-        */
-
-        //s++->setPosition(obj.position().x - obj.radius(), obj.position().y - obj.radius());
-        sf::CircleShape shape(obj.radius());
-        shape.setFillColor(COLORS[i % 7]);
-        shape.setPosition(obj.position().x - obj.radius(), obj.position().y - obj.radius());
-        window.draw(shape);
+
+      {
+        TraceScope capture("snapshot");
+        // under the space's lock: the physics thread is stepping it meanwhile
+        space.visit([&snapshot](const Space::Objects& objects, const Space::Ids& ids, double originX, double originY) {
+          snapshot.capture(objects, ids, originX, originY);
+        });
+      }
+
+      if (snapshot.count > HEATMAP_BODIES) {
+        {
+          TraceScope build("heatmap");
+          heatmap.build(snapshot, camera, &renderPool);
+        }
+
+        heatmapTexture.update(heatmap.pixels().data());
+        window.draw(heatmapSprite);
+      } else {
+        {
+          TraceScope build("render list");
+          renderList.build(snapshot, camera, &renderPool);
+        }
+
+        window.draw(renderList.vertices().data(), renderList.vertices().size(), sf::Triangles);
       }
     }
 
-    window.display();
+    {
+      TraceScope display("display");
+      window.display();
+    }
 
     high_resolution_clock::time_point frameEnd = high_resolution_clock::now();
     duration<double> frameTime = duration_cast<duration<double> >(frameEnd - frameStart);
@@ -245,5 +287,7 @@ int main() {
     }
   }
 
+  space.stopJournal();
+
   return 0;
 }
@@ -0,0 +1,145 @@
+// Checks that a Space's steps stop allocating once a workload has settled:
+// every temporary comes from its StepArena or from buffers it keeps.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src allocation_check.cpp -o allocation_check
+//   ./allocation_check [bodies, default 3000]
+//
+// Replaces the global operator new with one that counts calls, then for every
+// broadphase, gravity solver and optional pass, serially and on a thread pool,
+// sets up a world of bouncing bodies, steps it until it has settled and counts
+// the allocations over the steps after that. Any allocation there, or any
+// block the arena had to add, fails the check. It prints the arena's
+// high-water mark per configuration and exits nonzero on any failure.
+
+#include "Circle.h"
+#include "Metrics.h"
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+}
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+
+  if (void* memory = std::malloc(size ? size : 1))
+    return memory;
+
+  throw std::bad_alloc();
+}
+
+// GCC can't tell that these pair with the operator new above once inlined
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+using namespace flatics;
+
+typedef Space<double, Vector2<double> > World;
+
+const int WARM_UP_STEPS = 100;
+const int CHECKED_STEPS = 100;
+
+/** Step a world set up by configure; returns whether the checked steps allocated nothing */
+bool check(const char* name, const std::function<void(World&)>& configure, ThreadPool* pool, int bodies) {
+  World world(2000, 2000, World::BOUNCE);
+  world.setThreadPool(pool);
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> position(50, 1950), velocity(-30, 30);
+
+  for (int i = 0; i < bodies; ++i)
+    world.addCircle(3.0, 1.0, Vector2<double>(position(rng), position(rng)), Vector2<double>(velocity(rng), velocity(rng)));
+
+  configure(world);
+
+  for (int step = 0; step < WARM_UP_STEPS; ++step)
+    world.update(0.002);
+
+  const uint64_t arena_blocks = world.arena().heapAllocations();
+  const uint64_t before = allocations.load();
+
+  for (int step = 0; step < CHECKED_STEPS; ++step)
+    world.update(0.002);
+
+  const uint64_t allocated = allocations.load() - before;
+  const uint64_t grown = world.arena().heapAllocations() - arena_blocks;
+  const bool ok = allocated == 0 && grown == 0;
+
+  std::printf("  %-18s %-7s %8llu allocations %3llu arena blocks %10zu bytes high water  %s\n", name, pool ? "pool" : "serial",
+              static_cast<unsigned long long>(allocated), static_cast<unsigned long long>(grown), world.arena().highWater(),
+              ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const int bodies = argc > 1 ? std::atoi(argv[1]) : 3000;
+
+  struct Configuration {
+    const char* name;
+    std::function<void(World&)> configure;
+  };
+
+  // served but never scraped, as in a session nobody is watching
+  SocketExporter exporter;
+  exporter.open(0);
+
+  const Configuration configurations[] = {
+    { "brute force", [](World& world) { world.setObjectGravity(false); } },
+    { "direct gravity", [](World&) {} },
+    { "aabb tree", [](World& world) { world.setObjectGravity(false); world.setBroadphase(World::AABB_TREE); } },
+    { "sweep and prune", [](World& world) { world.setObjectGravity(false); world.setBroadphase(World::SWEEP_AND_PRUNE); } },
+    { "spatial hash", [](World& world) { world.setObjectGravity(false); world.setBroadphase(World::SPATIAL_HASH); } },
+    { "cutoff gravity", [](World& world) { world.setCutoffGravity(50); world.setBroadphase(World::SPATIAL_HASH); } },
+    { "particle mesh", [](World& world) {
+        world.setBoundaryMode(World::WRAP);
+        world.setGravitySolver(World::PARTICLE_MESH);
+        world.setParticleMesh(64, 64);
+      } },
+    { "p3m", [](World& world) {
+        world.setBoundaryMode(World::WRAP);
+        world.setGravitySolver(World::PARTICLE_MESH);
+        world.setParticleMesh(64, 64, ParticleMesh<double, Vector2<double> >::CIC, 100);
+      } },
+    { "block timesteps", [](World& world) { world.setBlockTimesteps(4); } },
+    { "reorder", [](World& world) { world.setObjectGravity(false); world.setReorderPolicy(5); } },
+    { "metrics, contacts", [](World& world) {
+        world.setObjectGravity(false);
+        world.setBroadphase(World::AABB_TREE);
+        world.setMetrics(true);
+        world.setContactEvents(true);
+      } },
+    { "socket exporter", [&exporter](World& world) {
+        world.setObjectGravity(false);
+        world.setMetrics(true, &exporter);
+      } },
+  };
+
+  ThreadPool pool(4);
+  int failures = 0;
+
+  std::printf("%d bodies, %d steps after %d to settle\n", bodies, CHECKED_STEPS, WARM_UP_STEPS);
+
+  for (ThreadPool* workers : { static_cast<ThreadPool*>(nullptr), &pool }) {
+    for (const Configuration& configuration : configurations)
+      failures += !check(configuration.name, configuration.configure, workers, bodies);
+  }
+
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/*
+ *  A minimal C host of the Flatics shared library, as a check of the C API
+ *  from plain C and an example of reading the views.
+ *
+ *    g++ -std=c++11 -O2 -shared -fPIC -fvisibility=hidden -pthread -DFLATICS_C_BUILD ../src/flatics_c.cpp -o libflatics.so
+ *    cc -std=c99 -O2 -I../src c_host.c -L. -lflatics -o c_host
+ *    LD_LIBRARY_PATH=. ./c_host [bodies, default 100000]
+ *
+ *  Adds the bodies in one call, steps for a second of simulated time, takes
+ *  a tenth of them out again, and reports the centre of mass and the
+ *  fastest body from the views, without copying anything out.
+ */
+
+#include "flatics_c.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define AT(view, i) (*(const flatics_real*)((const char*)(view).data + (i) * (view).stride))
+
+static void report(const flatics_space* space) {
+  flatics_view x, y, vx, vy, mass;
+  size_t count, i, fastest = 0;
+  const size_t* ids = flatics_ids(space, &count);
+  double total = 0, cx = 0, cy = 0, top = -1;
+
+  flatics_view_of(space, FLATICS_POSITION_X, &x);
+  flatics_view_of(space, FLATICS_POSITION_Y, &y);
+  flatics_view_of(space, FLATICS_VELOCITY_X, &vx);
+  flatics_view_of(space, FLATICS_VELOCITY_Y, &vy);
+  flatics_view_of(space, FLATICS_MASS, &mass);
+
+  for (i = 0; i < count; ++i) {
+    double speed = AT(vx, i) * AT(vx, i) + AT(vy, i) * AT(vy, i);
+
+    total += AT(mass, i);
+    cx += AT(mass, i) * AT(x, i);
+    cy += AT(mass, i) * AT(y, i);
+
+    if (speed > top) {
+      top = speed;
+      fastest = i;
+    }
+  }
+
+  if (count > 0)
+    printf("%zu bodies, centre of mass (%.2f, %.2f), fastest is id %zu\n", count, cx / total, cy / total, ids[fastest]);
+  else
+    printf("no bodies\n");
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+  flatics_real *x, *y, *vx, *vy, *radius, *mass;
+  size_t *ids, i, removed;
+  flatics_space* space;
+  int step;
+
+  if (flatics_version() != FLATICS_C_VERSION || flatics_real_size() != sizeof(flatics_real)) {
+    fprintf(stderr, "library doesn't match flatics_c.h\n");
+    return 1;
+  }
+
+  space = flatics_create(10000, 10000, FLATICS_BOUNCE);
+  if (!space)
+    return 1;
+
+  if (!flatics_set_object_gravity(space, 0) || !flatics_set_broadphase(space, FLATICS_AABB_TREE) ||
+      !flatics_set_gravity(space, 0, 9.8)) {
+    fprintf(stderr, "could not configure the space\n");
+    return 1;
+  }
+
+  x = malloc(count * sizeof(flatics_real));
+  y = malloc(count * sizeof(flatics_real));
+  vx = malloc(count * sizeof(flatics_real));
+  vy = malloc(count * sizeof(flatics_real));
+  radius = malloc(count * sizeof(flatics_real));
+  mass = malloc(count * sizeof(flatics_real));
+  ids = malloc(count * sizeof(size_t));
+
+  srand(1);
+  for (i = 0; i < count; ++i) {
+    x[i] = 10 + (flatics_real)rand() / RAND_MAX * 9980;
+    y[i] = 10 + (flatics_real)rand() / RAND_MAX * 9980;
+    vx[i] = (flatics_real)rand() / RAND_MAX * 20 - 10;
+    vy[i] = (flatics_real)rand() / RAND_MAX * 20 - 10;
+    radius[i] = 2;
+    mass[i] = 1 + (flatics_real)rand() / RAND_MAX;
+  }
+
+  if (flatics_add(space, count, x, y, vx, vy, radius, mass, ids) != count) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  report(space);
+
+  for (step = 0; step < 60; ++step) {
+    if (!flatics_step(space, 1.0 / 60)) {
+      fprintf(stderr, "step failed\n");
+      return 1;
+    }
+  }
+
+  report(space);
+
+  if (!flatics_remove(space, ids, count / 10, &removed)) {
+    fprintf(stderr, "remove failed\n");
+    return 1;
+  }
+
+  printf("removed %zu\n", removed);
+  report(space);
+
+  flatics_destroy(space);
+  free(x); free(y); free(vx); free(vy); free(radius); free(mass); free(ids);
+  return 0;
+}
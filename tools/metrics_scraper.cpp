@@ -0,0 +1,367 @@
+// Stand-in Prometheus scraper for the metrics a Space exports with
+// setMetrics(), for checking the export without a Prometheus server.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src metrics_scraper.cpp -o metrics_scraper
+//   ./metrics_scraper <port | text file> [--seconds N] [--interval ms]
+//   ./metrics_scraper --self-test
+//
+// Given a port, it scrapes http://127.0.0.1:port/metrics (a SocketExporter);
+// given a path, it reads the file a PrometheusFileExporter writes. Every
+// interval it parses the exposition, checks that it is well formed (every
+// sample has a TYPE, histogram buckets are cumulative and end in +Inf, counters
+// never go down between scrapes) and prints a line of the headline values.
+//
+// --self-test steps a Space with both exporters attached, scrapes them from
+// another thread while it runs, and checks the fused metrics against a
+// separate pass of energy() and momentum(). It exits nonzero on any failure.
+
+#include "Circle.h"
+#include "Metrics.h"
+#include "Space.h"
+#include "Vector2.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace flatics;
+
+typedef std::map<std::string, double> Samples;
+
+/** The response body of a GET on 127.0.0.1:port, empty on failure */
+std::string scrapePort(uint16_t port) {
+#ifndef _WIN32
+  int connection = ::socket(AF_INET, SOCK_STREAM, 0);
+
+  if (connection < 0)
+    return std::string();
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  // don't hang forever on a simulation that stopped stepping
+  timeval timeout = { 5, 0 };
+  ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::string response;
+
+  if (::connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+    const char request[] = "GET /metrics HTTP/1.0\r\nHost: localhost\r\n\r\n";
+    ::send(connection, request, sizeof(request) - 1, MSG_NOSIGNAL);
+
+    char buffer[4096];
+    ssize_t received;
+
+    while ((received = ::recv(connection, buffer, sizeof(buffer), 0)) > 0)
+      response.append(buffer, static_cast<size_t>(received));
+  }
+
+  ::close(connection);
+
+  const size_t body = response.find("\r\n\r\n");
+  return response.compare(0, 12, "HTTP/1.0 200") == 0 && body != std::string::npos ? response.substr(body + 4) : std::string();
+#else
+  (void)port;
+  return std::string();
+#endif
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  std::ostringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+/** The family a sample belongs to: its name without labels or histogram suffixes */
+std::string familyOf(const std::string& sample, const std::map<std::string, std::string>& types) {
+  std::string name = sample.substr(0, sample.find('{'));
+
+  if (types.count(name))
+    return name;
+
+  const char* suffixes[] = { "_bucket", "_sum", "_count" };
+
+  for (const char* suffix : suffixes) {
+    const size_t length = std::strlen(suffix);
+
+    if (name.size() > length && name.compare(name.size() - length, length, suffix) == 0)
+      return name.substr(0, name.size() - length);
+  }
+
+  return name;
+}
+
+/** Parse and check an exposition; problems are appended to errors */
+Samples parse(const std::string& text, std::string& errors) {
+  Samples samples;
+  std::map<std::string, std::string> types;
+  std::istringstream lines(text);
+  std::string line;
+  double last_bucket = -1;
+
+  while (std::getline(lines, line)) {
+    if (line.empty())
+      continue;
+
+    if (line[0] == '#') {
+      std::istringstream comment(line);
+      std::string hash, kind, name, type;
+      comment >> hash >> kind >> name >> type;
+
+      if (kind == "TYPE")
+        types[name] = type;
+
+      continue;
+    }
+
+    const size_t space = line.rfind(' ');
+    const std::string name = line.substr(0, space);
+    char* end = nullptr;
+    const double value = std::strtod(line.c_str() + space + 1, &end);
+
+    if (space == std::string::npos || *end != '\0') {
+      errors += "  unparseable line: " + line + "\n";
+      continue;
+    }
+
+    const std::string family = familyOf(name, types);
+
+    if (!types.count(family))
+      errors += "  no TYPE for " + name + "\n";
+
+    if (name.compare(0, family.size() + 7, family + "_bucket") == 0) {
+      if (value < last_bucket)
+        errors += "  histogram buckets not cumulative at " + name + "\n";
+      last_bucket = value;
+    } else {
+      last_bucket = -1;
+    }
+
+    samples[name] = value;
+  }
+
+  for (const auto& type : types) {
+    if (type.second == "histogram" && !samples.count(type.first + "_bucket{le=\"+Inf\"}"))
+      errors += "  histogram " + type.first + " has no +Inf bucket\n";
+  }
+
+  return samples;
+}
+
+/** Counters that went down since the previous scrape */
+std::string checkCounters(const Samples& previous, const Samples& current) {
+  std::string errors;
+
+  for (const auto& sample : current) {
+    const std::string& name = sample.first;
+    const bool counter = name.find("_total") != std::string::npos || name.find("_bucket") != std::string::npos ||
+                         name.find("_count") != std::string::npos;
+    Samples::const_iterator before = previous.find(name);
+
+    if (counter && before != previous.end() && sample.second < before->second)
+      errors += "  counter went down: " + name + "\n";
+  }
+
+  return errors;
+}
+
+void printSummary(const Samples& samples) {
+  auto value = [&samples](const char* name) {
+    Samples::const_iterator it = samples.find(name);
+    return it == samples.end() ? 0.0 : it->second;
+  };
+
+  const double steps = value("flatics_step_seconds_count");
+  const double mean_ms = steps > 0 ? value("flatics_step_seconds_sum") / steps * 1e3 : 0;
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "step " << std::setw(8) << static_cast<uint64_t>(value("flatics_steps_total"))
+            << "  bodies " << std::setw(7) << static_cast<uint64_t>(value("flatics_bodies"))
+            << "  energy " << std::setw(14) << value("flatics_kinetic_energy")
+            << "  momentum (" << value("flatics_momentum{axis=\"x\"}") << ", " << value("flatics_momentum{axis=\"y\"}") << ")"
+            << "  max speed " << value("flatics_max_speed")
+            << "  contacts " << static_cast<uint64_t>(value("flatics_contacts"))
+            << "  mean step " << mean_ms << " ms" << std::endl;
+}
+
+int scrapeLoop(const std::string& source, double seconds, int interval_ms) {
+  const bool port = source.find_first_not_of("0123456789") == std::string::npos;
+  const auto start = std::chrono::steady_clock::now();
+  Samples previous;
+  int failures = 0;
+
+  while (seconds <= 0 || std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds)) {
+    const std::string text = port ? scrapePort(static_cast<uint16_t>(std::atoi(source.c_str()))) : readFile(source);
+
+    if (text.empty()) {
+      std::cout << "nothing at " << source << std::endl;
+    } else {
+      std::string errors;
+      Samples samples = parse(text, errors);
+      errors += checkCounters(previous, samples);
+
+      printSummary(samples);
+
+      if (!errors.empty()) {
+        std::cout << errors;
+        ++failures;
+      }
+
+      previous.swap(samples);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+  }
+
+  return failures ? 1 : 0;
+}
+
+bool near(double a, double b) {
+  return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
+}
+
+int selfTest() {
+  typedef Space<double, Vector2<double> > World;
+
+  World world(1000, 1000, World::BOUNCE, Vector2<double>(0, 9.8));
+  world.setObjectGravity(false);
+  world.setBroadphase(World::SPATIAL_HASH);
+
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<double> position(20, 980), velocity(-50, 50);
+
+  for (int i = 0; i < 5000; ++i)
+    world.addCircle(3.0, 1.0 + i % 7, Vector2<double>(position(rng), position(rng)), Vector2<double>(velocity(rng), velocity(rng)));
+
+  SocketExporter socket;
+  const std::string path = "flatics_metrics_selftest.prom";
+  PrometheusFileExporter file(path, 10);
+
+  struct Both : MetricsExporter {
+    MetricsExporter* a;
+    MetricsExporter* b;
+    void publish(const StepMetrics& metrics) { a->publish(metrics); b->publish(metrics); }
+  } both;
+  both.a = &socket;
+  both.b = &file;
+
+  if (!socket.open(0)) {
+    std::cout << "couldn't listen on a loopback port" << std::endl;
+    return 1;
+  }
+
+  world.setMetrics(true, &both);
+
+  std::atomic<bool> running(true);
+  std::atomic<int> scrapes(0), bad(0);
+  const uint16_t port = socket.port();
+
+  std::thread scraper([&]() {
+    Samples previous;
+
+    while (running) {
+      const std::string text = scrapePort(port);
+
+      if (text.empty())
+        continue;
+
+      std::string errors;
+      Samples samples = parse(text, errors);
+      errors += checkCounters(previous, samples);
+
+      if (!errors.empty()) {
+        std::cout << errors;
+        ++bad;
+      }
+
+      previous.swap(samples);
+      ++scrapes;
+    }
+  });
+
+  int failures = 0;
+
+  for (int step = 0; step < 400; ++step) {
+    world.update(0.005);
+
+    const StepMetrics& metrics = world.metrics();
+
+    if (!near(metrics.kinetic_energy, world.energy()) || !near(metrics.momentum_x, world.momentum().x) ||
+        !near(metrics.momentum_y, world.momentum().y) || metrics.bodies != world.objects().size()) {
+      std::cout << "step " << step << ": fused metrics differ from a separate pass" << std::endl;
+      ++failures;
+    }
+  }
+
+  // keep stepping until the scraper has seen a few more, then stop it
+  for (int wait = 0; wait < 1000 && scrapes < 5; ++wait)
+    world.update(0.005);
+
+  running = false;
+  for (int wait = 0; wait < 200; ++wait)
+    world.update(0.005);
+  scraper.join();
+
+  std::string errors;
+  Samples samples = parse(readFile(path), errors);
+  std::remove(path.c_str());
+
+  if (!errors.empty() || samples["flatics_steps_total"] <= 0) {
+    std::cout << "bad text file:" << std::endl << errors;
+    ++failures;
+  }
+
+  std::cout << scrapes << " scrapes over the socket, " << bad << " bad; " << file.writes() << " text files written" << std::endl;
+  printSummary(samples);
+
+  failures += bad + (scrapes == 0);
+  std::cout << (failures ? "FAILED" : "ok") << std::endl;
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  std::string source;
+  double seconds = 0;
+  int interval_ms = 1000;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    if (arg == "--self-test")
+      return selfTest();
+    else if (arg == "--seconds" && i + 1 < argc)
+      seconds = std::atof(argv[++i]);
+    else if (arg == "--interval" && i + 1 < argc)
+      interval_ms = std::atoi(argv[++i]);
+    else
+      source = arg;
+  }
+
+  if (source.empty()) {
+    std::cerr << "usage: metrics_scraper <port | text file> [--seconds N] [--interval ms]" << std::endl
+              << "       metrics_scraper --self-test" << std::endl;
+    return 2;
+  }
+
+  return scrapeLoop(source, seconds, interval_ms);
+}
@@ -0,0 +1,96 @@
+// Replays a journal recorded with Space::startJournal() (flatics-journal.flj
+// from the demo) and reports whether it re-executed the same session.
+//
+//   g++ -std=c++11 -O2 -pthread -I../src replay.cpp -o replay
+//   ./replay flatics-journal.flj [more journals...]
+//
+// The space is set up like the demo's (default gravity solver, a pool with as
+// many workers as the recording had), then every step is taken again as fast
+// as it will go. For each journal it prints the steps and changes replayed,
+// the state hashes compared and the first step where they stopped matching,
+// and how much faster than real time the replay ran. It exits nonzero if any
+// journal diverged or couldn't be read.
+
+#include "Circle.h"
+#include "Journal.h"
+#include "Space.h"
+#include "ThreadPool.h"
+#include "Vector2.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace flatics;
+
+template<typename Scalar>
+bool replay(const std::string& path, const JournalHeader& header) {
+  typedef Space<Scalar, Vector2<Scalar> > World;
+
+  std::unique_ptr<ThreadPool> pool;
+  World world(static_cast<size_t>(header.width), static_cast<size_t>(header.height));
+
+  if (header.threads > 0) {
+    pool.reset(new ThreadPool(header.threads));
+    world.setThreadPool(pool.get());
+  }
+
+  JournalReplay result;
+  const auto start = std::chrono::steady_clock::now();
+
+  if (!world.replay(path, result)) {
+    std::cout << path << ": not a journal this build can replay" << std::endl;
+    return false;
+  }
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << path << ": " << result.steps << " steps, " << result.records << " records, "
+            << result.hashes << " hashes, " << world.objects().size() << " bodies at the end"
+            << (result.complete ? "" : " (cut off, no end record)") << std::endl
+            << std::fixed << std::setprecision(2) << "  " << result.simulated_seconds << " s simulated in " << seconds
+            << " s, " << (seconds > 0 ? result.simulated_seconds / seconds : 0) << "x real time" << std::endl;
+
+  if (result.diverged_step != 0) {
+    std::cout << "  DIVERGED at step " << result.diverged_step << std::endl;
+    return false;
+  }
+
+  std::cout << "  same as recorded" << std::endl;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: replay <journal> [more journals...]" << std::endl;
+    return 2;
+  }
+
+  int failures = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    JournalReader reader;
+
+    if (!reader.open(argv[i])) {
+      std::cout << argv[i] << ": not a journal" << std::endl;
+      ++failures;
+      continue;
+    }
+
+    const JournalHeader& header = reader.header();
+    std::cout << "seed " << header.seed << ", step " << header.step << " s, " << header.threads << " workers" << std::endl;
+
+    bool same;
+
+    if (header.scalar_size == sizeof(float))
+      same = replay<float>(argv[i], header);
+    else
+      same = replay<double>(argv[i], header);
+
+    failures += !same;
+  }
+
+  return failures ? 1 : 0;
+}
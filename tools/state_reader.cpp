@@ -0,0 +1,115 @@
+// Stand-in consumer of the shared memory state a Space publishes with
+// setSharedState(), for checking the export from another process.
+//
+//   g++ -std=c++11 -O2 -I../src state_reader.cpp -o state_reader   (add -lrt on older glibc)
+//   ./state_reader [segment name, default /flatics] [--float] [--seconds N]
+//
+// Polls the segment for new steps and once a second prints the steps it
+// read whole, the steps the writer finished without it seeing them, the reads
+// it had to retry because the writer overwrote them, and a summary of the
+// latest step (bodies, centre of mass, kinetic energy). Follows the writer
+// when it replaces the segment, and waits for it if it isn't there yet.
+
+#include "SharedState.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace flatics;
+
+template<typename Scalar>
+int consume(const std::string& name, double seconds) {
+  typedef std::chrono::steady_clock Clock;
+
+  SharedStateReader<Scalar> reader;
+  const Clock::time_point start = Clock::now();
+  Clock::time_point report = start;
+
+  uint64_t last_step = 0;
+  size_t whole = 0, missed = 0, retries = 0;
+  size_t count = 0;
+  double time = 0, com_x = 0, com_y = 0, energy = 0;
+
+  while (seconds <= 0 || Clock::now() - start < std::chrono::duration<double>(seconds)) {
+    if (!reader.isOpen() || reader.retired()) {
+      if (!reader.open(name)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        continue;
+      }
+
+      std::cout << "mapped " << name << std::endl;
+      last_step = 0;
+    }
+
+    if (reader.step() == last_step) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    typename SharedStateReader<Scalar>::View view;
+    if (!reader.begin(view)) {
+      // the writer is in the middle of a step
+      std::this_thread::yield();
+      continue;
+    }
+
+    // read straight out of the segment, then check the writer left it alone
+    double mass = 0, x = 0, y = 0, kinetic = 0;
+
+    for (size_t i = 0; i < view.count; ++i) {
+      mass += view.mass[i];
+      x += view.mass[i] * view.x[i];
+      y += view.mass[i] * view.y[i];
+      kinetic += 0.5 * view.mass[i] * (double(view.vx[i]) * view.vx[i] + double(view.vy[i]) * view.vy[i]);
+    }
+
+    if (!reader.validate()) {
+      ++retries;
+      continue;
+    }
+
+    if (last_step != 0 && view.step > last_step + 1)
+      missed += view.step - last_step - 1;
+
+    last_step = view.step;
+    ++whole;
+    count = view.count;
+    time = view.time;
+    com_x = mass > 0 ? view.origin_x + x / mass : view.origin_x;
+    com_y = mass > 0 ? view.origin_y + y / mass : view.origin_y;
+    energy = kinetic;
+
+    if (Clock::now() - report >= std::chrono::seconds(1)) {
+      std::cout << "step " << last_step << " t=" << std::setprecision(4) << time
+                << ": " << whole << " read, " << missed << " missed, " << retries << " retried; "
+                << count << " bodies, centre of mass (" << com_x << ", " << com_y << "), kinetic energy " << energy << std::endl;
+
+      whole = missed = retries = 0;
+      report = Clock::now();
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  std::string name = "/flatics";
+  bool single = false;
+  double seconds = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--float") == 0)
+      single = true;
+    else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+      seconds = std::atof(argv[++i]);
+    else
+      name = argv[i];
+  }
+
+  return single ? consume<float>(name, seconds) : consume<double>(name, seconds);
+}